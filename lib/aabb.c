@@ -0,0 +1,203 @@
+#include "aabb.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AABB_X86
+#endif
+
+#include "entity.h"
+#include "scalar.h"
+
+
+void overlapBatchScalar(
+    Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits
+) {
+    memset(hits, 0, hitWords(n) * sizeof(uint64_t));
+    Bounds box = {.width = width, .height = height};
+
+    for (int i = 0; i < n; ++i) {
+        box.x = x[i];
+        box.y = y[i];
+        hits[i / 64] |= (uint64_t)checkCollisionBounds(box, query) << (i % 64);
+    }
+}
+
+#ifdef AABB_X86
+
+/**
+ * The sums are the same ones the scalar test does (box.x + width and query.x + query.width),
+ * so the float paths round the same way.
+ */
+void overlapBatchSse2(
+    Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits
+) {
+    memset(hits, 0, hitWords(n) * sizeof(uint64_t));
+    int i = 0;
+
+#ifdef FIXED_POINT_SIM
+    const __m128i left   = _mm_set1_epi32(query.x);
+    const __m128i right  = _mm_set1_epi32(query.x + query.width);
+    const __m128i top    = _mm_set1_epi32(query.y);
+    const __m128i bottom = _mm_set1_epi32(query.y + query.height);
+    const __m128i w      = _mm_set1_epi32(width);
+    const __m128i h      = _mm_set1_epi32(height);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i boxX = _mm_loadu_si128((const __m128i *)(x + i));
+        __m128i boxY = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i mask = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(boxX, w), left), _mm_cmpgt_epi32(right, boxX)),
+            _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(boxY, h), top), _mm_cmpgt_epi32(bottom, boxY))
+        );
+        hits[i / 64] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(mask)) << (i % 64);
+    }
+#else
+    const __m128 left   = _mm_set1_ps(query.x);
+    const __m128 right  = _mm_set1_ps(query.x + query.width);
+    const __m128 top    = _mm_set1_ps(query.y);
+    const __m128 bottom = _mm_set1_ps(query.y + query.height);
+    const __m128 w      = _mm_set1_ps(width);
+    const __m128 h      = _mm_set1_ps(height);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 boxX = _mm_loadu_ps(x + i);
+        __m128 boxY = _mm_loadu_ps(y + i);
+        __m128 mask = _mm_and_ps(
+            _mm_and_ps(_mm_cmplt_ps(left, _mm_add_ps(boxX, w)), _mm_cmpgt_ps(right, boxX)),
+            _mm_and_ps(_mm_cmplt_ps(top, _mm_add_ps(boxY, h)), _mm_cmpgt_ps(bottom, boxY))
+        );
+        hits[i / 64] |= (uint64_t)_mm_movemask_ps(mask) << (i % 64);
+    }
+#endif
+
+    Bounds box = {.width = width, .height = height};
+    for (; i < n; ++i) {
+        box.x = x[i];
+        box.y = y[i];
+        hits[i / 64] |= (uint64_t)checkCollisionBounds(box, query) << (i % 64);
+    }
+}
+
+__attribute__((target("avx2")))
+void overlapBatchAvx2(
+    Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits
+) {
+    memset(hits, 0, hitWords(n) * sizeof(uint64_t));
+    int i = 0;
+
+#ifdef FIXED_POINT_SIM
+    const __m256i left   = _mm256_set1_epi32(query.x);
+    const __m256i right  = _mm256_set1_epi32(query.x + query.width);
+    const __m256i top    = _mm256_set1_epi32(query.y);
+    const __m256i bottom = _mm256_set1_epi32(query.y + query.height);
+    const __m256i w      = _mm256_set1_epi32(width);
+    const __m256i h      = _mm256_set1_epi32(height);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i boxX = _mm256_loadu_si256((const __m256i *)(x + i));
+        __m256i boxY = _mm256_loadu_si256((const __m256i *)(y + i));
+        __m256i mask = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(boxX, w), left), _mm256_cmpgt_epi32(right, boxX)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(boxY, h), top), _mm256_cmpgt_epi32(bottom, boxY))
+        );
+        hits[i / 64] |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(mask)) << (i % 64);
+    }
+#else
+    const __m256 left   = _mm256_set1_ps(query.x);
+    const __m256 right  = _mm256_set1_ps(query.x + query.width);
+    const __m256 top    = _mm256_set1_ps(query.y);
+    const __m256 bottom = _mm256_set1_ps(query.y + query.height);
+    const __m256 w      = _mm256_set1_ps(width);
+    const __m256 h      = _mm256_set1_ps(height);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 boxX = _mm256_loadu_ps(x + i);
+        __m256 boxY = _mm256_loadu_ps(y + i);
+        __m256 mask = _mm256_and_ps(
+            _mm256_and_ps(
+                _mm256_cmp_ps(left, _mm256_add_ps(boxX, w), _CMP_LT_OQ),
+                _mm256_cmp_ps(right, boxX, _CMP_GT_OQ)
+            ),
+            _mm256_and_ps(
+                _mm256_cmp_ps(top, _mm256_add_ps(boxY, h), _CMP_LT_OQ),
+                _mm256_cmp_ps(bottom, boxY, _CMP_GT_OQ)
+            )
+        );
+        hits[i / 64] |= (uint64_t)_mm256_movemask_ps(mask) << (i % 64);
+    }
+#endif
+
+    Bounds box = {.width = width, .height = height};
+    for (; i < n; ++i) {
+        box.x = x[i];
+        box.y = y[i];
+        hits[i / 64] |= (uint64_t)checkCollisionBounds(box, query) << (i % 64);
+    }
+}
+
+#endif
+
+static OverlapKernel overlapKernel = overlapBatchScalar;
+static const char *overlapKernelName = "scalar";
+
+// Resolved before main, so the sessions running on other threads only read it
+__attribute__((constructor))
+static void pickOverlapKernel() {
+#ifdef AABB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        overlapKernel = overlapBatchAvx2;
+        overlapKernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        overlapKernel = overlapBatchSse2;
+        overlapKernelName = "sse2";
+    }
+#endif
+}
+
+void overlapBatch(Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits) {
+    overlapKernel(query, x, y, width, height, n, hits);
+}
+
+const char *overlapBatchPath() {
+    return overlapKernelName;
+}
+
+Bounds sweptBounds(Bounds box, Scalar dy) {
+    if (dy < 0) box.y += dy;
+    box.height += dy < 0 ? -dy : dy;
+
+    return box;
+}
+
+Scalar timeOfImpact(Bounds box, Scalar dy, Bounds target) {
+    Scalar gap;
+    if (dy > 0) gap = target.y - (box.y + box.height);
+    else gap = box.y - (target.y + target.height);
+
+    if (gap <= 0 || dy == 0) return SC(0.0f);
+    return scDiv(gap, dy > 0 ? dy : -dy);
+}
+
+int overlapKernels(OverlapKernel kernels[3], const char *names[3]) {
+    int n = 0;
+    kernels[n] = overlapBatchScalar;
+    names[n++] = "scalar";
+
+#ifdef AABB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels[n] = overlapBatchSse2;
+        names[n++] = "sse2";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[n] = overlapBatchAvx2;
+        names[n++] = "avx2";
+    }
+#endif
+
+    return n;
+}
@@ -0,0 +1,36 @@
+#ifndef _AABB_H_
+#define _AABB_H_
+
+#include <stdint.h>
+
+#include "entity.h"
+#include "scalar.h"
+
+#define hitWords(n) (((n) + 63) / 64)
+
+
+typedef void (*OverlapKernel)(
+    Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits
+);
+
+/**
+ * Tests query against n boxes of the same size stored as x and y arrays, bit i of hits is set
+ * when box i overlaps it, with the same test as checkCollisionBounds (and CheckCollisionRecs).
+ * hits must have room for hitWords(n) words, they are cleared first.
+ * The AVX2, SSE2 or scalar path is picked once by CPU detection.
+ */
+void overlapBatch(Bounds query, const Scalar *x, const Scalar *y, Scalar width, Scalar height, int n, uint64_t *hits);
+const char *overlapBatchPath();
+
+// Box covering every position of box moving by dy along y
+Bounds sweptBounds(Bounds box, Scalar dy);
+/**
+ * Fraction of the move by dy along y after which box starts to overlap target, 0 when they
+ * overlap from the start. Only meaningful when their swept bounds overlap.
+ */
+Scalar timeOfImpact(Bounds box, Scalar dy, Bounds target);
+
+// Every path the CPU can run, for benchmarks and equivalence checks, returns how many were written
+int overlapKernels(OverlapKernel kernels[3], const char *names[3]);
+
+#endif
@@ -0,0 +1,163 @@
+#include "alloc.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Right before each block, offset is where the block starts in what libc returned
+typedef struct AllocHeader {
+    uint64_t size;
+    uint32_t offset;
+    uint32_t tag;
+} AllocHeader;
+
+// Keeps the blocks on the alignment malloc gives
+#define ALLOC_OFFSET sizeof(AllocHeader)
+_Static_assert(sizeof(AllocHeader) % alignof(max_align_t) == 0, "the header breaks the alignment of malloc");
+
+typedef struct AllocCounters {
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t liveBytes;
+    atomic_uint          calls;
+    atomic_uint          frees;
+    atomic_uint          zoneCalls;
+} AllocCounters;
+
+static const char *tagNames[N_ALLOC_TAGS] = {
+    [ALLOC_GAME]     = "game",
+    [ALLOC_SNAPSHOT] = "snapshot",
+    [ALLOC_COMMANDS] = "commands",
+    [ALLOC_JOBS]     = "jobs",
+    [ALLOC_BATCH]    = "batch",
+    [ALLOC_LEVEL]    = "level",
+    [ALLOC_REPLAY]   = "replay",
+    [ALLOC_EVENTS]   = "events",
+    [ALLOC_BENCH]    = "bench",
+};
+
+static AllocCounters counters[N_ALLOC_TAGS];
+// Each thread has its own zones, an allocation is charged to those of the thread making it
+static _Thread_local int zoneDepth;
+// The zone opened last on the thread, for the message of ALLOC_GUARD
+static _Thread_local const char *zoneName;
+
+
+static void countAlloc(AllocTag tag, size_t size) {
+    AllocCounters *tagCounters = &counters[tag];
+    atomic_fetch_add(&tagCounters->bytes, size);
+    atomic_fetch_add(&tagCounters->calls, 1);
+
+    if (zoneDepth > 0) {
+        atomic_fetch_add(&tagCounters->zoneCalls, 1);
+#ifdef ALLOC_GUARD
+        fprintf(stderr, "%zu bytes of %s allocated in %s.\n", size, tagNames[tag], zoneName);
+        abort();
+#endif
+    }
+}
+
+static AllocHeader *blockHeader(void *ptr) {
+    return (AllocHeader *)((uint8_t *)ptr - sizeof(AllocHeader));
+}
+
+static void *placeBlock(uint8_t *base, size_t offset, AllocTag tag, size_t size) {
+    if (base == NULL) return NULL;
+
+    void *ptr = base + offset;
+    *blockHeader(ptr) = (AllocHeader) {.size = size, .offset = (uint32_t)offset, .tag = tag};
+    atomic_fetch_add(&counters[tag].liveBytes, size);
+    return ptr;
+}
+
+void *gameAlloc(AllocTag tag, size_t size) {
+    countAlloc(tag, size);
+    return placeBlock((uint8_t *)malloc(ALLOC_OFFSET + size), ALLOC_OFFSET, tag, size);
+}
+
+void *gameCalloc(AllocTag tag, size_t n, size_t size) {
+    if (size != 0 && n > (SIZE_MAX - ALLOC_OFFSET) / size) return NULL;
+
+    countAlloc(tag, n * size);
+    return placeBlock((uint8_t *)calloc(1, ALLOC_OFFSET + n * size), ALLOC_OFFSET, tag, n * size);
+}
+
+void *gameAlignedAlloc(AllocTag tag, size_t alignment, size_t size) {
+    // The header takes a whole alignment step, so the block after it stays aligned
+    size_t offset = alignment > ALLOC_OFFSET ? alignment : ALLOC_OFFSET;
+    size_t total = (offset + size + offset - 1) / offset * offset;
+
+    countAlloc(tag, size);
+    return placeBlock((uint8_t *)aligned_alloc(offset, total), offset, tag, size);
+}
+
+void *gameRealloc(AllocTag tag, void *ptr, size_t size) {
+    if (ptr == NULL) return gameAlloc(tag, size);
+
+    AllocHeader header = *blockHeader(ptr);
+    void *moved;
+    if (header.offset == ALLOC_OFFSET) {
+        countAlloc(header.tag, size);
+        moved = placeBlock(
+            (uint8_t *)realloc((uint8_t *)ptr - ALLOC_OFFSET, ALLOC_OFFSET + size), ALLOC_OFFSET, header.tag, size
+        );
+        // realloc left the old block in place when it failed
+        if (moved == NULL) return NULL;
+    } else {
+        moved = gameAlignedAlloc(header.tag, header.offset, size);
+        if (moved == NULL) return NULL;
+        memcpy(moved, ptr, header.size < size ? header.size : size);
+        free((uint8_t *)ptr - header.offset);
+    }
+
+    atomic_fetch_sub(&counters[header.tag].liveBytes, header.size);
+    return moved;
+}
+
+void gameFree(void *ptr) {
+    if (ptr == NULL) return;
+
+    AllocHeader header = *blockHeader(ptr);
+    atomic_fetch_add(&counters[header.tag].frees, 1);
+    atomic_fetch_sub(&counters[header.tag].liveBytes, header.size);
+    free((uint8_t *)ptr - header.offset);
+}
+
+void beginNoAllocZone(const char *name) {
+    zoneName = name;
+    zoneDepth++;
+}
+
+void endNoAllocZone(void) {
+    zoneDepth--;
+}
+
+AllocStats getAllocStats(AllocTag tag) {
+    AllocCounters *tagCounters = &counters[tag];
+    return (AllocStats) {
+        .bytes     = atomic_load(&tagCounters->bytes),
+        .liveBytes = atomic_load(&tagCounters->liveBytes),
+        .calls     = atomic_load(&tagCounters->calls),
+        .frees     = atomic_load(&tagCounters->frees),
+        .zoneCalls = atomic_load(&tagCounters->zoneCalls),
+    };
+}
+
+const char *allocTagName(AllocTag tag) {
+    return tagNames[tag];
+}
+
+uint32_t printAllocReport(FILE *out) {
+    uint32_t zoneCalls = 0;
+    fprintf(out, "%-9s %8s %12s %8s %12s %8s\n", "subsystem", "calls", "bytes", "frees", "live bytes", "in zones");
+    for (int tag = 0; tag < N_ALLOC_TAGS; ++tag) {
+        AllocStats stats = getAllocStats(tag);
+        fprintf(out, "%-9s %8u %12llu %8u %12llu %8u\n",
+            tagNames[tag], stats.calls, (unsigned long long)stats.bytes, stats.frees,
+            (unsigned long long)stats.liveBytes, stats.zoneCalls);
+        zoneCalls += stats.zoneCalls;
+    }
+
+    return zoneCalls;
+}
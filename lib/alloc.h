@@ -0,0 +1,60 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// Subsystem a heap allocation is counted under
+typedef enum AllocTag {
+    ALLOC_GAME,
+    ALLOC_SNAPSHOT,
+    ALLOC_COMMANDS,
+    ALLOC_JOBS,
+    ALLOC_BATCH,
+    ALLOC_LEVEL,
+    ALLOC_REPLAY,
+    ALLOC_EVENTS,
+    ALLOC_BENCH,
+    N_ALLOC_TAGS
+} AllocTag;
+
+typedef struct AllocStats {
+    // Requested over the run, a reallocation counts its new size
+    uint64_t bytes;
+    uint64_t liveBytes;
+    uint32_t calls;
+    uint32_t frees;
+    // Calls made while a no-allocation zone was open
+    uint32_t zoneCalls;
+} AllocStats;
+
+/**
+ * Every heap allocation of the project goes through these, so the bytes and calls of each
+ * subsystem are known. Blocks from any of them are given back with gameFree.
+ * raylib and libc (getline, stdio) allocate on their own and aren't counted.
+ */
+void *gameAlloc(AllocTag tag, size_t size);
+void *gameCalloc(AllocTag tag, size_t n, size_t size);
+// Allocates under tag when ptr is NULL, a block otherwise keeps the tag it was allocated with
+void *gameRealloc(AllocTag tag, void *ptr, size_t size);
+void *gameAlignedAlloc(AllocTag tag, size_t alignment, size_t size);
+void gameFree(void *ptr);
+
+/**
+ * The steady state (updateGame, buildSnapshot, drawing) runs inside no-allocation zones, which
+ * nest and belong to the thread that opened them: a thread running part of a stage for another
+ * opens its own. An allocation while one of its thread is open is counted in zoneCalls;
+ * building with -DALLOC_GUARD makes it abort instead, naming the zone.
+ */
+void beginNoAllocZone(const char *name);
+void endNoAllocZone(void);
+
+AllocStats getAllocStats(AllocTag tag);
+const char *allocTagName(AllocTag tag);
+// A line per subsystem, returns the number of calls made inside the zones
+uint32_t printAllocReport(FILE *out);
+
+#endif
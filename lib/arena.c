@@ -0,0 +1,36 @@
+#include "arena.h"
+
+#include <stdio.h>
+
+
+int createArena(Arena *arena, AllocTag tag, size_t size) {
+    size = arenaBytes(size);
+    *arena = (Arena) {
+        .base = (uint8_t *)gameAlignedAlloc(tag, ARENA_ALIGNMENT, size),
+        .size = size,
+    };
+
+    if (arena->base == NULL) {
+        perror("failed to allocate an arena.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void destroyArena(Arena *arena) {
+    gameFree(arena->base);
+    *arena = (Arena) {0};
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = arenaBytes(size);
+    if (arena->size - arena->used < size) {
+        fprintf(stderr, "arena of %zu bytes is too small for %zu more.\n", arena->size, size);
+        return NULL;
+    }
+
+    void *ptr = arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
@@ -0,0 +1,32 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc.h"
+
+// A cache line, no two allocations share one
+#define ARENA_ALIGNMENT 64
+
+// Room an allocation of size takes in an arena
+#define arenaBytes(size) (((size_t)(size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+
+/**
+ * One block handed out front to back, freed at once. The owner sums the arenaBytes of what it
+ * will allocate to size it, so it's never grown.
+ */
+typedef struct Arena {
+    uint8_t *base;
+    size_t  size;
+    size_t  used;
+} Arena;
+
+// The memory isn't cleared, like malloc. Returns a negative value when it can't be allocated
+int createArena(Arena *arena, AllocTag tag, size_t size);
+void destroyArena(Arena *arena);
+// Aligned on ARENA_ALIGNMENT, NULL when the arena was sized too small
+void *arenaAlloc(Arena *arena, size_t size);
+
+#endif
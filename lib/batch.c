@@ -0,0 +1,151 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "gameData.h"
+#include "gameLogic.h"
+
+
+// Steps and observes the range of sessions of the worker
+void stepBatchRange(BatchEnv *envs, int index) {
+    const int first = (int)((int64_t)envs->nStepped * index / envs->nThreads);
+    const int last = (int)((int64_t)envs->nStepped * (index + 1) / envs->nThreads);
+    const uint32_t nSlots = batchObservationSize(envs);
+
+    for (int i = first; i < last; ++i) {
+        Game *game = &envs->games[i];
+        game->hotData->input = envs->inputs[BATCH_INPUTS_PER_ENV * i];
+        envs->commandInputs[i] = envs->inputs[BATCH_INPUTS_PER_ENV * i + 1];
+        updateGame(game, &envs->commands[i], scFromFloat(game->tickDuration));
+
+        if (envs->positions != NULL) {
+            Observation observation = {
+                .positions = envs->positions + 2 * (size_t)nSlots * i,
+                .alive     = envs->alive + (size_t)nSlots * i,
+            };
+            observeGame(game, &observation);
+        }
+        if (envs->states != NULL) envs->states[i] = (uint8_t)game->hotData->gameState;
+    }
+}
+
+void *batchWorker(void *arg) {
+    BatchWorker *worker = (BatchWorker *)arg;
+    BatchEnv *envs = worker->envs;
+
+    // Released once every worker is started and the barriers are set up for them
+    pthread_mutex_lock(&envs->startup);
+    pthread_mutex_unlock(&envs->startup);
+
+    for (;;) {
+        pthread_barrier_wait(&envs->start);
+        if (envs->stopping) break;
+        stepBatchRange(envs, worker->index);
+        pthread_barrier_wait(&envs->done);
+    }
+
+    return NULL;
+}
+
+static void freeBatchEnv(BatchEnv *envs) {
+    destroyArena(&envs->arena);
+    gameFree(envs->games);
+    gameFree(envs->commands);
+    gameFree(envs->commandInputs);
+    gameFree(envs->workers);
+    *envs = (BatchEnv) {0};
+}
+
+int createBatchEnv(BatchEnv *envs, int n, GameConfig config, int nThreads, uint64_t seed) {
+    if (n <= 0 || checkGameConfig(&config) < 0) return -1;
+    if (nThreads <= 0) nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > n) nThreads = n;
+    if (nThreads < 1) nThreads = 1;
+
+    *envs = (BatchEnv) {
+        .games         = (Game *)gameAlloc(ALLOC_BATCH, n * sizeof(Game)),
+        .commands      = (CommandsBufPlayer2 *)gameAlloc(ALLOC_BATCH, n * sizeof(CommandsBufPlayer2)),
+        .commandInputs = (Input *)gameCalloc(ALLOC_BATCH, n, sizeof(Input)),
+        .n             = n,
+        .workers       = (BatchWorker *)gameAlloc(ALLOC_BATCH, nThreads * sizeof(BatchWorker)),
+        .nThreads      = nThreads,
+    };
+    if (envs->games == NULL || envs->commands == NULL || envs->commandInputs == NULL || envs->workers == NULL
+        || createArena(&envs->arena, ALLOC_BATCH, n * gameArenaSize(&config, true)) < 0) {
+        perror("failed to allocate the batch sessions.\n");
+        freeBatchEnv(envs);
+        return -2;
+    }
+
+    // The hot data of every session first, next to each other, then the rest of each session
+    for (int i = 0; i < n; ++i) {
+        envs->games[i].hotData = initHotGameData(&envs->arena);
+    }
+    for (int i = 0; i < n; ++i) {
+        initHeadlessGameIn(&envs->games[i], config, &envs->arena, envs->games[i].hotData);
+        seedGame(&envs->games[i], seed + i);
+        envs->games[i].hotData->gameState = PLAYING;
+        envs->commands[i] = (CommandsBufPlayer2) {
+            .input    = &envs->commandInputs[i],
+            .capacity = 1,
+        };
+    }
+
+    // The caller is worker 0
+    pthread_mutex_init(&envs->startup, NULL);
+    pthread_mutex_lock(&envs->startup);
+    envs->workers[0] = (BatchWorker) {.envs = envs};
+    for (int i = 1; i < nThreads; ++i) {
+        envs->workers[i] = (BatchWorker) {.envs = envs, .index = i};
+        if (pthread_create(&envs->workers[i].thread, NULL, batchWorker, &envs->workers[i]) != 0) {
+            perror("failed to start a batch worker, running with fewer threads.\n");
+            envs->nThreads = i;
+            break;
+        }
+    }
+
+    pthread_barrier_init(&envs->start, NULL, envs->nThreads);
+    pthread_barrier_init(&envs->done, NULL, envs->nThreads);
+    pthread_mutex_unlock(&envs->startup);
+
+    return 0;
+}
+
+void destroyBatchEnv(BatchEnv *envs) {
+    envs->stopping = true;
+    pthread_barrier_wait(&envs->start);
+    for (int i = 1; i < envs->nThreads; ++i) {
+        pthread_join(envs->workers[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&envs->start);
+    pthread_barrier_destroy(&envs->done);
+    pthread_mutex_destroy(&envs->startup);
+
+    for (int i = 0; i < envs->n; ++i) {
+        cleanupGame(&envs->games[i]);
+    }
+    freeBatchEnv(envs);
+}
+
+uint32_t batchObservationSize(BatchEnv *envs) {
+    return envs->games[0].snapshotLayout.nEntities;
+}
+
+void setBatchObservation(BatchEnv *envs, float *positions, uint8_t *alive, uint8_t *states) {
+    envs->positions = positions;
+    envs->alive = alive;
+    envs->states = states;
+}
+
+void stepBatch(BatchEnv *envs, const Input *inputs, int n) {
+    envs->inputs = inputs;
+    envs->nStepped = n < envs->n ? n : envs->n;
+
+    pthread_barrier_wait(&envs->start);
+    stepBatchRange(envs, 0);
+    pthread_barrier_wait(&envs->done);
+}
@@ -0,0 +1,69 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "gameData.h"
+
+// Inputs of a session for a tick: player 1, then the single command of player 2
+#define BATCH_INPUTS_PER_ENV 2
+
+
+typedef struct BatchEnv BatchEnv;
+
+typedef struct BatchWorker {
+    BatchEnv  *envs;
+    pthread_t thread;
+    int       index;
+} BatchWorker;
+
+/**
+ * Independent headless sessions stepped in lockstep, for bots and balancing runs.
+ * The games are one array split in contiguous ranges between the workers, each session
+ * is only touched by the worker of its range, so the results don't depend on the threads.
+ * All the sessions are carved from one arena, the hot data of every one of them first.
+ * The sessions start playing and a finished one waits for START, as in the game.
+ */
+struct BatchEnv {
+    Game               *games;
+    Arena              arena;
+    CommandsBufPlayer2 *commands;
+    // Command of player 2 of every session, the buffers point into it
+    Input              *commandInputs;
+    int                n;
+    // Flat observation buffers of the caller, observed after each step when set
+    float              *positions;
+    uint8_t            *alive;
+    uint8_t            *states;
+    // Of the step in progress, read by the workers
+    const Input        *inputs;
+    int                nStepped;
+    BatchWorker        *workers;
+    int                nThreads;
+    pthread_mutex_t    startup;
+    pthread_barrier_t  start;
+    pthread_barrier_t  done;
+    bool               stopping;
+};
+
+/**
+ * n sessions of config, seeded from seed on, split across nThreads threads counting the caller,
+ * 0 for one per online core. Returns a negative value on failure.
+ */
+int createBatchEnv(BatchEnv *envs, int n, GameConfig config, int nThreads, uint64_t seed);
+void destroyBatchEnv(BatchEnv *envs);
+// Slots of the snapshot layout observed per session
+uint32_t batchObservationSize(BatchEnv *envs);
+/**
+ * Sets the buffers the steps write to: positions holds 2 * batchObservationSize floats per session
+ * and alive batchObservationSize bytes, both or neither are set. states holds one GameState per
+ * session and can be NULL on its own.
+ */
+void setBatchObservation(BatchEnv *envs, float *positions, uint8_t *alive, uint8_t *states);
+// Runs a tick of the first n sessions, inputs holds BATCH_INPUTS_PER_ENV per session
+void stepBatch(BatchEnv *envs, const Input *inputs, int n);
+
+#endif
@@ -0,0 +1,1549 @@
+#include "bench.h"
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aabb.h"
+#include "alloc.h"
+#include "arena.h"
+#include "batch.h"
+#include "broadphase.h"
+#include "entity.h"
+#include "eventBus.h"
+#include "eventChannel.h"
+#include "game.h"
+#include "gameData.h"
+#include "gameLogic.h"
+#include "jobs.h"
+#include "level.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "render.h"
+#include "rng.h"
+#include "spriteBatch.h"
+
+
+#define BENCH_TICK_DURATION 0.016f
+#define BENCH_COMMANDS_PER_TICK 3
+
+
+// Deterministic stand-in for a human: starts the match, strafes, fires and restarts after it ends
+void scriptedInput(uint32_t tick, Input *player1, CommandsBufPlayer2 *commandsPlayer2) {
+    *player1 = 0;
+    if (tick % 120 == 0) *player1 |= 1 << 5;
+    *player1 |= (tick / 90) % 2 ? 1 << 2 : 1 << 3;
+    if (tick % 7 == 0) *player1 |= 1 << 4;
+
+    for (int i = 0; i < commandsPlayer2->capacity; ++i) {
+        commandsPlayer2->input[i] = (tick / 60) % 2 ? 1 << 3 : 1 << 2;
+        if ((tick + i) % 11 == 0) commandsPlayer2->input[i] |= 1 << 4;
+    }
+}
+
+int recordScriptedReplay(const char *path, uint32_t nTicks) {
+    Game game;
+    ReplayWriter writer;
+    if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+
+    int result = openReplayWriter(&writer, path, &game, commands->capacity, BENCH_TICK_DURATION, 2112);
+    for (uint32_t tick = 0; result == 0 && tick < nTicks; ++tick) {
+        scriptedInput(tick, &game.hotData->input, commands);
+        result = recordTick(&writer, &game, commands);
+        updateGame(&game, commands, SC(BENCH_TICK_DURATION));
+    }
+
+    if (writer.file != NULL && closeReplayWriter(&writer) < 0) result = -1;
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    return result;
+}
+
+// Replays a whole file headless as fast as possible, then seeks to its last tick
+int benchReplay(const char *path) {
+    Game game;
+    ReplayReader reader;
+    const char *defaultPath = "/tmp/space_invaders_bench.rpl";
+
+    if (path == NULL) {
+        path = defaultPath;
+        if (recordScriptedReplay(path, 60 * 60 * 20) < 0) return -1;
+    }
+
+    if (openReplayReader(&reader, path) < 0) return -1;
+
+    GameConfig config = {
+        .hordeRows    = reader.header->hordeRows,
+        .hordeColumns = reader.header->hordeColumns,
+        .nBullets     = reader.header->nBullets,
+        .nPowerups    = reader.header->nPowerups,
+    };
+    if (checkGameConfig(&config) < 0) {
+        closeReplayReader(&reader);
+        return -1;
+    }
+    if (initGame(&game, true, config) < 0) {
+        closeReplayReader(&reader);
+        return -1;
+    }
+    CommandsBufPlayer2 *commands = initCommandsBuf(reader.header->commandsPerTick);
+    int result = replaySeek(&reader, &game, commands, 0);
+
+    // The state stepped to the last tick, the seek to it must give the same
+    uint32_t nTicks = reader.footer.nTicks;
+    size_t stateSize = gameStateSize(&game);
+    uint8_t *stepped = (uint8_t *)gameAlloc(ALLOC_BENCH, stateSize);
+    uint8_t *seeked = (uint8_t *)gameAlloc(ALLOC_BENCH, stateSize);
+
+    double start = getTimeSecs();
+    while (result == 0) {
+        if (reader.tick == nTicks - 1) saveGameState(&game, stepped);
+        result = replayStep(&reader, &game, commands);
+    }
+    double elapsed = getTimeSecs() - start;
+
+    printf(
+        "replay: %u ticks (%.1f min of play) in %.3f s, %.0f ticks/s\n",
+        nTicks, nTicks * reader.header->tickDuration / 60.0f, elapsed, nTicks / elapsed
+    );
+
+    start = getTimeSecs();
+    if (result >= 0) result = replaySeek(&reader, &game, commands, nTicks - 1);
+    double seekElapsed = getTimeSecs() - start;
+    saveGameState(&game, seeked);
+    bool same = memcmp(stepped, seeked, stateSize) == 0;
+    printf(
+        "seek to tick %u: %.3f ms (keyframe every %u ticks), state %s\n",
+        nTicks - 1, seekElapsed * 1e3, reader.header->keyframeInterval, same ? "identical" : "DIFFERS"
+    );
+
+    gameFree(stepped);
+    gameFree(seeked);
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    closeReplayReader(&reader);
+    if (result < 0) return result;
+    return same ? 0 : -2;
+}
+
+// Raw updateGame throughput on the scripted session, build with and without FIXED_POINT_SIM to compare
+int benchUpdate(uint32_t nTicks) {
+    Game game;
+    if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+
+    double elapsed = 0.0;
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        scriptedInput(tick, &game.hotData->input, commands);
+        double start = getTimeSecs();
+        updateGame(&game, commands, SC(BENCH_TICK_DURATION));
+        elapsed += getTimeSecs() - start;
+    }
+
+#ifdef FIXED_POINT_SIM
+    const char *mode = "fixed point";
+#else
+    const char *mode = "float";
+#endif
+    printf("update (%s): %u ticks in %.3f s, %.0f ticks/s\n", mode, nTicks, elapsed, nTicks / elapsed);
+    printf(
+        "final state: ship0 x %.3f, horde origin %.3f,%.3f, horde speed %.3f, enemies alive %u\n",
+        scToFloat(game.ships[0].bounds.x),
+        scToFloat(game.formation.x),
+        scToFloat(game.formation.y),
+        scToFloat(game.hotData->hordeSpeed),
+        game.enemiesAlive
+    );
+
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    return 0;
+}
+
+// The filtering iterator over array-of-structs entities that updateProjectiles and updateHorde used
+void legacyNext(Entity *entities, int n, int *i, bool bulletsUp, bool filterUp) {
+    for (++*i; *i < n; ++*i) {
+        if (entities[*i].state != ACTIVE) continue;
+        if (filterUp && entities[*i].up != bulletsUp) continue;
+        break;
+    }
+}
+
+void legacyTick(Entity *bullets, int nBullets, Entity *horde, int nHorde, Scalar step, Scalar bottom, Scalar *maxX) {
+    for (int i = -1; legacyNext(bullets, nBullets, &i, false, false), i < nBullets;) {
+        if (bullets[i].up) bullets[i].bounds.y -= step;
+        else bullets[i].bounds.y += step;
+
+        if (bullets[i].bounds.y >= bottom || bullets[i].bounds.y <= -bullets[i].bounds.height) {
+            bullets[i].state = INACTIVE;
+        }
+    }
+
+    for (int i = -1; legacyNext(horde, nHorde, &i, false, false), i < nHorde;) {
+        horde[i].bounds.x += step;
+    }
+
+    *maxX = scFromInt(-30000);
+    for (int i = -1; legacyNext(horde, nHorde, &i, false, false), i < nHorde;) {
+        if (horde[i].bounds.x > *maxX) *maxX = horde[i].bounds.x;
+    }
+}
+
+void denseTick(EntityPool *bulletsUp, EntityPool *bulletsDown, EntityPool *horde, Scalar step, Scalar bottom, Scalar *maxX) {
+    movePoolVertically(bulletsUp, -step, bottom);
+    movePoolVertically(bulletsDown, step, bottom);
+    translatePool(horde, step, 0);
+    *maxX = getPoolMaxX(horde);
+}
+
+// Array-of-structs plus filtering iterators against the dense pools, half of the entities alive
+int benchEntities(uint16_t nBullets, uint32_t iterations) {
+    const GameConfig config = DEFAULT_GAME_CONFIG;
+    const uint16_t nHorde = config.hordeRows * config.hordeColumns;
+    // Keeps everything on screen so the amount of work stays the same along the run
+    const Scalar bottom = scFromInt(30000);
+    const Scalar step = SC(0.001f);
+    Scalar legacyMax = 0, denseMax = 0;
+
+    Entity *legacyBullets = (Entity *)gameAlloc(ALLOC_BENCH, nBullets * sizeof(Entity));
+    Entity *legacyHorde = (Entity *)gameAlloc(ALLOC_BENCH, nHorde * sizeof(Entity));
+    Arena arena;
+    createArena(&arena, ALLOC_BENCH, 2 * entityPoolBytes(nBullets) + entityPoolBytes(nHorde));
+    EntityPool bulletsUp = createBulletsPool(&arena, nBullets);
+    EntityPool bulletsDown = createBulletsPool(&arena, nBullets);
+    EntityPool horde = createHorde(&arena, config.hordeRows, config.hordeColumns);
+
+    for (int i = 0; i < nBullets; ++i) {
+        bool alive = i % 2 == 0;
+        bool up = i % 3 == 0;
+        Scalar x = scFromInt(i % 1920);
+        Scalar y = scFromInt(500);
+        if (alive) spawnInPool(up ? &bulletsUp : &bulletsDown, x, y, BULLET);
+        legacyBullets[i] = (Entity) {
+            .bounds = {.x = x, .y = y, .width = bulletsUp.width, .height = bulletsUp.height},
+            .type   = BULLET,
+            .state  = alive ? ACTIVE : INACTIVE,
+            .up     = up,
+        };
+    }
+
+    for (int i = 0; i < nHorde; ++i) {
+        legacyHorde[i] = (Entity) {
+            .bounds = poolBounds(&horde, i),
+            .type   = (EntityType)horde.types[i],
+            .state  = i % 2 ? DEAD : ACTIVE,
+        };
+    }
+
+    for (int i = nHorde - 1; i >= 0; --i) {
+        if (handleSlot(horde.handles[i]) % 2) removeFromPool(&horde, i);
+    }
+
+    double start = getTimeSecs();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        legacyTick(legacyBullets, nBullets, legacyHorde, nHorde, step, bottom, &legacyMax);
+    }
+    double legacyElapsed = getTimeSecs() - start;
+
+    start = getTimeSecs();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        denseTick(&bulletsUp, &bulletsDown, &horde, step, bottom, &denseMax);
+    }
+    double denseElapsed = getTimeSecs() - start;
+
+    printf(
+        "entities (%u bullets, %u aliens, %u ticks): iterators %.1f ns/tick, dense pools %.1f ns/tick (%.2fx)\n",
+        nBullets, nHorde, iterations,
+        legacyElapsed * 1e9 / iterations, denseElapsed * 1e9 / iterations, legacyElapsed / denseElapsed
+    );
+    if (legacyMax != denseMax) printf("results differ: %f %f\n", scToFloat(legacyMax), scToFloat(denseMax));
+
+    gameFree(legacyBullets);
+    gameFree(legacyHorde);
+    destroyArena(&arena);
+    return legacyMax == denseMax ? 0 : -1;
+}
+
+// The scan that CollisionIterator did for every upward bullet: all the aliens in grid order, skipping dead ones
+int legacyAlienHit(Entity *horde, int nHorde, Bounds bullet) {
+    for (int i = -1; legacyNext(horde, nHorde, &i, false, false), i < nHorde;) {
+        if (checkCollisionBounds(horde[i].bounds, bullet)) return i;
+    }
+
+    return -1;
+}
+
+// Bullets scattered around the formation against a third of dead aliens, per bullet hit tests only
+int benchCollision(uint16_t nBullets, uint32_t iterations) {
+    const GameConfig config = DEFAULT_GAME_CONFIG;
+    const uint16_t nHorde = config.hordeRows * config.hordeColumns;
+    Rng rng;
+    seedRng(&rng, 2112, 0);
+
+    Arena arena;
+    createArena(&arena, ALLOC_BENCH, entityPoolBytes(nHorde) + formationBytes(config.hordeRows, config.hordeColumns));
+    EntityPool horde = createHorde(&arena, config.hordeRows, config.hordeColumns);
+    Formation formation = createFormation(&arena, &horde, config.hordeRows, config.hordeColumns);
+    Entity *legacyHorde = (Entity *)gameAlloc(ALLOC_BENCH, nHorde * sizeof(Entity));
+    Bounds *bullets = (Bounds *)gameAlloc(ALLOC_BENCH, nBullets * sizeof(Bounds));
+
+    for (int i = 0; i < nHorde; ++i) {
+        legacyHorde[i] = (Entity) {
+            .bounds = formationBounds(&formation, &horde, i),
+            .type   = (EntityType)horde.types[i],
+            .state  = ACTIVE,
+        };
+    }
+
+    for (int i = nHorde - 1; i >= 0; --i) {
+        if (rngBelow(&rng, 3) == 0) {
+            legacyHorde[i].state = DEAD;
+            killInFormation(&formation, i);
+            removeFromPool(&horde, horde.denseIdx[i]);
+        }
+    }
+
+    for (int i = 0; i < nBullets; ++i) {
+        bullets[i] = (Bounds) {
+            .x      = formation.x + scFromInt((int)rngBelow(&rng, 620) - 50),
+            .y      = formation.y + scFromInt((int)rngBelow(&rng, 340) - 50),
+            .width  = SC(4.0f),
+            .height = SC(32.0f),
+        };
+    }
+
+    int mismatches = 0, hits = 0;
+    for (int i = 0; i < nBullets; ++i) {
+        int legacy = legacyAlienHit(legacyHorde, nHorde, bullets[i]);
+        int lattice = findAlienHit(&horde, &formation, bullets[i], 0);
+        if (lattice >= 0) lattice = handleSlot(horde.handles[lattice]);
+        if (legacy != lattice) mismatches++;
+        if (legacy >= 0) hits++;
+    }
+
+    // The sums of the cells hit keep the compiler from dropping the loops
+    long legacySum = 0, latticeSum = 0;
+    double start = getTimeSecs();
+    for (uint32_t it = 0; it < iterations; ++it) {
+        for (int i = 0; i < nBullets; ++i) legacySum += legacyAlienHit(legacyHorde, nHorde, bullets[i]);
+    }
+    double legacyElapsed = getTimeSecs() - start;
+
+    start = getTimeSecs();
+    for (uint32_t it = 0; it < iterations; ++it) {
+        for (int i = 0; i < nBullets; ++i) {
+            int hit = findAlienHit(&horde, &formation, bullets[i], 0);
+            latticeSum += hit >= 0 ? handleSlot(horde.handles[hit]) : -1;
+        }
+    }
+    double latticeElapsed = getTimeSecs() - start;
+
+    uint32_t tests = nBullets * iterations;
+    printf(
+        "collision (%u bullets, %d hits, %u aliens alive): iterator %.1f ns/bullet, lattice %.1f ns/bullet (%.2fx)\n",
+        nBullets, hits, horde.count,
+        legacyElapsed * 1e9 / tests, latticeElapsed * 1e9 / tests, legacyElapsed / latticeElapsed
+    );
+    if (mismatches > 0 || legacySum != latticeSum) printf("%d bullets hit a different alien\n", mismatches);
+
+    gameFree(legacyHorde);
+    gameFree(bullets);
+    destroyArena(&arena);
+    return mismatches == 0 && legacySum == latticeSum ? 0 : -1;
+}
+
+// Collisions of a target against every entity of the pool, what the ship checks did before the broad phase
+int bruteForceHits(EntityPool *pool, Bounds target) {
+    int hits = 0;
+    for (int i = 0; i < pool->count; ++i) {
+        hits += checkCollisionBounds(poolBounds(pool, i), target);
+    }
+
+    return hits;
+}
+
+int broadPhaseHits(Game *game) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    int hits = 0;
+
+    for (uint32_t i = 0; i < broadPhase->nPairs; ++i) {
+        CandidatePair *pair = &broadPhase->pairs[i];
+        EntityPool *pool = proxyPool(game, pair->kind);
+        Bounds target = pair->target < 2 ? game->ships[pair->target].bounds : game->enemyShip.bounds;
+        hits += checkCollisionBounds(poolBounds(pool, lookupInPool(pool, pair->projectile)), target);
+    }
+
+    return hits;
+}
+
+// Thousands of projectiles around the ships, which sweep the screen so the order changes every tick
+int benchBroadPhase(uint16_t nProjectiles, uint32_t nTicks) {
+    Game game;
+    Rng rng;
+    GameConfig config = DEFAULT_GAME_CONFIG;
+    config.nBullets = nProjectiles / 2;
+    config.nPowerups = nProjectiles / 8;
+    if (checkGameConfig(&config) < 0 || initGame(&game, true, config) < 0) return -1;
+    seedRng(&rng, 2112, 0);
+
+    EntityPool *pools[N_PROXY_POOLS] = {&game.bulletsUp, &game.bulletsDown, &game.powerups};
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        while (pools[kind]->count < pools[kind]->capacity) {
+            Scalar x = scFromInt((int)rngBelow(&rng, 1920));
+            Scalar y = scFromInt(800 + (int)rngBelow(&rng, 200));
+            spawnInPool(pools[kind], x, y, kind == PROXY_POWERUP ? FAST_MOVE : BULLET);
+        }
+    }
+
+    game.enemyShip.state = ACTIVE;
+    game.enemyShip.bounds.y = game.ships[0].bounds.y;
+
+    int mismatches = 0;
+    long bruteHits = 0, broadHits = 0, nPairs = 0;
+    double bruteElapsed = 0.0, broadElapsed = 0.0;
+
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        game.ships[0].bounds.x = scFromInt((tick * 7) % 1824);
+        game.ships[1].bounds.x = scFromInt(1824 - (tick * 5) % 1824);
+        game.enemyShip.bounds.x = scFromInt((tick * 11) % 1856);
+
+        double start = getTimeSecs();
+        int brute = bruteForceHits(&game.bulletsUp, game.enemyShip.bounds);
+        for (int ship = 0; ship < 2; ++ship) {
+            brute += bruteForceHits(&game.bulletsDown, game.ships[ship].bounds);
+            brute += bruteForceHits(&game.powerups, game.ships[ship].bounds);
+        }
+        bruteElapsed += getTimeSecs() - start;
+
+        start = getTimeSecs();
+        updateBroadPhase(&game, 0);
+        int broad = broadPhaseHits(&game);
+        broadElapsed += getTimeSecs() - start;
+
+        if (brute != broad) mismatches++;
+        bruteHits += brute;
+        broadHits += broad;
+        nPairs += game.broadPhase.nPairs;
+    }
+
+    printf(
+        "broad phase (%u projectiles, %u ticks, %.1f pairs and %.1f hits per tick): "
+        "full scans %.1f us/tick, sweep and prune %.1f us/tick (%.2fx)\n",
+        game.bulletsUp.count + game.bulletsDown.count + game.powerups.count, nTicks, (double)nPairs / nTicks, (double)broadHits / nTicks,
+        bruteElapsed * 1e6 / nTicks, broadElapsed * 1e6 / nTicks, bruteElapsed / broadElapsed
+    );
+    if (mismatches > 0) printf("%d ticks with different hits (%ld against %ld)\n", mismatches, bruteHits, broadHits);
+
+    cleanupGame(&game);
+    return mismatches == 0 ? 0 : -1;
+}
+
+// Every path against CheckCollisionRecs, boxes on a quarter pixel lattice around the query so every edge touches
+int checkOverlapKernels(OverlapKernel *kernels, const char **names, int nKernels) {
+    const float sizes[][2] = {{4.0f, 32.0f}, {25.0f, 25.0f}, {48.0f, 48.0f}, {0.25f, 0.25f}};
+    const int nSizes = sizeof(sizes) / sizeof(sizes[0]);
+    const float step = 0.25f;
+    int mismatches = 0;
+    long tests = 0;
+
+    for (int q = 0; q < nSizes; ++q) {
+        for (int b = 0; b < nSizes; ++b) {
+            Bounds query = {SC(3.0f), SC(-2.0f), scFromFloat(sizes[q][0]), scFromFloat(sizes[q][1])};
+            Scalar width = scFromFloat(sizes[b][0]), height = scFromFloat(sizes[b][1]);
+            float minX = 3.0f - sizes[b][0] - 1.0f, maxX = 3.0f + sizes[q][0] + 1.0f;
+            float minY = -2.0f - sizes[b][1] - 1.0f, maxY = -2.0f + sizes[q][1] + 1.0f;
+            int nx = (int)((maxX - minX) / step) + 1, ny = (int)((maxY - minY) / step) + 1;
+            int n = nx * ny;
+
+            Scalar *x = (Scalar *)gameAlloc(ALLOC_BENCH, n * sizeof(Scalar));
+            Scalar *y = (Scalar *)gameAlloc(ALLOC_BENCH, n * sizeof(Scalar));
+            uint64_t *hits = (uint64_t *)gameAlloc(ALLOC_BENCH, hitWords(n) * sizeof(uint64_t));
+            for (int i = 0; i < n; ++i) {
+                x[i] = scFromFloat(minX + (i % nx) * step);
+                y[i] = scFromFloat(minY + (i / nx) * step);
+            }
+
+            for (int k = 0; k < nKernels; ++k) {
+                // The short batches go through the tails of the vector loops
+                for (int length = 0; length <= 20; ++length) {
+                    kernels[k](query, x, y, width, height, length, hits);
+                    for (int i = 0; i < length; ++i) {
+                        Bounds box = {x[i], y[i], width, height};
+                        bool expected = CheckCollisionRecs(boundsToRectangle(box), boundsToRectangle(query));
+                        if (expected != (bool)((hits[i / 64] >> (i % 64)) & 1)) mismatches++;
+                    }
+                    if (length > 0 && (hits[hitWords(length) - 1] >> 1 >> ((length - 1) % 64)) != 0) mismatches++;
+                }
+
+                kernels[k](query, x, y, width, height, n, hits);
+                for (int i = 0; i < n; ++i) {
+                    Bounds box = {x[i], y[i], width, height};
+                    bool expected = CheckCollisionRecs(boundsToRectangle(box), boundsToRectangle(query));
+                    if (expected != (bool)((hits[i / 64] >> (i % 64)) & 1)) {
+                        if (mismatches++ == 0) printf("%s differs on box %d of size %d against query %d\n", names[k], i, b, q);
+                    }
+                }
+                tests += n;
+            }
+
+            gameFree(x);
+            gameFree(y);
+            gameFree(hits);
+        }
+    }
+
+    printf("aabb equivalence: %ld boxes tested, %d mismatches\n", tests, mismatches);
+    return mismatches;
+}
+
+// Batch test of a ship against n projectiles spread over the screen
+int benchAabb(int n, uint32_t iterations) {
+    OverlapKernel kernels[3];
+    const char *names[3];
+    int nKernels = overlapKernels(kernels, names);
+    int mismatches = checkOverlapKernels(kernels, names, nKernels);
+
+    Rng rng;
+    seedRng(&rng, 2112, 0);
+    const Scalar width = SC(4.0f), height = SC(32.0f);
+    Scalar *x = (Scalar *)gameAlloc(ALLOC_BENCH, n * sizeof(Scalar));
+    Scalar *y = (Scalar *)gameAlloc(ALLOC_BENCH, n * sizeof(Scalar));
+    Rectangle *rectangles = (Rectangle *)gameAlloc(ALLOC_BENCH, n * sizeof(Rectangle));
+    uint64_t *hits = (uint64_t *)gameAlloc(ALLOC_BENCH, hitWords(n) * sizeof(uint64_t));
+
+    for (int i = 0; i < n; ++i) {
+        x[i] = scFromInt((int)rngBelow(&rng, 1920));
+        y[i] = scFromInt((int)rngBelow(&rng, 1080));
+        rectangles[i] = boundsToRectangle((Bounds) {x[i], y[i], width, height});
+    }
+
+    // The query moves so the loops can't be hoisted, the hit counts keep them from being dropped
+    long pairwiseHits = 0;
+    double start = getTimeSecs();
+    for (uint32_t it = 0; it < iterations; ++it) {
+        Rectangle query = {(float)(it % 1824), 900.0f, 96.0f, 96.0f};
+        for (int i = 0; i < n; ++i) pairwiseHits += CheckCollisionRecs(rectangles[i], query);
+    }
+    double pairwiseElapsed = getTimeSecs() - start;
+    printf("aabb (%d boxes): CheckCollisionRecs %.2f ns/box\n", n, pairwiseElapsed * 1e9 / ((double)n * iterations));
+
+    for (int k = 0; k < nKernels; ++k) {
+        long batchHits = 0;
+        start = getTimeSecs();
+        for (uint32_t it = 0; it < iterations; ++it) {
+            Bounds query = {scFromInt(it % 1824), SC(900.0f), SC(96.0f), SC(96.0f)};
+            kernels[k](query, x, y, width, height, n, hits);
+            for (int word = 0; word < hitWords(n); ++word) batchHits += __builtin_popcountll(hits[word]);
+        }
+        double elapsed = getTimeSecs() - start;
+
+        printf(
+            "aabb (%d boxes): %s%s %.2f ns/box (%.2fx)\n", n, names[k],
+            strcmp(names[k], overlapBatchPath()) == 0 ? " (selected)" : "",
+            elapsed * 1e9 / ((double)n * iterations), pairwiseElapsed / elapsed
+        );
+        if (batchHits != pairwiseHits) {
+            printf("%s found %ld hits against %ld\n", names[k], batchHits, pairwiseHits);
+            mismatches++;
+        }
+    }
+
+    gameFree(x);
+    gameFree(y);
+    gameFree(rectangles);
+    gameFree(hits);
+    return mismatches == 0 ? 0 : -1;
+}
+
+// Fires bullets up through a full horde, hits missed or landing past the bottom row of a column
+void sweepBullets(
+    EntityPool *horde, Formation *formation, Scalar step, bool swept, uint16_t nBullets, int *missed, int *late
+) {
+    Arena arena;
+    createArena(&arena, ALLOC_BENCH, entityPoolBytes(nBullets));
+    EntityPool bullets = createBulletsPool(&arena, nBullets);
+    bool *expected = (bool *)gameCalloc(ALLOC_BENCH, nBullets, sizeof(bool));
+    Rng rng;
+    seedRng(&rng, 2112, 0);
+    *missed = 0;
+    *late = 0;
+
+    Scalar spanX = formationMaxX(formation) + horde->width - formation->x;
+    Scalar bottom = formationMaxY(formation) + horde->height + SC(50.0f);
+    while (bullets.count < bullets.capacity) {
+        // On a quarter pixel lattice, with the phase of the steps drawn too
+        Scalar offset = scFromInt((int)rngBelow(&rng, 4 * scToInt(spanX + bullets.width))) / 4 - bullets.width;
+        Scalar y = bottom + scMul(step, scFromInt((int)rngBelow(&rng, 1024))) / 1024;
+        spawnInPool(&bullets, formation->x + offset, y, BULLET);
+
+        // Goes through a column when its x interval overlaps one
+        int col = scFloorDiv(offset + bullets.width, formation->pitchX);
+        expected[bullets.count - 1] = (
+            col >= 0 && col < formation->nColumns && offset + bullets.width > col * formation->pitchX
+            && offset < col * formation->pitchX + horde->width
+        );
+    }
+
+    while (bullets.count > 0) {
+        for (int i = bullets.count - 1; i >= 0; --i) {
+            Bounds start = swept ? poolSweepStart(&bullets, i) : poolBounds(&bullets, i);
+            int alien = findAlienHit(horde, formation, start, swept ? bullets.sweepY : 0);
+            if (alien < 0) continue;
+
+            uint16_t slot = handleSlot(bullets.handles[i]);
+            if (!expected[slot]) (*missed)--;
+            expected[slot] = false;
+            if (handleSlot(horde->handles[alien]) / formation->nColumns != formation->nRows - 1) (*late)++;
+            removeFromPool(&bullets, i);
+        }
+
+        movePoolVertically(&bullets, -step, scFromInt(1 << 14));
+    }
+
+    for (int i = 0; i < nBullets; ++i) *missed += expected[i];
+    gameFree(expected);
+    destroyArena(&arena);
+}
+
+int benchSweep(Scalar speed) {
+    const int rates[] = {240, 120, 60, 30, 20, 10};
+    const uint16_t nBullets = 4000;
+    const GameConfig config = DEFAULT_GAME_CONFIG;
+    Arena arena;
+    createArena(
+        &arena,
+        ALLOC_BENCH,
+        entityPoolBytes(config.hordeRows * config.hordeColumns) + formationBytes(config.hordeRows, config.hordeColumns)
+    );
+    EntityPool horde = createHorde(&arena, config.hordeRows, config.hordeColumns);
+    Formation formation = createFormation(&arena, &horde, config.hordeRows, config.hordeColumns);
+    int failures = 0;
+
+    for (int r = 0; r < (int)(sizeof(rates) / sizeof(rates[0])); ++r) {
+        Scalar step = scDiv(speed, scFromInt(rates[r]));
+        int discreteMissed, discreteLate, sweptMissed, sweptLate;
+        sweepBullets(&horde, &formation, step, false, nBullets, &discreteMissed, &discreteLate);
+        sweepBullets(&horde, &formation, step, true, nBullets, &sweptMissed, &sweptLate);
+
+        printf(
+            "sweep (%d bullets at %.0f px/s, %d Hz, %.1f px/tick): discrete %d missed %d late, swept %d missed %d late\n",
+            nBullets, scToFloat(speed), rates[r], scToFloat(step),
+            discreteMissed, discreteLate, sweptMissed, sweptLate
+        );
+        failures += sweptMissed + sweptLate;
+    }
+
+    destroyArena(&arena);
+    return failures == 0 ? 0 : -1;
+}
+
+/**
+ * The scripted session at several tick rates: its frames stay at 60 Hz and each runs the ticks
+ * of 1/60 s, pressed inputs on the first one only, as the host does.
+ * What the player sees should not depend on the rate, only the cost of a simulated second.
+ */
+int benchRates(uint32_t seconds) {
+    const int rates[] = {60, 120, 240};
+
+    for (int r = 0; r < (int)(sizeof(rates) / sizeof(rates[0])); ++r) {
+        Game game;
+        if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+        setTickDuration(&game, 1.0f / rates[r]);
+        const uint32_t subSteps = rates[r] / 60;
+        CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK * subSteps);
+        const Scalar deltaTime = scFromFloat(game.tickDuration);
+        const uint32_t nTicks = seconds * rates[r];
+
+        Input held = 0;
+        long bulletsInFlight = 0, enemyShipActive = 0;
+        double elapsed = 0.0;
+        for (uint32_t tick = 0; tick < nTicks; ++tick) {
+            if (tick % subSteps == 0) {
+                scriptedInput(tick / subSteps, &game.hotData->input, commands);
+                held = game.hotData->input & HELD_INPUTS;
+            } else {
+                game.hotData->input = held;
+            }
+
+            double start = getTimeSecs();
+            updateGame(&game, commands, deltaTime);
+            elapsed += getTimeSecs() - start;
+
+            bulletsInFlight += game.bulletsDown.count;
+            enemyShipActive += game.enemyShip.state == ACTIVE;
+        }
+
+        printf(
+            "rates (%u s simulated at %d Hz): %.3f ms per simulated second, %.0f ticks/s; "
+            "alien bullets in flight %.2f, enemy ship active %.1f%% of the time\n",
+            seconds, rates[r], elapsed * 1e3 / seconds, nTicks / elapsed,
+            (double)bulletsInFlight / nTicks, 100.0 * enemyShipActive / nTicks
+        );
+
+        cleanupCommandsBuf(&commands);
+        cleanupGame(&game);
+    }
+
+    return 0;
+}
+
+// Runs the scripted session, the last snapshot and keyframe are left in snap and keyframe
+void runStress(Game *game, uint32_t nTicks, SnapshotGameState *snap, uint8_t *keyframe) {
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    GameConfig config = game->config;
+
+    long entities = 0;
+    double updateElapsed = 0.0, snapshotElapsed = 0.0;
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        scriptedInput(tick, &game->hotData->input, commands);
+        double start = getTimeSecs();
+        updateGame(game, commands, SC(BENCH_TICK_DURATION));
+        double updated = getTimeSecs();
+        buildSnapshot(game, snap);
+        snapshotElapsed += getTimeSecs() - updated;
+        updateElapsed += updated - start;
+
+        entities += game->horde.count + game->bulletsUp.count + game->bulletsDown.count + game->powerups.count;
+    }
+    saveGameState(game, keyframe);
+
+    printf(
+        "stress (%ux%u aliens, %u bullets, %u powerups, %u ticks, %d threads): %.1f entities alive on average\n",
+        config.hordeRows, config.hordeColumns, config.nBullets, config.nPowerups, nTicks,
+        game->jobs != NULL ? game->jobs->nWorkers : 1, (double)entities / nTicks
+    );
+    printf(
+        "  update %.1f us/tick, snapshot %.1f us/tick (%zu bytes, %u slots), keyframe %zu bytes\n",
+        updateElapsed * 1e6 / nTicks, snapshotElapsed * 1e6 / nTicks,
+        snapshotSize(&game->snapshotLayout), game->snapshotLayout.nEntities, gameStateSize(game)
+    );
+
+    cleanupCommandsBuf(&commands);
+}
+
+/**
+ * The scripted session with a config thousands of entities large, headless: the cost per tick
+ * of the simulation and of the snapshot sent to the remote host, plus the sizes those scale to.
+ * With more than one thread it's run again with the jobs, which must end in the same state.
+ * The render path is profiled on a windowed host given the same sizes (--horde, --bullets, --powerups).
+ */
+int benchStress(GameConfig config, uint32_t nTicks, int nThreads) {
+    if (checkGameConfig(&config) < 0) return -1;
+
+    Game game;
+    if (initGame(&game, true, config) < 0) return -1;
+    SnapshotGameState *snap = createSnapshot(&game.snapshotLayout);
+    uint8_t *keyframe = (uint8_t *)gameAlloc(ALLOC_BENCH, gameStateSize(&game));
+    runStress(&game, nTicks, snap, keyframe);
+    cleanupGame(&game);
+
+    int result = 0;
+    JobSystem jobs;
+    if (nThreads > 1 && createJobSystem(&jobs, nThreads) == 0) {
+        if (initGame(&game, true, config) < 0) {
+            destroyJobSystem(&jobs);
+            gameFree(snap);
+            gameFree(keyframe);
+            return -1;
+        }
+        SnapshotGameState *jobsSnap = createSnapshot(&game.snapshotLayout);
+        uint8_t *jobsKeyframe = (uint8_t *)gameAlloc(ALLOC_BENCH, gameStateSize(&game));
+        runStress(&game, nTicks, jobsSnap, jobsKeyframe);
+
+        bool same =
+            memcmp(keyframe, jobsKeyframe, gameStateSize(&game)) == 0 &&
+            memcmp(snap, jobsSnap, snapshotSize(&game.snapshotLayout)) == 0;
+        printf("  %u jobs stolen, final state %s\n", atomic_load(&jobs.steals), same ? "identical" : "DIFFERS");
+        if (!same) result = -2;
+
+        gameFree(jobsSnap);
+        gameFree(jobsKeyframe);
+        cleanupGame(&game);
+        destroyJobSystem(&jobs);
+    }
+
+    gameFree(snap);
+    gameFree(keyframe);
+    return result;
+}
+
+// Each bucket must hold the quads of its texture and only those, in the order they were pushed
+bool spriteOrderHolds(const SpriteBatch *batch) {
+    uint32_t next[N_SPRITE_TEXTURES];
+    for (int t = 0; t < N_SPRITE_TEXTURES; ++t) next[t] = batch->bucketStart[t];
+
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        uint8_t t = batch->textures[i];
+        if (next[t] == batch->bucketStart[t + 1]) return false;
+        if (memcmp(&batch->sorted[next[t]++], &batch->quads[i], sizeof(SpriteQuad)) != 0) return false;
+    }
+
+    return batch->bucketStart[N_SPRITE_TEXTURES] == batch->count;
+}
+
+typedef struct SpriteFrames {
+    const char *name;
+    double      elapsed;
+    uint64_t    quads;
+    uint64_t    calls;
+    uint64_t    switches;
+    uint32_t    worstSwitches;
+    uint32_t    misordered;
+} SpriteFrames;
+
+void countSpriteFrame(SpriteFrames *frames, const SpriteBatch *batch, double elapsed) {
+    frames->elapsed += elapsed;
+    frames->quads += batch->count;
+    frames->calls += spriteDrawCalls(batch);
+    frames->switches += batch->switches;
+    if (batch->switches > frames->worstSwitches) frames->worstSwitches = batch->switches;
+    if (!spriteOrderHolds(batch) || batch->dropped > 0) frames->misordered++;
+}
+
+/**
+ * The sprites the host and the remote would draw each tick of the scripted session, headless:
+ * what batching them costs, and the draw calls they take bucketed by texture against those the
+ * texture switches of the entity order took before. Every bucket must keep the order of its quads.
+ * With a level, its formations mix the types of aliens across the cells.
+ */
+int benchSprites(GameConfig config, uint32_t nTicks, Level *level) {
+    if (checkGameConfig(&config) < 0) return -1;
+
+    Game game;
+    Arena arena;
+    SnapshotView view;
+    if (initGame(&game, true, config) < 0) return -1;
+    if (level != NULL) setLevel(&game, level);
+    initSnapshotView(&view, &game);
+    uint32_t capacity = gameSpriteCapacity(&config);
+    if (createArena(&arena, ALLOC_BENCH, spriteBatchBytes(capacity)) < 0) {
+        cleanupGame(&game);
+        return -1;
+    }
+    SpriteBatch *batch = createSpriteBatch(&arena, capacity);
+    SnapshotGameState *snap = createSnapshot(&game.snapshotLayout);
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    SpriteFrames frames[2] = {{.name = "game"}, {.name = "snapshot"}};
+
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        scriptedInput(tick, &game.hotData->input, commands);
+        updateGame(&game, commands, SC(BENCH_TICK_DURATION));
+        buildSnapshot(&game, snap);
+
+        double start = getTimeSecs();
+        batchGame(&game, batch);
+        countSpriteFrame(&frames[0], batch, getTimeSecs() - start);
+
+        start = getTimeSecs();
+        batchSnapshot(&view, snap, batch);
+        countSpriteFrame(&frames[1], batch, getTimeSecs() - start);
+    }
+
+    printf(
+        "sprites (%ux%u aliens%s, %u bullets, %u powerups, %u frames, room for %u quads):\n",
+        config.hordeRows, config.hordeColumns, level != NULL ? " in mixed formations" : "",
+        config.nBullets, config.nPowerups, nTicks, capacity
+    );
+    uint32_t misordered = 0;
+    for (int i = 0; i < 2; ++i) {
+        printf(
+            "  %-8s %7.1f quads, %.1f draw calls by texture against %.1f in entity order (%u at most), %.1f us/frame\n",
+            frames[i].name, (double)frames[i].quads / nTicks, (double)frames[i].calls / nTicks,
+            (double)frames[i].switches / nTicks, frames[i].worstSwitches, frames[i].elapsed * 1e6 / nTicks
+        );
+        misordered += frames[i].misordered;
+    }
+    printf("  %u frames with quads out of their bucket or dropped\n", misordered);
+
+    cleanupCommandsBuf(&commands);
+    gameFree(snap);
+    destroyArena(&arena);
+    cleanupGame(&game);
+    return misordered == 0 ? 0 : -2;
+}
+
+/**
+ * Latency of starting a new round in place, against tearing the game down and initializing it
+ * again as rebooting did. Headless, so neither side includes the assets the old path reloaded.
+ */
+int benchReboot(GameConfig config, int nReboots) {
+    if (checkGameConfig(&config) < 0) return -1;
+
+    Game game;
+    if (initGame(&game, true, config) < 0) return -1;
+    printf("reboot (%ux%u aliens, %u bullets, %u powerups, %d reboots):\n",
+        config.hordeRows, config.hordeColumns, config.nBullets, config.nPowerups, nReboots);
+
+    const char *names[] = {"in place", "cleanup and init"};
+    for (int inPlace = 1; inPlace >= 0; --inPlace) {
+        double total = 0.0, worst = 0.0;
+        for (int i = 0; i < nReboots; ++i) {
+            double start = getTimeSecs();
+            if (inPlace) {
+                rebootGame(&game);
+            } else {
+                cleanupGame(&game);
+                if (initGame(&game, true, config) < 0) return -1;
+            }
+            double elapsed = getTimeSecs() - start;
+            total += elapsed;
+            if (elapsed > worst) worst = elapsed;
+        }
+        printf("  %-16s %.1f us on average, %.1f us worst\n", names[1 - inPlace], total * 1e6 / nReboots, worst * 1e6);
+    }
+
+    cleanupGame(&game);
+    return 0;
+}
+
+/**
+ * The scripted session with its restarts and a snapshot per tick, on nThreads: what each subsystem
+ * allocated, none of it may come from inside updateGame or buildSnapshot.
+ * Built with -DALLOC_GUARD the first allocation there aborts and names the zone.
+ */
+int benchAllocs(uint32_t nTicks, int nThreads) {
+    Game game;
+    JobSystem jobs;
+    bool withJobs = nThreads > 1 && createJobSystem(&jobs, nThreads) == 0;
+    if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) {
+        if (withJobs) destroyJobSystem(&jobs);
+        return -1;
+    }
+    game.jobs = withJobs ? &jobs : NULL;
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    SnapshotGameState *snap = createSnapshot(&game.snapshotLayout);
+
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        scriptedInput(tick, &game.hotData->input, commands);
+        updateGame(&game, commands, SC(BENCH_TICK_DURATION));
+        buildSnapshot(&game, snap);
+    }
+
+    gameFree(snap);
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    if (withJobs) destroyJobSystem(&jobs);
+
+    printf("allocations (%u ticks, %d threads):\n", nTicks, withJobs ? nThreads : 1);
+    uint32_t zoneCalls = printAllocReport(stdout);
+    printf("%u allocations in the steady state\n", zoneCalls);
+    return zoneCalls == 0 ? 0 : -1;
+}
+
+typedef struct StalledConsumer {
+    struct timespec stall;
+    // Set once the session is over, what is left then is drained without stalling
+    atomic_bool     released;
+} StalledConsumer;
+
+// A consumer that hitches on every event, as a stuck audio device or socket would
+void stallOnEvent(void *data, const GameEvent *event) {
+    (void)event;
+    StalledConsumer *consumer = (StalledConsumer *)data;
+    if (!atomic_load(&consumer->released)) nanosleep(&consumer->stall, NULL);
+}
+
+// The scripted session, the time of the ticks goes to elapsed and worst, the final state to keyframe
+void runEventSession(Game *game, uint32_t nTicks, double *elapsed, double *worst, uint8_t *keyframe) {
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    *elapsed = *worst = 0.0;
+
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        scriptedInput(tick, &game->hotData->input, commands);
+        double start = getTimeSecs();
+        updateGame(game, commands, SC(BENCH_TICK_DURATION));
+        double tickElapsed = getTimeSecs() - start;
+        *elapsed += tickElapsed;
+        if (tickElapsed > *worst) *worst = tickElapsed;
+    }
+    saveGameState(game, keyframe);
+
+    cleanupCommandsBuf(&commands);
+}
+
+/**
+ * The scripted session publishing its events to a counting consumer and to one stalled for
+ * stallMs on each event, against the same session without a bus. The ticks must cost about
+ * the same and end in the same state, the stalled consumer only drops its own events.
+ */
+int benchEvents(uint32_t nTicks, int stallMs) {
+    EventBus bus;
+    EventConsumer counter, stalled;
+    EventStats stats = {0};
+    StalledConsumer stall = {.stall = {.tv_sec = stallMs / 1000, .tv_nsec = (stallMs % 1000) * 1000000L}};
+    atomic_init(&stall.released, false);
+
+    // Both sessions are created up front, the second one publishes to the bus
+    Game game, busGame;
+    if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+    if (initGame(&busGame, true, DEFAULT_GAME_CONFIG) < 0) {
+        cleanupGame(&game);
+        return -1;
+    }
+
+    initEventBus(&bus);
+    EventRing *countRing = subscribeEvents(&bus, EVENT_RING_CAPACITY);
+    EventRing *stallRing = subscribeEvents(&bus, EVENT_RING_CAPACITY);
+    if (countRing == NULL || stallRing == NULL || startEventConsumer(&counter, countRing, countEvent, &stats) < 0) {
+        destroyEventBus(&bus);
+        cleanupGame(&game);
+        cleanupGame(&busGame);
+        return -1;
+    }
+    if (startEventConsumer(&stalled, stallRing, stallOnEvent, &stall) < 0) {
+        stopEventConsumer(&counter);
+        destroyEventBus(&bus);
+        cleanupGame(&game);
+        cleanupGame(&busGame);
+        return -1;
+    }
+
+    size_t stateSize = gameStateSize(&game);
+    uint8_t *keyframe = (uint8_t *)gameAlloc(ALLOC_BENCH, stateSize);
+    uint8_t *busKeyframe = (uint8_t *)gameAlloc(ALLOC_BENCH, stateSize);
+    double elapsed, worst, busElapsed, busWorst;
+    runEventSession(&game, nTicks, &elapsed, &worst, keyframe);
+    cleanupGame(&game);
+
+    busGame.events = &bus;
+    // Publishes its sounds, with a bus they only go there and never reach the missing assets
+    busGame.muted = false;
+    runEventSession(&busGame, nTicks, &busElapsed, &busWorst, busKeyframe);
+    cleanupGame(&busGame);
+
+    uint32_t stalledDropped = atomic_load(&stallRing->dropped);
+    atomic_store(&stall.released, true);
+    stopEventConsumer(&counter);
+    stopEventConsumer(&stalled);
+
+    bool same = memcmp(keyframe, busKeyframe, stateSize) == 0;
+    printf("events (%u ticks, a consumer stalled %d ms per event):\n", nTicks, stallMs);
+    printf("  without a bus %.2f us/tick, %.1f us worst\n", elapsed * 1e6 / nTicks, worst * 1e6);
+    printf("  with the bus  %.2f us/tick, %.1f us worst\n", busElapsed * 1e6 / nTicks, busWorst * 1e6);
+    printf("  counted:");
+    for (int type = 0; type < N_GAME_EVENT_TYPES; ++type) {
+        printf(" %u %s", stats.counts[type], eventTypeName(type));
+    }
+    printf(", up to tick %u\n", stats.lastTick);
+    printf(
+        "  dropped: %u by the counter, %u by the stalled consumer, final state %s\n",
+        atomic_load(&countRing->dropped), stalledDropped, same ? "identical" : "DIFFERS"
+    );
+
+    destroyEventBus(&bus);
+    gameFree(keyframe);
+    gameFree(busKeyframe);
+    if (stats.counts[EVENT_SOUND] == 0) {
+        fprintf(stderr, "no sound was published.\n");
+        return -2;
+    }
+    return same ? 0 : -2;
+}
+
+#define CHANNEL_COMM_TICKS 3
+#define CHANNEL_MAX_LATENCY 6
+#define CHANNEL_IN_FLIGHT 16
+
+// A datagram on the simulated link, delivered on its tick
+typedef struct InFlight {
+    uint32_t    deliverAt;
+    bool        used;
+    EventPacket packet;
+    EventAck    ack;
+} InFlight;
+
+// Loses percent of the datagrams, delays the others by 1 to CHANNEL_MAX_LATENCY ticks and sends a few twice
+void sendOverLink(InFlight *link, Rng *rng, int lossPercent, uint32_t tick, const EventPacket *packet, const EventAck *ack) {
+    int copies = (int)rngBelow(rng, 100) < lossPercent ? 0 : 1 + ((int)rngBelow(rng, 100) < lossPercent);
+
+    for (int i = 0; i < CHANNEL_IN_FLIGHT && copies > 0; ++i) {
+        if (link[i].used) continue;
+
+        link[i].used = true;
+        link[i].deliverAt = tick + 1 + rngBelow(rng, CHANNEL_MAX_LATENCY);
+        if (packet != NULL) link[i].packet = *packet;
+        if (ack != NULL) link[i].ack = *ack;
+        copies--;
+    }
+}
+
+/**
+ * Every event of the scripted session through the reliable channel, over a link losing, delaying,
+ * reordering and duplicating datagrams, with a comm tick every CHANNEL_COMM_TICKS ticks.
+ * Each event must be played once, in the order it was queued.
+ */
+int benchChannel(uint32_t nTicks, int lossPercent) {
+    Game game;
+    EventBus bus;
+    initEventBus(&bus);
+    EventRing *replication = subscribeEvents(&bus, EVENT_RING_CAPACITY);
+    if (replication == NULL || initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) {
+        destroyEventBus(&bus);
+        return -1;
+    }
+    game.events = &bus;
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+
+    EventSender sender;
+    EventReceiver receiver;
+    initEventSender(&sender, 2 * CHANNEL_COMM_TICKS);
+    initEventReceiver(&receiver, CHANNEL_COMM_TICKS + 1);
+    InFlight *toRemote = (InFlight *)gameCalloc(ALLOC_BENCH, CHANNEL_IN_FLIGHT, sizeof(InFlight));
+    InFlight *toHost = (InFlight *)gameCalloc(ALLOC_BENCH, CHANNEL_IN_FLIGHT, sizeof(InFlight));
+    Rng rng;
+    seedRng(&rng, 7, 1);
+
+    // What was queued by seq, to check what is played against
+    uint32_t logCapacity = 1024;
+    GameEvent *log = (GameEvent *)gameAlloc(ALLOC_BENCH, logCapacity * sizeof(GameEvent));
+    uint32_t played = 0, wrong = 0, worstLatency = 0;
+    uint64_t latency = 0;
+    EventPacket packet;
+    EventAck ack;
+
+    // Past nTicks the session stops and the link runs until everything queued was played
+    uint32_t tick = 0;
+    for (; tick < nTicks || (played < sender.next && tick < nTicks + 600); ++tick) {
+        if (tick < nTicks) {
+            scriptedInput(tick, &game.hotData->input, commands);
+            updateGame(&game, commands, SC(BENCH_TICK_DURATION));
+        }
+
+        for (int i = 0; i < CHANNEL_IN_FLIGHT; ++i) {
+            if (toRemote[i].used && toRemote[i].deliverAt == tick) {
+                readEventPacket(&receiver, &toRemote[i].packet, tick);
+                toRemote[i].used = false;
+            }
+            if (toHost[i].used && toHost[i].deliverAt == tick) {
+                readEventAck(&sender, &toHost[i].ack);
+                toHost[i].used = false;
+            }
+        }
+
+        GameEvent event;
+        while (takeDueEvent(&receiver, tick, &event)) {
+            const GameEvent *queued = &log[played++];
+            if (queued->tick != event.tick || queued->type != event.type || queued->value != event.value) wrong++;
+            uint32_t late = tick - event.tick;
+            latency += late;
+            if (late > worstLatency) worstLatency = late;
+        }
+
+        if (tick % CHANNEL_COMM_TICKS == 0) {
+            while (popEvent(replication, &event)) {
+                uint32_t seq = sender.next;
+                if (!queueEvent(&sender, &event) || sender.next == seq) continue;
+
+                if (seq == logCapacity) {
+                    logCapacity *= 2;
+                    log = (GameEvent *)gameRealloc(ALLOC_BENCH, log, logCapacity * sizeof(GameEvent));
+                }
+                log[seq] = event;
+            }
+            writeEventPacket(&sender, &packet, tick < nTicks ? game.tick : tick);
+            sendOverLink(toRemote, &rng, lossPercent, tick, &packet, NULL);
+            writeEventAck(&receiver, &ack);
+            sendOverLink(toHost, &rng, lossPercent, tick, NULL, &ack);
+        }
+    }
+
+    printf("channel (%u ticks, %d%% of the datagrams lost, a comm tick every %d ticks):\n", nTicks, lossPercent, CHANNEL_COMM_TICKS);
+    printf(
+        "  %u events queued, %u merged, %u dropped on a full window, %u played, %u out of order\n",
+        sender.next, sender.merged, sender.dropped, played, wrong
+    );
+    printf(
+        "  %u sent, %u resent, %u duplicates discarded, played %.1f ticks after they happened on average, %u at most\n",
+        sender.sent, sender.resent, receiver.duplicates, played ? (double)latency / played : 0.0, worstLatency
+    );
+
+    gameFree(log);
+    gameFree(toRemote);
+    gameFree(toHost);
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    destroyEventBus(&bus);
+    return played == sender.next && wrong == 0 ? 0 : -2;
+}
+
+#define PIPELINE_FRAME_DURATION 0.016
+#define PIPELINE_STALL_EVERY 10
+
+// The render stage without a window: an input and the latest snapshot each frame, stalled every few frames
+void runRenderStage(HostPipeline *pipeline, uint32_t nFrames, int stallMs, StageTiming *frames) {
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    uint32_t fresh = 0;
+
+    for (uint32_t frame = 0; frame < nFrames; ++frame) {
+        double start = monotonicSecs();
+        Input input;
+        scriptedInput(frame, &input, commands);
+        pushPlayerInput(pipeline, input);
+
+        bool isFresh;
+        if (latestSnapshot(pipeline, &isFresh) != NULL && isFresh) fresh++;
+        if (frame % PIPELINE_STALL_EVERY == PIPELINE_STALL_EVERY - 1) sleepSecs(stallMs / 1000.0);
+        addStageTime(frames, monotonicSecs() - start);
+
+        double left = PIPELINE_FRAME_DURATION - (monotonicSecs() - start);
+        if (left > 0.0) sleepSecs(left);
+    }
+
+    printf("    %u of %u frames had a new tick\n", fresh, nFrames);
+    cleanupCommandsBuf(&commands);
+}
+
+// The same frames with the ticks run between them on the one thread, as the host did before the pipeline
+void runSingleThread(Game *game, uint32_t nFrames, int stallMs, StageTiming *jitter, StageTiming *ticks) {
+    CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+    double next = monotonicSecs();
+
+    for (uint32_t frame = 0; frame < nFrames; ++frame) {
+        double start = monotonicSecs();
+        for (; monotonicSecs() >= next; next += game->tickDuration) {
+            double tickStart = monotonicSecs();
+            addStageTime(jitter, tickStart - next);
+            scriptedInput(frame, &game->hotData->input, commands);
+            updateGame(game, commands, scFromFloat(game->tickDuration));
+            addStageTime(ticks, monotonicSecs() - tickStart);
+        }
+        if (frame % PIPELINE_STALL_EVERY == PIPELINE_STALL_EVERY - 1) sleepSecs(stallMs / 1000.0);
+
+        double left = PIPELINE_FRAME_DURATION - (monotonicSecs() - start);
+        if (left > 0.0) sleepSecs(left);
+    }
+
+    cleanupCommandsBuf(&commands);
+}
+
+/**
+ * The host pipeline without its network stage, with a render stage stalled stallMs every
+ * PIPELINE_STALL_EVERY frames, against a render stage that never stalls and against the ticks
+ * run on the render thread. How late the ticks start must stay flat on the pipeline.
+ */
+int benchPipeline(uint32_t nFrames, int stallMs) {
+    int stalls[2] = {0, stallMs};
+
+    printf("pipeline (%u frames, the render stage stalled %d ms every %d frames):\n", nFrames, stallMs, PIPELINE_STALL_EVERY);
+    for (int i = 0; i < 2; ++i) {
+        Game game;
+        HostPipeline pipeline;
+        StageTiming frames = {0};
+        if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+        CommandsBufPlayer2 *commands = initCommandsBuf(BENCH_COMMANDS_PER_TICK);
+        if (startHostPipeline(&pipeline, &game, NULL, commands, NULL, NULL, NULL, 0.0f, 0.0f) < 0) {
+            cleanupCommandsBuf(&commands);
+            cleanupGame(&game);
+            return -1;
+        }
+
+        printf("  three threads, stalled %d ms:\n", stalls[i]);
+        runRenderStage(&pipeline, nFrames, stalls[i], &frames);
+        stopHostPipeline(&pipeline);
+        printStageTiming(stdout, "tick late", &pipeline.jitter);
+        printStageTiming(stdout, "tick", &pipeline.tick);
+        printStageTiming(stdout, "frame", &frames);
+
+        cleanupCommandsBuf(&commands);
+        cleanupGame(&game);
+    }
+
+    Game game;
+    StageTiming jitter = {0}, ticks = {0};
+    if (initGame(&game, true, DEFAULT_GAME_CONFIG) < 0) return -1;
+    runSingleThread(&game, nFrames, stallMs, &jitter, &ticks);
+    printf("  one thread, stalled %d ms:\n", stallMs);
+    printStageTiming(stdout, "tick late", &jitter);
+    printStageTiming(stdout, "tick", &ticks);
+    cleanupGame(&game);
+
+    return 0;
+}
+
+// A level of nWaves random formations on a rows by columns grid, with tunings growing along it
+int writeLevelSource(const char *path, int nWaves, int rows, int columns) {
+    FILE *src = fopen(path, "w");
+    if (src == NULL) {
+        perror("failed to create the level source.\n");
+        return -1;
+    }
+
+    Rng rng;
+    seedRng(&rng, 2112, 0);
+    fprintf(src, "grid %d %d\nfire_chance 0.0001\n", rows, columns);
+    for (int wave = 0; wave < nWaves; ++wave) {
+        fprintf(src, "wave\nhorde_speed %d\nenemy_sleep %.2f\nformation\n", 100 + wave % 100, 4.0f - (wave % 30) * 0.1f);
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < columns; ++col) {
+                // The first cell is never empty so no wave is
+                fputc(row + col == 0 || rngBelow(&rng, 4) != 0 ? '1' + (int)rngBelow(&rng, 3) : '.', src);
+            }
+            fputc('\n', src);
+        }
+    }
+
+    return fclose(src) == 0 ? 0 : -1;
+}
+
+/**
+ * Converts a text level (a generated one when no source is given), then starts every wave
+ * of the mapped file in turn as a session reaching them would: the slowest start is the hitch.
+ */
+int benchWaves(const char *srcPath) {
+    const char *defaultSrc = "/tmp/space_invaders_bench_level.txt";
+    const char *binPath = "/tmp/space_invaders_bench.siwv";
+    Level level;
+    Game game;
+
+    if (srcPath == NULL) {
+        srcPath = defaultSrc;
+        if (writeLevelSource(srcPath, 500, 20, 40) < 0) return -1;
+    }
+
+    double start = getTimeSecs();
+    if (convertLevel(srcPath, binPath) < 0) return -1;
+    double convertElapsed = getTimeSecs() - start;
+
+    start = getTimeSecs();
+    if (openLevel(&level, binPath) < 0) return -1;
+    double openElapsed = getTimeSecs() - start;
+
+    GameConfig config = DEFAULT_GAME_CONFIG;
+    config.hordeRows = level.header->hordeRows;
+    config.hordeColumns = level.header->hordeColumns;
+    if (initGame(&game, true, config) < 0) {
+        closeLevel(&level);
+        return -1;
+    }
+    setLevel(&game, &level);
+
+    const uint16_t nWaves = level.header->nWaves;
+    double total = 0.0, slowest = 0.0;
+    long aliens = 0;
+    for (uint16_t wave = 0; wave < nWaves; ++wave) {
+        start = getTimeSecs();
+        startWave(&game, wave);
+        double elapsed = getTimeSecs() - start;
+        total += elapsed;
+        slowest = elapsed > slowest ? elapsed : slowest;
+        aliens += game.horde.count;
+    }
+
+    printf(
+        "waves (%u waves of %ux%u, %.1f aliens on average, %zu bytes): convert %.3f ms, open %.3f ms\n",
+        nWaves, level.header->hordeRows, level.header->hordeColumns, (double)aliens / nWaves, level.size,
+        convertElapsed * 1e3, openElapsed * 1e3
+    );
+    printf("  start of a wave %.1f us on average, %.1f us at most\n", total * 1e6 / nWaves, slowest * 1e6);
+
+    cleanupGame(&game);
+    closeLevel(&level);
+    return 0;
+}
+
+// Steps the scripted sessions nTicks times with observations on, returns the ticks per second or a negative value
+double runBatch(int nEnvs, int nThreads, uint32_t nTicks, float *positions, uint8_t *alive, uint8_t *states) {
+    BatchEnv envs;
+    if (createBatchEnv(&envs, nEnvs, DEFAULT_GAME_CONFIG, nThreads, 1) < 0) return -1.0;
+    setBatchObservation(&envs, positions, alive, states);
+
+    Input *inputs = (Input *)gameAlloc(ALLOC_BENCH, BATCH_INPUTS_PER_ENV * nEnvs * sizeof(Input));
+    double elapsed = 0.0;
+    for (uint32_t tick = 0; tick < nTicks; ++tick) {
+        // Offset so the sessions don't all play the same match
+        for (int i = 0; i < nEnvs; ++i) {
+            CommandsBufPlayer2 commands = {.input = &inputs[BATCH_INPUTS_PER_ENV * i + 1], .capacity = 1};
+            scriptedInput(tick + 37 * i, &inputs[BATCH_INPUTS_PER_ENV * i], &commands);
+        }
+
+        double start = getTimeSecs();
+        stepBatch(&envs, inputs, nEnvs);
+        elapsed += getTimeSecs() - start;
+    }
+
+    printf("  %d threads: %.0f ticks/s (%.2f us per session tick)\n",
+        envs.nThreads, nEnvs * (double)nTicks / elapsed, elapsed * 1e6 / ((double)nEnvs * nTicks));
+
+    gameFree(inputs);
+    destroyBatchEnv(&envs);
+    return nEnvs * (double)nTicks / elapsed;
+}
+
+/**
+ * Throughput of the batch sessions, one thread against nThreads, each run with the observations
+ * written out like a training loop would. The final observations must match between the runs.
+ */
+int benchBatch(int nEnvs, int nThreads, uint32_t nTicks) {
+    if (nEnvs <= 0) return -1;
+
+    // Any session gives the layout, the config is the same
+    BatchEnv probe;
+    if (createBatchEnv(&probe, 1, DEFAULT_GAME_CONFIG, 1, 1) < 0) return -1;
+    size_t nSlots = batchObservationSize(&probe);
+    destroyBatchEnv(&probe);
+
+    float *positions[2];
+    uint8_t *alive[2], *states[2];
+    for (int k = 0; k < 2; ++k) {
+        positions[k] = (float *)gameCalloc(ALLOC_BENCH, 2 * nSlots * nEnvs, sizeof(float));
+        alive[k] = (uint8_t *)gameCalloc(ALLOC_BENCH, nSlots * nEnvs, 1);
+        states[k] = (uint8_t *)gameCalloc(ALLOC_BENCH, nEnvs, 1);
+    }
+
+    printf("batch (%d sessions, %u ticks, %zu observed slots each):\n", nEnvs, nTicks, nSlots);
+    double single = runBatch(nEnvs, 1, nTicks, positions[0], alive[0], states[0]);
+    double parallel = runBatch(nEnvs, nThreads, nTicks, positions[1], alive[1], states[1]);
+
+    int result = 0;
+    if (single < 0.0 || parallel < 0.0) {
+        result = -1;
+    } else {
+        bool same =
+            memcmp(alive[0], alive[1], nSlots * nEnvs) == 0 &&
+            memcmp(states[0], states[1], nEnvs) == 0 &&
+            memcmp(positions[0], positions[1], 2 * nSlots * nEnvs * sizeof(float)) == 0;
+        int playing = 0;
+        for (int i = 0; i < nEnvs; ++i) playing += states[1][i] == PLAYING;
+
+        printf("  speedup %.2fx, %d sessions playing at the end, observations %s\n",
+            parallel / single, playing, same ? "identical" : "DIFFER");
+        if (!same) result = -2;
+    }
+
+    for (int k = 0; k < 2; ++k) {
+        gameFree(positions[k]);
+        gameFree(alive[k]);
+        gameFree(states[k]);
+    }
+    return result;
+}
+
+// Rows, columns, bullets and powerups from argv[1] on, those left out keep the value of config
+static int parseConfigArgs(int argc, char *argv[], GameConfig *config) {
+    uint16_t *sizes[] = {&config->hordeRows, &config->hordeColumns, &config->nBullets, &config->nPowerups};
+    for (int i = 0; i < 4 && i + 1 < argc; ++i) {
+        long count;
+        if (parseCount(argv[i + 1], 0xffff, &count) < 0) return -1;
+        *sizes[i] = (uint16_t)count;
+    }
+
+    return 0;
+}
+
+int benchMain(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: bench replay [file] | update [ticks] | entities [bullets] | collision [bullets] | broadphase [projectiles] | aabb [boxes] | sweep [speed] | rates [seconds] | stress [rows columns bullets powerups threads] | reboot [rows columns bullets powerups] | sprites [rows columns bullets powerups | level] | allocs [threads] | events [stall ms] | channel [loss percent] | pipeline [stall ms] | waves [source] | batch [sessions threads]\n");
+        return -1;
+    }
+
+    if (strcmp(argv[0], "replay") == 0) {
+        return benchReplay(argc > 1 ? argv[1] : NULL);
+    }
+
+    if (strcmp(argv[0], "entities") == 0) {
+        long nBullets = 40;
+        if (argc > 1 && parseCount(argv[1], 0xffff, &nBullets) < 0) return -1;
+        return benchEntities((uint16_t)nBullets, 20000000 / (nBullets + 55));
+    }
+
+    if (strcmp(argv[0], "collision") == 0) {
+        long nBullets = 1000;
+        if (argc > 1 && parseCount(argv[1], 0xffff, &nBullets) < 0) return -1;
+        return benchCollision((uint16_t)nBullets, 10000000 / nBullets);
+    }
+
+    if (strcmp(argv[0], "broadphase") == 0) {
+        long nProjectiles = 4000;
+        if (argc > 1 && parseCount(argv[1], 0xffff, &nProjectiles) < 0) return -1;
+        return benchBroadPhase((uint16_t)nProjectiles, 2000);
+    }
+
+    if (strcmp(argv[0], "aabb") == 0) {
+        long n = 4096;
+        if (argc > 1 && parseCount(argv[1], 1 << 24, &n) < 0) return -1;
+        return benchAabb((int)n, 200000000 / n);
+    }
+
+    if (strcmp(argv[0], "sweep") == 0) {
+        return benchSweep(scFromInt(argc > 1 ? atoi(argv[1]) : 600));
+    }
+
+    if (strcmp(argv[0], "rates") == 0) {
+        return benchRates(argc > 1 ? (uint32_t)atoi(argv[1]) : 20 * 60);
+    }
+
+    if (strcmp(argv[0], "stress") == 0) {
+        GameConfig config = {
+            .hordeRows    = 40,
+            .hordeColumns = 100,
+            .nBullets     = 4000,
+            .nPowerups    = 1000,
+        };
+        if (parseConfigArgs(argc, argv, &config) < 0) return -1;
+        return benchStress(config, 60 * 60 * 2, argc > 5 ? atoi(argv[5]) : 4);
+    }
+
+    if (strcmp(argv[0], "reboot") == 0) {
+        GameConfig config = DEFAULT_GAME_CONFIG;
+        if (parseConfigArgs(argc, argv, &config) < 0) return -1;
+        return benchReboot(config, 1000);
+    }
+
+    if (strcmp(argv[0], "sprites") == 0 && argc > 1 && strcmp(argv[1], "level") == 0) {
+        const char *srcPath = "/tmp/space_invaders_bench_sprites.txt";
+        const char *binPath = "/tmp/space_invaders_bench_sprites.siwv";
+        Level level;
+        if (writeLevelSource(srcPath, 20, 20, 40) < 0 || convertLevel(srcPath, binPath) < 0) return -1;
+        if (openLevel(&level, binPath) < 0) return -1;
+
+        GameConfig config = DEFAULT_GAME_CONFIG;
+        config.hordeRows = level.header->hordeRows;
+        config.hordeColumns = level.header->hordeColumns;
+        int result = benchSprites(config, 60 * 60 * 2, &level);
+        closeLevel(&level);
+        return result;
+    }
+
+    if (strcmp(argv[0], "sprites") == 0) {
+        GameConfig config = DEFAULT_GAME_CONFIG;
+        if (parseConfigArgs(argc, argv, &config) < 0) return -1;
+        return benchSprites(config, 60 * 60 * 2, NULL);
+    }
+
+    if (strcmp(argv[0], "allocs") == 0) {
+        return benchAllocs(60 * 60 * 20, argc > 1 ? atoi(argv[1]) : 1);
+    }
+
+    if (strcmp(argv[0], "events") == 0) {
+        return benchEvents(60 * 60 * 5, argc > 1 ? atoi(argv[1]) : 50);
+    }
+
+    if (strcmp(argv[0], "channel") == 0) {
+        return benchChannel(60 * 60 * 5, argc > 1 ? atoi(argv[1]) : 20);
+    }
+
+    if (strcmp(argv[0], "pipeline") == 0) {
+        return benchPipeline(60 * 5, argc > 1 ? atoi(argv[1]) : 50);
+    }
+
+    if (strcmp(argv[0], "waves") == 0) {
+        return benchWaves(argc > 1 ? argv[1] : NULL);
+    }
+
+    if (strcmp(argv[0], "batch") == 0) {
+        int nEnvs = argc > 1 ? atoi(argv[1]) : 4096;
+        return benchBatch(nEnvs, argc > 2 ? atoi(argv[2]) : 0, 600);
+    }
+
+    if (strcmp(argv[0], "update") == 0) {
+        return benchUpdate(argc > 1 ? (uint32_t)atoi(argv[1]) : 60 * 60 * 20);
+    }
+
+    fprintf(stderr, "unknown benchmark %s.\n", argv[0]);
+    return -1;
+}
@@ -0,0 +1,8 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+
+// Headless benchmarks, run as: ./game bench <name> [args]
+int benchMain(int argc, char *argv[]);
+
+#endif
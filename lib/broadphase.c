@@ -0,0 +1,261 @@
+#include "broadphase.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aabb.h"
+#include "arena.h"
+#include "entity.h"
+#include "gameData.h"
+
+
+EntityPool *proxyPool(Game *game, ProxyKind kind) {
+    switch (kind) {
+        case PROXY_BULLET_UP: return &game->bulletsUp;
+        case PROXY_BULLET_DOWN: return &game->bulletsDown;
+        case PROXY_POWERUP: return &game->powerups;
+        default: return NULL;
+    }
+}
+
+uint32_t nProjectiles(Game *game) {
+    uint32_t n = 0;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        n += proxyPool(game, kind)->capacity;
+    }
+
+    return n;
+}
+
+size_t broadPhaseBytes(const uint16_t capacities[N_PROXY_POOLS]) {
+    uint32_t n = 0;
+    size_t bytes = 0;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        n += capacities[kind];
+        bytes += arenaBytes(capacities[kind] * sizeof(EntityHandle));
+    }
+
+    return bytes
+        + arenaBytes(2 * n * sizeof(Proxy))
+        + arenaBytes(2 * n * sizeof(CandidatePair))
+        + 2 * arenaBytes(n * sizeof(Scalar))
+        + arenaBytes(n * sizeof(EntityHandle))
+        + arenaBytes(hitWords(n) * sizeof(uint64_t));
+}
+
+void initBroadPhase(Game *game, Arena *arena) {
+    uint32_t n = nProjectiles(game);
+    // Stale proxies are kept up to the count of the live ones after an insertion, a projectile pairs with two ships at most
+    game->broadPhase = (BroadPhase) {
+        .proxies       = (Proxy *)arenaAlloc(arena, 2 * n * sizeof(Proxy)),
+        .pairs         = (CandidatePair *)arenaAlloc(arena, 2 * n * sizeof(CandidatePair)),
+        .narrowX       = (Scalar *)arenaAlloc(arena, n * sizeof(Scalar)),
+        .narrowY       = (Scalar *)arenaAlloc(arena, n * sizeof(Scalar)),
+        .narrowHandles = (EntityHandle *)arenaAlloc(arena, n * sizeof(EntityHandle)),
+        .hits          = (uint64_t *)arenaAlloc(arena, hitWords(n) * sizeof(uint64_t)),
+    };
+
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        game->broadPhase.tracked[kind] = (EntityHandle *)arenaAlloc(arena, proxyPool(game, kind)->capacity * sizeof(EntityHandle));
+    }
+
+    resetBroadPhase(game);
+}
+
+void resetBroadPhase(Game *game) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        memset(broadPhase->tracked[kind], 0, proxyPool(game, kind)->capacity * sizeof(EntityHandle));
+    }
+
+    broadPhase->nProxies = 0;
+    broadPhase->nPairs = 0;
+}
+
+bool proxyLess(const Proxy *a, const Proxy *b) {
+    if (a->minX != b->minX) return a->minX < b->minX;
+    if (a->kind != b->kind) return a->kind < b->kind;
+    return a->handle < b->handle;
+}
+
+// A freed entity bumps the generation of its slot
+bool proxyAlive(Game *game, const Proxy *proxy) {
+    return proxyPool(game, proxy->kind)->generations[handleSlot(proxy->handle)] == handleGeneration(proxy->handle);
+}
+
+// Entities spawned since the last tick, not proxied yet
+uint32_t countNewProxies(Game *game) {
+    uint32_t n = 0;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        EntityPool *pool = proxyPool(game, kind);
+        EntityHandle *tracked = game->broadPhase.tracked[kind];
+        for (int i = 0; i < pool->count; ++i) {
+            if (tracked[handleSlot(pool->handles[i])] != pool->handles[i]) n++;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Dropping the proxies of removed entities is only worth it once they would be half of the
+ * array after the insertion, which then never holds more than twice the live entities.
+ */
+void compactProxies(Game *game) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    uint32_t alive = 0;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        alive += proxyPool(game, kind)->count;
+    }
+
+    if (broadPhase->nProxies + countNewProxies(game) <= 2 * alive) return;
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < broadPhase->nProxies; ++i) {
+        if (proxyAlive(game, &broadPhase->proxies[i])) broadPhase->proxies[n++] = broadPhase->proxies[i];
+    }
+    broadPhase->nProxies = n;
+}
+
+// Appends the proxies of the entities spawned since the last tick and sorts them in
+void insertNewProxies(Game *game) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    Proxy *proxies = broadPhase->proxies;
+    uint32_t sorted = broadPhase->nProxies;
+
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        EntityPool *pool = proxyPool(game, kind);
+        EntityHandle *tracked = broadPhase->tracked[kind];
+
+        for (int i = 0; i < pool->count; ++i) {
+            EntityHandle handle = pool->handles[i];
+            if (tracked[handleSlot(handle)] == handle) continue;
+
+            tracked[handleSlot(handle)] = handle;
+            proxies[broadPhase->nProxies++] = (Proxy) {
+                .minX   = pool->x[i],
+                .maxX   = pool->x[i] + pool->width,
+                .handle = handle,
+                .kind   = kind,
+            };
+        }
+    }
+
+    for (uint32_t i = sorted; i < broadPhase->nProxies; ++i) {
+        Proxy proxy = proxies[i];
+        uint32_t j = i;
+        for (; j > 0 && proxyLess(&proxy, &proxies[j - 1]); --j) {
+            proxies[j] = proxies[j - 1];
+        }
+        proxies[j] = proxy;
+    }
+}
+
+// First proxy whose interval can reach x, the intervals are at most maxWidth wide
+uint32_t firstProxyReaching(BroadPhase *broadPhase, Scalar x, Scalar maxWidth) {
+    uint32_t low = 0, high = broadPhase->nProxies;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (broadPhase->proxies[mid].minX <= x - maxWidth) low = mid + 1;
+        else high = mid;
+    }
+
+    return low;
+}
+
+void queryTarget(Game *game, Bounds target, uint8_t targetNumber, Scalar maxWidth) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    Scalar minX = target.x;
+    Scalar maxX = target.x + target.width;
+
+    for (
+        uint32_t i = firstProxyReaching(broadPhase, minX, maxWidth);
+        i < broadPhase->nProxies && broadPhase->proxies[i].minX < maxX;
+        ++i
+    ) {
+        const Proxy *proxy = &broadPhase->proxies[i];
+        if (proxy->maxX <= minX || !proxyAlive(game, proxy)) continue;
+
+        bool pairs;
+        if (targetNumber == 2) pairs = proxy->kind == PROXY_BULLET_UP;
+        else pairs = proxy->kind != PROXY_BULLET_UP;
+        if (!pairs) continue;
+
+        broadPhase->pairs[broadPhase->nPairs++] = (CandidatePair) {
+            .projectile = proxy->handle,
+            .kind       = proxy->kind,
+            .target     = targetNumber,
+        };
+    }
+}
+
+void updateBroadPhase(Game *game, Scalar reach) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    compactProxies(game);
+    insertNewProxies(game);
+    broadPhase->nPairs = 0;
+
+    Scalar maxWidth = 0;
+    for (int kind = 0; kind < N_PROXY_POOLS; ++kind) {
+        Scalar width = proxyPool(game, kind)->width;
+        maxWidth = width > maxWidth ? width : maxWidth;
+    }
+
+    // Dead ships still take powerups, the narrow phase skips their bullets
+    for (int shipNumber = 0; shipNumber < 2; ++shipNumber) {
+        Bounds bounds = game->ships[shipNumber].bounds;
+        if (shipNumber == 1) {
+            bounds.x -= reach;
+            bounds.width += 2 * reach;
+        }
+        queryTarget(game, bounds, shipNumber, maxWidth);
+    }
+
+    if (game->enemyShip.state == ACTIVE) {
+        queryTarget(game, game->enemyShip.bounds, 2, maxWidth);
+    }
+}
+
+uint32_t overlapPairs(Game *game, ProxyKind kind, uint8_t targetNumber, Bounds target) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    EntityPool *pool = proxyPool(game, kind);
+    // The whole pool moved by the same step, so the swept boxes share their size too
+    Bounds swept = sweptBounds((Bounds) {0, 0, pool->width, pool->height}, pool->sweepY);
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < broadPhase->nPairs; ++i) {
+        CandidatePair *pair = &broadPhase->pairs[i];
+        if (pair->kind != kind || pair->target != targetNumber) continue;
+
+        int idx = lookupInPool(pool, pair->projectile);
+        if (idx < 0) continue;
+
+        broadPhase->narrowX[n] = pool->x[idx];
+        broadPhase->narrowY[n] = pool->y[idx] - pool->sweepY + swept.y;
+        broadPhase->narrowHandles[n++] = pair->projectile;
+    }
+
+    overlapBatch(target, broadPhase->narrowX, broadPhase->narrowY, swept.width, swept.height, n, broadPhase->hits);
+    return n;
+}
+
+int firstImpact(Game *game, ProxyKind kind, uint32_t n, Bounds target) {
+    BroadPhase *broadPhase = &game->broadPhase;
+    EntityPool *pool = proxyPool(game, kind);
+    int first = -1;
+    Scalar firstTime = 0;
+
+    for (uint32_t word = 0; word < hitWords(n); ++word) {
+        for (uint64_t hits = broadPhase->hits[word]; hits; hits &= hits - 1) {
+            int i = word * 64 + __builtin_ctzll(hits);
+            int idx = lookupInPool(pool, broadPhase->narrowHandles[i]);
+            Scalar time = timeOfImpact(poolSweepStart(pool, idx), pool->sweepY, target);
+            if (first < 0 || time < firstTime) {
+                first = i;
+                firstTime = time;
+            }
+        }
+    }
+
+    return first;
+}
@@ -0,0 +1,77 @@
+#ifndef _BROAD_PHASE_H_
+#define _BROAD_PHASE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "entity.h"
+#include "scalar.h"
+
+#define N_PROXY_POOLS 3
+
+
+typedef struct Game Game;
+
+typedef enum ProxyKind {
+    PROXY_BULLET_UP,
+    PROXY_BULLET_DOWN,
+    PROXY_POWERUP,
+} ProxyKind;
+
+// Interval of a projectile along x
+typedef struct Proxy {
+    Scalar       minX;
+    Scalar       maxX;
+    EntityHandle handle;
+    uint8_t      kind;
+} Proxy;
+
+// A bullet or powerup whose interval overlaps the one of a ship
+typedef struct CandidatePair {
+    EntityHandle projectile;
+    uint8_t      kind;
+    // 0 and 1 for the players ships, 2 for the enemy ship
+    uint8_t      target;
+} CandidatePair;
+
+/**
+ * Sweep and prune along x for what bullets and powerups can hit but the aliens: the ships.
+ * Projectiles only move along y, so their intervals never change and the sorted proxies
+ * persist between ticks: the new ones are inserted and the ones of removed entities are
+ * dropped lazily. Each ship then takes the projectiles overlapping it from a binary search.
+ * The pairs go to a buffer sized for the worst case at creation.
+ * The order is total (x, kind, handle), so a rebuilt broad phase gives the same pairs.
+ */
+typedef struct BroadPhase {
+    Proxy         *proxies;
+    CandidatePair *pairs;
+    // Handle proxied for each slot of the bullets and powerups pools, tells the new entities apart
+    EntityHandle  *tracked[N_PROXY_POOLS];
+    // Projectiles of the pairs of one target gathered for the batch test, and its result
+    Scalar        *narrowX;
+    Scalar        *narrowY;
+    EntityHandle  *narrowHandles;
+    uint64_t      *hits;
+    uint32_t      nProxies;
+    uint32_t      nPairs;
+} BroadPhase;
+
+// Room the broad phase of pools of these capacities takes in an arena
+size_t broadPhaseBytes(const uint16_t capacities[N_PROXY_POOLS]);
+// Needs the pools of the game created
+void initBroadPhase(Game *game, Arena *arena);
+// Forgets every proxy, for when the game state is replaced
+void resetBroadPhase(Game *game);
+// reach widens the interval of the player 2 ship to cover all its moves of the tick
+void updateBroadPhase(Game *game, Scalar reach);
+EntityPool *proxyPool(Game *game, ProxyKind kind);
+/**
+ * Tests target against the paths of the last move of the projectiles of kind paired with targetNumber
+ * still alive. Bit i of broadPhase.hits is set when narrowHandles[i] went through it, the count is returned.
+ */
+uint32_t overlapPairs(Game *game, ProxyKind kind, uint8_t targetNumber, Bounds target);
+// Among the hits of overlapPairs the one that reached target first or -1, ties go to the first gathered
+int firstImpact(Game *game, ProxyKind kind, uint32_t n, Bounds target);
+
+#endif
@@ -3,126 +3,197 @@
 #include <raylib.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "aabb.h"
+#include "arena.h"
+#include "rng.h"
+#include "scalar.h"
 
-EntitiesIterator createIterator(
-    Entity *entities, IteratorType type, uint16_t size
-) {
-    EntitiesIterator it = {
-        .entities     = entities,
-        .type         = type,
-        .size         = size,
+
+Rectangle boundsToRectangle(Bounds bounds) {
+    return (Rectangle) {
+        .x      = scToFloat(bounds.x),
+        .y      = scToFloat(bounds.y),
+        .width  = scToFloat(bounds.width),
+        .height = scToFloat(bounds.height),
     };
-    resetIterator(&it);
+}
 
-    return it;
+bool checkCollisionBounds(Bounds a, Bounds b) {
+    return (
+        a.x < b.x + b.width && a.x + a.width > b.x &&
+        a.y < b.y + b.height && a.y + a.height > b.y
+    );
 }
 
-void resetIterator(EntitiesIterator *it) {
-    switch (it->type) {
-        case BULLETS_AT_SHIP:
-        {
-            it->currentIndex = 0;
-            while (!iteratorReachedEnd(it) && (getCurrentEntity(it)->state != ACTIVE || getCurrentEntity(it)->up)) {
-                it->currentIndex++;
-            }
-        } break;
-        case BULLETS_AT_ENEMIES:
-        {
-            it->currentIndex = 0;
-            while (!iteratorReachedEnd(it) && (getCurrentEntity(it)->state != ACTIVE || !getCurrentEntity(it)->up)) {
-                it->currentIndex++;
-            }
-        } break;
-        case ALIENS:
-        case POWERUPS:
-        case BULLETS:
-        {
-            it->currentIndex = 0;
-            while (!iteratorReachedEnd(it) && getCurrentEntity(it)->state != ACTIVE) {
-                it->currentIndex++;
-            }
-        } break;
-        default: break;
-    }
+size_t entityPoolBytes(uint16_t capacity) {
+    return 2 * arenaBytes(capacity * sizeof(Scalar))
+        + arenaBytes(capacity * sizeof(EntityHandle))
+        + arenaBytes(capacity * sizeof(uint8_t))
+        + 3 * arenaBytes(capacity * sizeof(uint16_t));
 }
 
-bool iteratorReachedEnd(EntitiesIterator *it) {
-    return it->currentIndex >= it->size;
-}
-
-void iteratorNext(EntitiesIterator *it) {
-    if (!iteratorReachedEnd(it)) {
-        it->currentIndex++;
-        switch (it->type) {
-            case BULLETS_AT_SHIP:
-            {
-                while (!iteratorReachedEnd(it) && (getCurrentEntity(it)->state != ACTIVE || getCurrentEntity(it)->up)) {
-                    it->currentIndex++;
-                }
-            } break;
-            case BULLETS_AT_ENEMIES:
-            {
-                while (!iteratorReachedEnd(it) && (getCurrentEntity(it)->state != ACTIVE || !getCurrentEntity(it)->up)) {
-                    it->currentIndex++;
-                }
-            } break;
-            case BULLETS:
-            case ALIENS:
-            case POWERUPS:
-            {
-                while (!iteratorReachedEnd(it) && getCurrentEntity(it)->state != ACTIVE) {
-                    it->currentIndex++;
-                }
-            } break;
-            default: break;
-        }
+// In the order the update loops touch them
+EntityPool createEntityPool(Arena *arena, uint16_t capacity, Scalar width, Scalar height) {
+    EntityPool pool = {
+        .x           = (Scalar *)arenaAlloc(arena, capacity * sizeof(Scalar)),
+        .y           = (Scalar *)arenaAlloc(arena, capacity * sizeof(Scalar)),
+        .handles     = (EntityHandle *)arenaAlloc(arena, capacity * sizeof(EntityHandle)),
+        .types       = (uint8_t *)arenaAlloc(arena, capacity * sizeof(uint8_t)),
+        .denseIdx    = (uint16_t *)arenaAlloc(arena, capacity * sizeof(uint16_t)),
+        .generations = (uint16_t *)arenaAlloc(arena, capacity * sizeof(uint16_t)),
+        .freeSlots   = (uint16_t *)arenaAlloc(arena, capacity * sizeof(uint16_t)),
+        .width       = width,
+        .height      = height,
+        .capacity    = capacity,
+    };
+
+    resetEntityPool(&pool);
+    return pool;
+}
+
+void resetEntityPool(EntityPool *pool) {
+    const uint16_t capacity = pool->capacity;
+    memset(pool->x, 0, capacity * sizeof(Scalar));
+    memset(pool->y, 0, capacity * sizeof(Scalar));
+    memset(pool->handles, 0, capacity * sizeof(EntityHandle));
+    memset(pool->types, 0, capacity * sizeof(uint8_t));
+    memset(pool->denseIdx, 0, capacity * sizeof(uint16_t));
+    pool->sweepY = 0;
+    pool->count = 0;
+    pool->nFree = capacity;
+
+    // The lowest slots are handed out first
+    for (int i = 0; i < capacity; ++i) {
+        pool->generations[i] = 1;
+        pool->freeSlots[i] = capacity - 1 - i;
     }
 }
 
-Entity *getCurrentEntity(EntitiesIterator *it) {
-    if (iteratorReachedEnd(it)) return NULL;
-    return &it->entities[it->currentIndex];
+EntityHandle spawnInPool(EntityPool *pool, Scalar x, Scalar y, EntityType type) {
+    if (pool->count == pool->capacity) return NULL_ENTITY_HANDLE;
+
+    uint16_t i = pool->count++;
+    uint16_t slot = pool->freeSlots[--pool->nFree];
+    EntityHandle handle = ((EntityHandle)pool->generations[slot] << 16) | slot;
+
+    pool->x[i]           = x;
+    pool->y[i]           = y;
+    pool->types[i]       = (uint8_t)type;
+    pool->handles[i]     = handle;
+    pool->denseIdx[slot] = i;
+
+    return handle;
 }
 
-CollisionIterator createCollisionIterator(
-    Entity *bullets, Entity *horde, uint16_t sizeBullets, uint16_t sizeHorde
-) {
-    return (CollisionIterator) {
-        .bullets = createIterator(bullets, BULLETS_AT_ENEMIES, sizeBullets),
-        .aliens  = createIterator(horde, ALIENS, sizeHorde),
+void removeFromPool(EntityPool *pool, uint16_t idx) {
+    uint16_t last = --pool->count;
+    uint16_t slot = handleSlot(pool->handles[idx]);
+
+    if (++pool->generations[slot] == 0) pool->generations[slot] = 1;
+    pool->freeSlots[pool->nFree++] = slot;
+
+    pool->x[idx]       = pool->x[last];
+    pool->y[idx]       = pool->y[last];
+    pool->types[idx]   = pool->types[last];
+    pool->handles[idx] = pool->handles[last];
+    pool->denseIdx[handleSlot(pool->handles[idx])] = idx;
+}
+
+int lookupInPool(EntityPool *pool, EntityHandle handle) {
+    uint16_t slot = handleSlot(handle);
+    if (slot >= pool->capacity) return -1;
+
+    // Also rejects the handles of slots that were never handed out
+    uint16_t i = pool->denseIdx[slot];
+    return (i < pool->count && pool->handles[i] == handle) ? i : -1;
+}
+
+bool freeInPool(EntityPool *pool, EntityHandle handle) {
+    int i = lookupInPool(pool, handle);
+    if (i < 0) return false;
+
+    removeFromPool(pool, i);
+    return true;
+}
+
+Bounds poolBounds(EntityPool *pool, uint16_t idx) {
+    return (Bounds) {
+        .x      = pool->x[idx],
+        .y      = pool->y[idx],
+        .width  = pool->width,
+        .height = pool->height,
     };
 }
 
-bool collisionIteratorReachedEnd(CollisionIterator *it) {
-    return (iteratorReachedEnd(&it->bullets) || iteratorReachedEnd(&it->aliens));
+Bounds poolSweepStart(EntityPool *pool, uint16_t idx) {
+    Bounds bounds = poolBounds(pool, idx);
+    bounds.y -= pool->sweepY;
+
+    return bounds;
+}
+
+void shiftPoolRange(EntityPool *pool, Scalar dy, uint32_t begin, uint32_t end) {
+    Scalar *restrict y = pool->y;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        y[i] += dy;
+    }
 }
 
-void collisionIteratorNext(CollisionIterator *it) {
-    Entity *currentBullet = getCurrentEntity(&it->bullets);
-    Entity *currentAlien  = getCurrentEntity(&it->aliens);
+void cullPool(EntityPool *pool, Scalar bottom) {
+    const Scalar *y = pool->y;
+    const Scalar top = -pool->height;
 
-    if (currentBullet != NULL && currentAlien != NULL) {
-        if (getCurrentEntity(&it->bullets)->state == INACTIVE && getCurrentEntity(&it->aliens)->state == DEAD)  {
-            iteratorNext(&it->bullets);
-            resetIterator(&it->aliens);
-        } else {
-            iteratorNext(&it->aliens);
-            if (!iteratorReachedEnd(&it->bullets) && iteratorReachedEnd(&it->aliens)) {
-                resetIterator(&it->aliens);
-                iteratorNext(&it->bullets);
-            }
-        }
+    // Backwards, so the entity swapped into a hole was already checked
+    for (int i = pool->count - 1; i >= 0; --i) {
+        if (y[i] >= bottom || y[i] <= top) removeFromPool(pool, i);
+    }
+}
+
+void movePoolVertically(EntityPool *pool, Scalar dy, Scalar bottom) {
+    pool->sweepY = dy;
+    shiftPoolRange(pool, dy, 0, pool->count);
+    cullPool(pool, bottom);
+}
+
+void translatePool(EntityPool *pool, Scalar dx, Scalar dy) {
+    Scalar *restrict x = pool->x;
+    Scalar *restrict y = pool->y;
+    const int n = pool->count;
+
+    for (int i = 0; i < n; ++i) {
+        x[i] += dx;
+        y[i] += dy;
     }
 }
 
-Entity *createPlayerShips() {
-    const float height = 72.0f;
-    const float width = 96.0f;
-    const float x = 912.0f;
-    const float y = 900.0f;
+Scalar getPoolMaxX(EntityPool *pool) {
+    const Scalar *restrict x = pool->x;
+    const int n = pool->count;
+    Scalar maxX = scFromInt(-30000);
+
+    for (int i = 0; i < n; ++i) {
+        maxX = x[i] > maxX ? x[i] : maxX;
+    }
+
+    return maxX;
+}
+
+Entity *createPlayerShips(Arena *arena) {
+    Entity *ships = (Entity *)arenaAlloc(arena, 2 * sizeof(Entity));
+    resetPlayerShips(ships);
+
+    return ships;
+}
+
+void resetPlayerShips(Entity *ships) {
+    const Scalar height = SC(72.0f);
+    const Scalar width = SC(96.0f);
+    const Scalar x = SC(912.0f);
+    const Scalar y = SC(900.0f);
 
-    Entity *ships = (Entity *)malloc(2 * sizeof(Entity));
     for (int i = 0; i < 2; ++i) {
         ships[i] = (Entity) {
             .bounds = {
@@ -136,20 +207,13 @@ Entity *createPlayerShips() {
         if (i == 0) ships[i].bounds.x = x - width;
         else ships[i].bounds.x = x + width;
     }
-
-    return ships;
-}
-
-void destroyPlayerShips(Entity **ships) {
-    free(*ships);
-    *ships = NULL;
 }
 
 Entity createEnemyShip() {
-    const float height = 40.0f;
-    const float width = 64.0f;
-    const float x = 1920.0f;
-    const float y = 50.0f;
+    const Scalar height = SC(40.0f);
+    const Scalar width = SC(64.0f);
+    const Scalar x = SC(1920.0f);
+    const Scalar y = SC(50.0f);
 
     Entity enemyShip = {
         .bounds = {
@@ -166,138 +230,240 @@ Entity createEnemyShip() {
 }
 
 
-Entity *createHorde() {
-    const int sizeHorde = nRowsAliens * nColsAliens;
-    const float height = 32.0f;
+// Alien of each fifth of the rows, top to bottom
+static const EntityType hordeRowTypes[] = {ALIEN1, ALIEN1, ALIEN2, ALIEN3, ALIEN3};
+
+EntityType hordeRowType(int row, int nRows) {
+    return hordeRowTypes[row * 5 / nRows];
+}
+
+// 1 up to the classic 5x11 horde, below for those that wouldn't fit in the room given to the horde
+float hordeScale(uint16_t nRows, uint16_t nColumns) {
     const float width = 32.0f;
-    const float gapX = 15.0f;
-    const float gapY = 20.0f;
-    const float offSetX = 1920.0f/2.0f - (width*(float)nColsAliens + gapX*((float)nColsAliens - 1.0f))/2.0f;
-    const float offSetY = height*3.0f;
-    float x, y;
+    const float height = 32.0f;
+    float scaleX = hordeMaxWidth / (nColumns * (width + hordeGapX));
+    float scaleY = hordeMaxHeight / (nRows * (height + hordeGapY));
+    float scale = scaleX < scaleY ? scaleX : scaleY;
 
-    Entity *horde = (Entity *)malloc(sizeHorde * sizeof(Entity));
+    return scale < 1.0f ? scale : 1.0f;
+}
+
+// The positions are offsets from the formation origin
+EntityPool createHorde(Arena *arena, uint16_t nRows, uint16_t nColumns) {
+    const float scale = hordeScale(nRows, nColumns);
+    EntityPool horde = createEntityPool(arena, nRows * nColumns, scFromFloat(32.0f * scale), scFromFloat(32.0f * scale));
+    resetHorde(&horde, nRows, nColumns);
+
+    return horde;
+}
+
+void resetHorde(EntityPool *horde, uint16_t nRows, uint16_t nColumns) {
+    const int sizeHorde = nRows * nColumns;
+    const float scale = hordeScale(nRows, nColumns);
+    const float height = 32.0f * scale;
+    const float width = 32.0f * scale;
+    const float gapX = hordeGapX * scale;
+    const float gapY = hordeGapY * scale;
+    float x, y;
 
+    resetEntityPool(horde);
     for (int i = 0; i < sizeHorde; ++i) {
-        x = offSetX + ((i % nColsAliens)*(width + gapX));
-        y = offSetY + ((i / nColsAliens)*(height + gapY));
-
-        horde[i].bounds = (Rectangle){.height = height, .width = width, .x = x, .y = y};
-        horde[i].state  = ACTIVE;
-        if (i / nColsAliens < 2) horde[i].type = ALIEN1;
-        else if (i / nColsAliens < 3) horde[i].type = ALIEN2;
-        else horde[i].type = ALIEN3;
+        x = (i % nColumns)*(width + gapX);
+        y = (i / nColumns)*(height + gapY);
+
+        // Spawned in order, so the slot of each alien is its cell
+        spawnInPool(horde, scFromFloat(x), scFromFloat(y), hordeRowType(i / nColumns, nRows));
     }
+}
 
-    return horde;
+size_t formationBytes(uint16_t nRows, uint16_t nColumns) {
+    return arenaBytes(hitWords(nRows * nColumns) * sizeof(uint64_t))
+        + arenaBytes(nColumns * sizeof(uint16_t))
+        + arenaBytes(nRows * sizeof(uint16_t));
 }
 
-void destroyHorde(Entity **horde) {
-    free(*horde);
-    *horde = NULL;
+Formation createFormation(Arena *arena, EntityPool *horde, uint16_t nRows, uint16_t nColumns) {
+    Formation formation = {
+        .alive       = (uint64_t *)arenaAlloc(arena, hitWords(nRows * nColumns) * sizeof(uint64_t)),
+        .columnCount = (uint16_t *)arenaAlloc(arena, nColumns * sizeof(uint16_t)),
+        .rowCount    = (uint16_t *)arenaAlloc(arena, nRows * sizeof(uint16_t)),
+        .nRows       = nRows,
+        .nColumns    = nColumns,
+    };
+
+    resetFormation(&formation, horde);
+    return formation;
 }
 
-// Create an array of size n of entities which the type field is BULLET
-Entity *createBulletsArray(int n) {
-    const float height = 32.0f;
-    const float width = 4.0f;
+void resetFormation(Formation *formation, EntityPool *horde) {
+    const uint16_t nRows = formation->nRows;
+    const uint16_t nColumns = formation->nColumns;
+    const float scale = hordeScale(nRows, nColumns);
+    const float width = scToFloat(horde->width);
+    const float height = scToFloat(horde->height);
+    const float gapX = hordeGapX * scale;
+    const float offSetX = 1920.0f/2.0f - (width*(float)nColumns + gapX*((float)nColumns - 1.0f))/2.0f;
+    const float offSetY = height*3.0f;
+    const int nCells = nRows * nColumns;
+
+    formation->x         = scFromFloat(offSetX);
+    formation->y         = scFromFloat(offSetY);
+    formation->pitchX    = horde->width + scFromFloat(gapX);
+    formation->pitchY    = horde->height + scFromFloat(hordeGapY * scale);
+    formation->nAlive    = nCells;
+    formation->minColumn = 0;
+    formation->maxColumn = nColumns - 1;
+    formation->maxRow    = nRows - 1;
+
+    memset(formation->alive, 0, hitWords(nCells) * sizeof(uint64_t));
+    for (int i = 0; i < nCells; ++i) formation->alive[i / 64] |= UINT64_C(1) << (i % 64);
+    for (int i = 0; i < nColumns; ++i) formation->columnCount[i] = nRows;
+    for (int i = 0; i < nRows; ++i) formation->rowCount[i] = nColumns;
+}
 
-    Entity *bullets = (Entity *)malloc(n * sizeof(Entity));
+// The extents move past the emptied columns and rows, each one once over the whole round
+void killInFormation(Formation *formation, int cell) {
+    int row = cell / formation->nColumns;
+    int col = cell % formation->nColumns;
 
-    for (int i = 0; i < n; ++i) {
-        bullets[i] = (Entity) {
-            .bounds = {.height = height, .width = width},
-            .state  = INACTIVE,
-            .type   = BULLET,
-        };
+    formation->alive[cell / 64] &= ~(UINT64_C(1) << (cell % 64));
+    formation->nAlive--;
+    formation->columnCount[col]--;
+    formation->rowCount[row]--;
+
+    while (formation->minColumn < formation->maxColumn && formation->columnCount[formation->minColumn] == 0) {
+        formation->minColumn++;
+    }
+    while (formation->maxColumn > formation->minColumn && formation->columnCount[formation->maxColumn] == 0) {
+        formation->maxColumn--;
+    }
+    while (formation->maxRow > 0 && formation->rowCount[formation->maxRow] == 0) {
+        formation->maxRow--;
     }
+}
 
-    return bullets;
+Scalar formationMinX(Formation *formation) {
+    return formation->x + formation->pitchX * formation->minColumn;
 }
 
-void destroyBullets(Entity **bullets) {
-    free(*bullets);
-    *bullets = NULL;
+Scalar formationMaxX(Formation *formation) {
+    return formation->x + formation->pitchX * formation->maxColumn;
 }
 
-Entity *createPowerupsArray(int n) {
-    const float height = 25.0f;
+Scalar formationMaxY(Formation *formation) {
+    return formation->y + formation->pitchY * formation->maxRow;
+}
 
-    Entity *powerups = (Entity *)malloc(n * sizeof(Entity));
+Bounds formationBounds(Formation *formation, EntityPool *horde, uint16_t idx) {
+    return (Bounds) {
+        .x      = formation->x + horde->x[idx],
+        .y      = formation->y + horde->y[idx],
+        .width  = horde->width,
+        .height = horde->height,
+    };
+}
 
-    for (int i = 0; i < n; ++i) {
-        // The position and the direction of the bullet will be setted in the activation.
-        powerups[i] = (Entity) {
-            .bounds = {.height = height, .width = height},
-            .state  = INACTIVE,
-        };
+// Keeps the alien met first among the n candidates of the batch
+void earliestAlienHit(
+    EntityPool *horde, Bounds bullet, Scalar dy, const Scalar *x, const Scalar *y, const uint16_t *candidates, int n,
+    int *hit, Scalar *hitTime
+) {
+    uint64_t hits;
+    overlapBatch(sweptBounds(bullet, dy), x, y, horde->width, horde->height, n, &hits);
+
+    for (; hits; hits &= hits - 1) {
+        int i = __builtin_ctzll(hits);
+        Bounds alien = {x[i], y[i], horde->width, horde->height};
+        Scalar time = timeOfImpact(bullet, dy, alien);
+        if (*hit < 0 || time < *hitTime) {
+            *hit = candidates[i];
+            *hitTime = time;
+        }
+    }
+}
+
+int findAlienHit(EntityPool *horde, Formation *formation, Bounds bullet, Scalar dy) {
+    const Scalar pitchX = formation->pitchX;
+    const Scalar pitchY = formation->pitchY;
+    // Covers the rounding of the divisions, the exact test is done on the alien below
+    const Scalar slack = SC(1.0f);
+    Bounds swept = sweptBounds(bullet, dy);
+
+    // Cells whose box can overlap the path of the bullet
+    int firstRow = scFloorDiv(swept.y - formation->y - horde->height - slack, pitchY);
+    int lastRow  = scFloorDiv(swept.y + swept.height - formation->y + slack, pitchY);
+    int firstCol = scFloorDiv(swept.x - formation->x - horde->width - slack, pitchX);
+    int lastCol  = scFloorDiv(swept.x + swept.width - formation->x + slack, pitchX);
+
+    if (firstRow < 0) firstRow = 0;
+    if (firstCol < 0) firstCol = 0;
+    if (lastRow >= formation->nRows) lastRow = formation->nRows - 1;
+    if (lastCol >= formation->nColumns) lastCol = formation->nColumns - 1;
+
+    // The live aliens of those cells in row-major order, tested in batches of 64
+    Scalar x[64], y[64];
+    uint16_t candidates[64];
+    int n = 0;
+    // The bullet stops at the first alien on its way, ties go to the first in row-major order
+    int hit = -1;
+    Scalar hitTime = 0;
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int col = firstCol; col <= lastCol; ++col) {
+            int cell = row * formation->nColumns + col;
+            if (!(formation->alive[cell / 64] & (UINT64_C(1) << (cell % 64)))) continue;
+
+            // The slot of an alien is its cell
+            uint16_t i = horde->denseIdx[cell];
+            x[n] = formation->x + horde->x[i];
+            y[n] = formation->y + horde->y[i];
+            candidates[n++] = i;
+
+            if (n == 64) {
+                earliestAlienHit(horde, bullet, dy, x, y, candidates, n, &hit, &hitTime);
+                n = 0;
+            }
+        }
     }
 
-    return powerups;
+    if (n > 0) earliestAlienHit(horde, bullet, dy, x, y, candidates, n, &hit, &hitTime);
+    return hit;
 }
 
-void destroyPowerups(Entity **powerups) {
-    free(*powerups);
-    *powerups = NULL;
+// Create an empty pool for n bullets
+EntityPool createBulletsPool(Arena *arena, uint16_t n) {
+    const Scalar height = SC(32.0f);
+    const Scalar width = SC(4.0f);
+
+    // The position and the direction of the bullet will be setted in the activation.
+    return createEntityPool(arena, n, width, height);
 }
 
-void generateBullet(Rectangle *shooterBounds, Entity *bullets, bool up, int n) {
-    int i;
-    for (i = 0; i < n && bullets[i].state == ACTIVE; ++i);
-    if (i < n) {
-        Vector2 position = {
-            .x = shooterBounds->x + (shooterBounds->width - bullets[i].bounds.width) / 2.0f,
-            .y = shooterBounds->y
-        };
+EntityPool createPowerupsPool(Arena *arena, uint16_t n) {
+    const Scalar height = SC(25.0f);
 
-        if (up) position.y -= bullets[i].bounds.height;
-        else position.y += shooterBounds->height;
+    return createEntityPool(arena, n, height, height);
+}
 
-        bullets[i].bounds.x = position.x;
-        bullets[i].bounds.y = position.y;
-        bullets[i].up       = up;
-        bullets[i].state    = ACTIVE;
-    }
+void generateBullet(Bounds *shooterBounds, EntityPool *bullets, bool up) {
+    Scalar x = shooterBounds->x + (shooterBounds->width - bullets->width) / 2;
+    Scalar y = shooterBounds->y;
+
+    if (up) y -= bullets->height;
+    else y += shooterBounds->height;
+
+    spawnInPool(bullets, x, y, BULLET);
 }
 
-void generatePowerup(Rectangle *bounds, Entity *powerups, int n) {
-    int newPowerupIdx = 0;
+void generatePowerup(Bounds *bounds, EntityPool *powerups, Rng *rng) {
     EntityType powerupType;
-    if ((rand() % 100) < 50) powerupType = FAST_MOVE;
+    if (rngBelow(rng, 100) < 50) powerupType = FAST_MOVE;
     else powerupType = FAST_SHOT;
 
-    switch (powerupType) {
-        case FAST_MOVE:
-        {
-            for (int i = 0; i < n / 2; ++i) {
-                if (powerups[i].state != ACTIVE) {
-                    newPowerupIdx = i;
-                    break;
-                }
-            }
-        } break;
-        case FAST_SHOT:
-        {
-            for (int i = n / 2; i < n; ++i) {
-                if (powerups[i].state != ACTIVE) {
-                    newPowerupIdx = i;
-                    break;
-                }
-            }
-        } break;
-        default: break;
-    }
-
-    if (newPowerupIdx < n) {
-        Vector2 position = {
-            .x = bounds->x + (bounds->width - powerups[newPowerupIdx].bounds.width) / 2.0f,
-            .y = bounds->y + bounds->height
-        };
-
-        powerups[newPowerupIdx].bounds.x = position.x;
-        powerups[newPowerupIdx].bounds.y = position.y;
-        powerups[newPowerupIdx].up       = false;
-        powerups[newPowerupIdx].state    = ACTIVE;
-        powerups[newPowerupIdx].type     = powerupType;
-    }
+    spawnInPool(
+        powerups,
+        bounds->x + (bounds->width - powerups->width) / 2,
+        bounds->y + bounds->height,
+        powerupType
+    );
 }
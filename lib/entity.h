@@ -2,10 +2,18 @@
 #define _ENTITY_H_
 
 #include <raylib.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define nRowsAliens 5
-#define nColsAliens 11
+#include "arena.h"
+#include "rng.h"
+#include "scalar.h"
+
+#define hordeGapX 15.0f
+#define hordeGapY 20.0f
+// Room the horde starts in, larger ones are scaled down to fit
+#define hordeMaxWidth 1100.0f
+#define hordeMaxHeight 500.0f
 
 
 typedef enum EntityType {
@@ -19,6 +27,8 @@ typedef enum EntityType {
     FAST_MOVE,
 } EntityType;
 
+#define N_ENTITY_TYPES (FAST_MOVE + 1)
+
 typedef enum EntityState {
     ACTIVE,
     // Used to stop the updating of the enemy ship
@@ -26,18 +36,18 @@ typedef enum EntityState {
     DEAD,
 } EntityState;
 
-typedef enum IteratorType {
-    BULLETS,
-    BULLETS_AT_SHIP,
-    BULLETS_AT_ENEMIES,
-    ALIENS,
-    POWERUPS,
-} IteratorType;
+// Simulation counterpart of raylib's Rectangle, same field order
+typedef struct Bounds {
+    Scalar x;
+    Scalar y;
+    Scalar width;
+    Scalar height;
+} Bounds;
 
 typedef struct Entity {
     // Each type of entity will have the same width and height, make sense to use a Rectangle?
     // What would be the tradeoffs of using a Vector2?
-    Rectangle bounds;
+    Bounds bounds;
     EntityType type;
     /*
         Used for the player to know how to update bullets (and powerups),
@@ -47,41 +57,127 @@ typedef struct Entity {
     bool up;
 } Entity;
 
-typedef struct EntitiesIterator {
-    Entity *entities;
-    IteratorType type;
-    uint16_t size;
-    uint16_t currentIndex;
-} EntitiesIterator;
-
-// Will be used to check the collision of bullets and aliens
-typedef struct CollisionIterator {
-    EntitiesIterator bullets;
-    EntitiesIterator aliens;
-} CollisionIterator;
-
-EntitiesIterator createIterator(Entity *, IteratorType, uint16_t size);
-void resetIterator(EntitiesIterator *it);
-bool iteratorReachedEnd(EntitiesIterator *it);
-void iteratorNext(EntitiesIterator *it);
-Entity *getCurrentEntity(EntitiesIterator *it);
-
-CollisionIterator createCollisionIterator(Entity *bullets, Entity *horde, uint16_t sizeBullets, uint16_t sizeHorde);
-bool collisionIteratorReachedEnd(CollisionIterator *it);
-void collisionIteratorNext(CollisionIterator *it);
-
-Entity *createPlayerShips();
-void destroyPlayerShips(Entity **ships);
+/**
+ * Reference to a pooled entity that stays valid while the entity lives: the slot in the low
+ * 16 bits and the generation of the slot in the high ones. Freeing an entity bumps the generation
+ * of its slot, so handles to it fail the lookup instead of reaching whatever reuses the slot.
+ * Generations start at 1, a zero handle never refers to an entity.
+ */
+typedef uint32_t EntityHandle;
+
+#define NULL_ENTITY_HANDLE 0
+#define handleSlot(handle) ((uint16_t)((handle) & 0xffff))
+#define handleGeneration(handle) ((uint16_t)((handle) >> 16))
+
+/**
+ * Dense structure of arrays storage for the numerous entities (aliens, bullets and powerups),
+ * any EntityType can be pooled.
+ * The live entities are packed in [0, count) and a removal moves the last one into the hole,
+ * so the update loops walk only live entities without checking any state.
+ * Every entity of a pool has the same width and height.
+ */
+typedef struct EntityPool {
+    // Dense, indexed from 0 to count
+    Scalar       *x;
+    Scalar       *y;
+    uint8_t      *types;
+    EntityHandle *handles;
+    // Sparse, indexed by slot
+    uint16_t     *denseIdx;
+    uint16_t     *generations;
+    // Stack of the slots not in use, spawning pops from it
+    uint16_t     *freeSlots;
+    Scalar       width;
+    Scalar       height;
+    // Move along y of the last tick, the collisions sweep the entities back over it
+    Scalar       sweepY;
+    uint16_t     count;
+    uint16_t     nFree;
+    uint16_t     capacity;
+} EntityPool;
+
+/**
+ * The horde moves as a rigid grid: its pool keeps the offsets of the aliens from the origin,
+ * which is where the cell 0 is (dead or not), and moving it is O(1).
+ * The alive counts of the columns and rows give the extents of the horde without touching the aliens.
+ * Its arrays are sized by the rows and columns at creation.
+ */
+typedef struct Formation {
+    Scalar   x;
+    Scalar   y;
+    Scalar   pitchX;
+    Scalar   pitchY;
+    // Bit per cell with a living alien, cells are row-major
+    uint64_t *alive;
+    uint16_t *columnCount;
+    uint16_t *rowCount;
+    uint32_t nAlive;
+    uint16_t nRows;
+    uint16_t nColumns;
+    // Outermost non empty columns and lowest non empty row, they only move inwards
+    uint16_t minColumn;
+    uint16_t maxColumn;
+    uint16_t maxRow;
+} Formation;
+
+Rectangle boundsToRectangle(Bounds bounds);
+// Same test as raylib's CheckCollisionRecs
+bool checkCollisionBounds(Bounds a, Bounds b);
+
+// Room the pool takes in an arena
+size_t entityPoolBytes(uint16_t capacity);
+EntityPool createEntityPool(Arena *arena, uint16_t capacity, Scalar width, Scalar height);
+// Empties the pool, as it was created
+void resetEntityPool(EntityPool *pool);
+// Returns NULL_ENTITY_HANDLE when the pool is full, the new entity is at the index count - 1
+EntityHandle spawnInPool(EntityPool *pool, Scalar x, Scalar y, EntityType type);
+// The last entity is moved into idx
+void removeFromPool(EntityPool *pool, uint16_t idx);
+// Index of the entity or -1 when the handle is stale
+int lookupInPool(EntityPool *pool, EntityHandle handle);
+// Returns false when the handle is stale
+bool freeInPool(EntityPool *pool, EntityHandle handle);
+Bounds poolBounds(EntityPool *pool, uint16_t idx);
+// Bounds of the entity before its last move
+Bounds poolSweepStart(EntityPool *pool, uint16_t idx);
+// Moves the entities along y and removes the ones off [top, bottom)
+void movePoolVertically(EntityPool *pool, Scalar dy, Scalar bottom);
+// The two halves of movePoolVertically, the move can be split in ranges but not the removal
+void shiftPoolRange(EntityPool *pool, Scalar dy, uint32_t begin, uint32_t end);
+void cullPool(EntityPool *pool, Scalar bottom);
+void translatePool(EntityPool *pool, Scalar dx, Scalar dy);
+// Only meaningful for a non empty pool
+Scalar getPoolMaxX(EntityPool *pool);
+
+Entity *createPlayerShips(Arena *arena);
+void resetPlayerShips(Entity *ships);
 Entity createEnemyShip();
-Entity *createHorde();
-void destroyHorde(Entity **horde);
-Entity *createBulletsArray(int n);
-void destroyBullets(Entity **bullets);
-Entity *createPowerupsArray(int n);
-void destroyPowerups(Entity **powerups);
-void generateBullet(Rectangle *shooterBounds, Entity *bullets, bool up, int n);
-
-// The name of the Rectangle variable can improve
-void generatePowerup(Rectangle *bounds, Entity *powerups, int n);
+// Type of the aliens of a row, the same bands as the classic 5 rows
+EntityType hordeRowType(int row, int nRows);
+EntityPool createHorde(Arena *arena, uint16_t nRows, uint16_t nColumns);
+// Every cell alive at its place, the pool must have been created for the grid
+void resetHorde(EntityPool *horde, uint16_t nRows, uint16_t nColumns);
+size_t formationBytes(uint16_t nRows, uint16_t nColumns);
+Formation createFormation(Arena *arena, EntityPool *horde, uint16_t nRows, uint16_t nColumns);
+// Full and back at its starting place
+void resetFormation(Formation *formation, EntityPool *horde);
+void killInFormation(Formation *formation, int cell);
+// The extents are the top left corners of the outermost non empty columns and rows, the formation can't be empty
+Scalar formationMinX(Formation *formation);
+Scalar formationMaxX(Formation *formation);
+Scalar formationMaxY(Formation *formation);
+// Absolute bounds of an alien
+Bounds formationBounds(Formation *formation, EntityPool *horde, uint16_t idx);
+/**
+ * Index of the first alien the bullet meets moving by dy from bullet, or -1.
+ * Aliens hit at the same time go in row-major order.
+ */
+int findAlienHit(EntityPool *horde, Formation *formation, Bounds bullet, Scalar dy);
+EntityPool createBulletsPool(Arena *arena, uint16_t n);
+EntityPool createPowerupsPool(Arena *arena, uint16_t n);
+void generateBullet(Bounds *shooterBounds, EntityPool *bullets, bool up);
+
+// The name of the Bounds variable can improve
+void generatePowerup(Bounds *bounds, EntityPool *powerups, Rng *rng);
 
 #endif
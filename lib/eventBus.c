@@ -0,0 +1,171 @@
+#include "eventBus.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+
+// How long a consumer sleeps when its ring is empty
+#define EVENT_POLL_NS 1000000
+
+static const char *typeNames[N_GAME_EVENT_TYPES] = {
+    [EVENT_SOUND]   = "sound",
+    [EVENT_MUSIC]   = "music",
+    [EVENT_KILL]    = "kill",
+    [EVENT_SHOT]    = "shot",
+    [EVENT_POWERUP] = "powerup",
+    [EVENT_STATE]   = "state",
+};
+
+
+int createEventRing(EventRing *ring, uint32_t capacity) {
+    uint32_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    ring->cells = (EventCell *)gameAlignedAlloc(ALLOC_EVENTS, 64, size * sizeof(EventCell));
+    if (ring->cells == NULL) {
+        perror("failed to allocate the event ring.\n");
+        return -1;
+    }
+
+    // Cell i is free for the producer that claims position i
+    for (uint32_t i = 0; i < size; ++i) {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+    ring->mask = size - 1;
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->dropped, 0);
+
+    return 0;
+}
+
+void destroyEventRing(EventRing *ring) {
+    gameFree(ring->cells);
+    ring->cells = NULL;
+}
+
+bool pushEvent(EventRing *ring, const GameEvent *event) {
+    uint32_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    EventCell *cell;
+
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        uint32_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        int32_t turn = (int32_t)(sequence - pos);
+
+        if (turn == 0) {
+            // pos is reloaded when another producer claimed it first
+            if (atomic_compare_exchange_weak_explicit(
+                &ring->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed
+            )) break;
+        } else if (turn < 0) {
+            // The consumer hasn't read the cell of the previous lap yet
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->event = *event;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+bool popEvent(EventRing *ring, GameEvent *event) {
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    EventCell *cell = &ring->cells[pos & ring->mask];
+
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1) return false;
+
+    *event = cell->event;
+    // Free for the producer of the next lap
+    atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+    atomic_store_explicit(&ring->head, pos + 1, memory_order_relaxed);
+    return true;
+}
+
+void initEventBus(EventBus *bus) {
+    memset(bus->rings, 0, sizeof(bus->rings));
+    bus->nSubscribers = 0;
+}
+
+void destroyEventBus(EventBus *bus) {
+    for (int i = 0; i < bus->nSubscribers; ++i) {
+        destroyEventRing(&bus->rings[i]);
+    }
+    bus->nSubscribers = 0;
+}
+
+EventRing *subscribeEvents(EventBus *bus, uint32_t capacity) {
+    if (bus->nSubscribers == MAX_EVENT_SUBSCRIBERS) {
+        fprintf(stderr, "the event bus has no room for another subscriber.\n");
+        return NULL;
+    }
+
+    EventRing *ring = &bus->rings[bus->nSubscribers];
+    if (createEventRing(ring, capacity) < 0) return NULL;
+
+    bus->nSubscribers++;
+    return ring;
+}
+
+void publishEvent(EventBus *bus, const GameEvent *event) {
+    for (int i = 0; i < bus->nSubscribers; ++i) {
+        pushEvent(&bus->rings[i], event);
+    }
+}
+
+static void *consumeEvents(void *arg) {
+    EventConsumer *consumer = (EventConsumer *)arg;
+    const struct timespec poll = {.tv_sec = 0, .tv_nsec = EVENT_POLL_NS};
+    GameEvent event;
+
+    for (;;) {
+        // Read before draining, so what was pushed before the stop is handled
+        bool stopping = atomic_load(&consumer->stopping);
+        bool handled = false;
+        while (popEvent(consumer->ring, &event)) {
+            consumer->handler(consumer->data, &event);
+            handled = true;
+        }
+
+        if (stopping) break;
+        if (!handled) nanosleep(&poll, NULL);
+    }
+
+    return NULL;
+}
+
+int startEventConsumer(EventConsumer *consumer, EventRing *ring, EventHandler handler, void *data) {
+    consumer->ring = ring;
+    consumer->handler = handler;
+    consumer->data = data;
+    atomic_init(&consumer->stopping, false);
+
+    if (pthread_create(&consumer->thread, NULL, consumeEvents, consumer) != 0) {
+        perror("failed to start an event consumer.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void stopEventConsumer(EventConsumer *consumer) {
+    atomic_store(&consumer->stopping, true);
+    pthread_join(consumer->thread, NULL);
+}
+
+void countEvent(void *stats, const GameEvent *event) {
+    EventStats *eventStats = (EventStats *)stats;
+    if (event->type < N_GAME_EVENT_TYPES) eventStats->counts[event->type]++;
+    eventStats->lastTick = event->tick;
+}
+
+const char *eventTypeName(GameEventType type) {
+    return typeNames[type];
+}
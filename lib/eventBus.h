@@ -0,0 +1,106 @@
+#ifndef _EVENT_BUS_H_
+#define _EVENT_BUS_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_EVENT_SUBSCRIBERS 4
+// Events a subscriber can fall behind by, a few seconds of a busy session
+#define EVENT_RING_CAPACITY 1024
+
+
+typedef enum GameEventType {
+    // value is the SoundSelect
+    EVENT_SOUND,
+    // value is the MusicSelect
+    EVENT_MUSIC,
+    // value is the EntityType killed, ship the player ship when one was
+    EVENT_KILL,
+    // value is the EntityType that fired, ship the player ship when one did
+    EVENT_SHOT,
+    // value is the EntityType of the powerup, ship the one that took it
+    EVENT_POWERUP,
+    // value is the GameState entered
+    EVENT_STATE,
+    N_GAME_EVENT_TYPES
+} GameEventType;
+
+typedef struct GameEvent {
+    // Tick of the session the event happened on
+    uint32_t tick;
+    uint8_t  type;
+    uint8_t  value;
+    // -1 when no player ship is involved
+    int8_t   ship;
+} GameEvent;
+
+// sequence tells whose turn the cell is, a producer's to fill it or the consumer's to read it
+typedef struct EventCell {
+    atomic_uint sequence;
+    GameEvent   event;
+} EventCell;
+
+/**
+ * Bounded lock-free queue of events with a single consumer and any number of producers, they
+ * claim cells with a compare and swap on tail. Neither side ever waits on the other: a push
+ * to a full ring drops the event and counts it, so a slow consumer only loses its own events.
+ */
+typedef struct EventRing {
+    EventCell   *cells;
+    uint32_t    mask;
+    // Apart so the producers and the consumer don't share a cache line
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) atomic_uint head;
+    atomic_uint dropped;
+} EventRing;
+
+// The capacity is rounded up to a power of two. Returns a negative value when it can't be allocated
+int createEventRing(EventRing *ring, uint32_t capacity);
+void destroyEventRing(EventRing *ring);
+// Returns false when the ring is full, the event is then counted as dropped
+bool pushEvent(EventRing *ring, const GameEvent *event);
+// Only from the consumer thread, returns false when the ring is empty
+bool popEvent(EventRing *ring, GameEvent *event);
+
+// A ring per subscriber, each gets every event published
+typedef struct EventBus {
+    EventRing rings[MAX_EVENT_SUBSCRIBERS];
+    int       nSubscribers;
+} EventBus;
+
+void initEventBus(EventBus *bus);
+void destroyEventBus(EventBus *bus);
+// Before anything is published. Returns the ring to read, NULL when the bus is full or out of memory
+EventRing *subscribeEvents(EventBus *bus, uint32_t capacity);
+// Never blocks, whatever the subscribers are doing
+void publishEvent(EventBus *bus, const GameEvent *event);
+
+typedef void (*EventHandler)(void *data, const GameEvent *event);
+
+// A thread handing the events of a ring to handler, as they come
+typedef struct EventConsumer {
+    EventRing    *ring;
+    EventHandler handler;
+    void         *data;
+    pthread_t    thread;
+    atomic_bool  stopping;
+} EventConsumer;
+
+// Returns a negative value when the thread can't be started
+int startEventConsumer(EventConsumer *consumer, EventRing *ring, EventHandler handler, void *data);
+// Handles what is left in the ring, then joins the thread
+void stopEventConsumer(EventConsumer *consumer);
+
+// Events seen by type, kept by a consumer thread and read once it's stopped
+typedef struct EventStats {
+    uint32_t counts[N_GAME_EVENT_TYPES];
+    uint32_t lastTick;
+} EventStats;
+
+// An EventHandler on EventStats
+void countEvent(void *stats, const GameEvent *event);
+const char *eventTypeName(GameEventType type);
+
+#endif
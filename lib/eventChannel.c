@@ -0,0 +1,140 @@
+#include "eventChannel.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+// Past that many ticks of drift between the clocks the receiver takes the new offset
+#define EVENT_RESYNC_TICKS 60
+
+
+void initEventSender(EventSender *sender, uint32_t resendTicks) {
+    memset(sender, 0, sizeof(EventSender));
+    sender->resendTicks = resendTicks;
+}
+
+bool queueEvent(EventSender *sender, const GameEvent *event) {
+    // The events of a tick are queued together, at the end
+    for (uint32_t seq = sender->next; seq != sender->oldest; --seq) {
+        const GameEvent *queued = &sender->pending[(seq - 1) % EVENT_WINDOW];
+        if (queued->tick != event->tick) break;
+        if (queued->type == event->type && queued->value == event->value && queued->ship == event->ship) {
+            sender->merged++;
+            return true;
+        }
+    }
+
+    if (sender->next - sender->oldest == EVENT_WINDOW) {
+        sender->dropped++;
+        return false;
+    }
+
+    sender->pending[sender->next % EVENT_WINDOW] = *event;
+    sender->next++;
+    return true;
+}
+
+void writeEventPacket(EventSender *sender, EventPacket *packet, uint32_t tick) {
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < sender->next - sender->oldest; ++i) {
+        if (sender->acked & (UINT64_C(1) << i)) continue;
+
+        uint32_t seq = sender->oldest + i;
+        bool resend = (int32_t)(seq - sender->sentUpTo) < 0;
+        if (resend && tick - sender->sentAt[seq % EVENT_WINDOW] < sender->resendTicks) continue;
+
+        const GameEvent *event = &sender->pending[seq % EVENT_WINDOW];
+        sender->sentAt[seq % EVENT_WINDOW] = tick;
+        packet->events[count++] = (WireEvent) {
+            .seq   = htonl(seq),
+            .tick  = htonl(event->tick),
+            .type  = event->type,
+            .value = event->value,
+            .ship  = event->ship,
+        };
+
+        if (resend) {
+            sender->resent++;
+        } else {
+            sender->sent++;
+        }
+    }
+
+    packet->tick = htonl(tick);
+    packet->count = htonl(count);
+    sender->sentUpTo = sender->next;
+}
+
+void readEventAck(EventSender *sender, const EventAck *ack) {
+    uint32_t next = ntohl(ack->next);
+    uint64_t received = (uint64_t)ntohl(ack->received[1]) << 32 | ntohl(ack->received[0]);
+
+    for (uint32_t i = 0; i < sender->next - sender->oldest; ++i) {
+        int32_t ahead = (int32_t)(sender->oldest + i - next);
+        if (ahead < 0 || (ahead < EVENT_WINDOW && (received & (UINT64_C(1) << ahead)))) {
+            sender->acked |= UINT64_C(1) << i;
+        }
+    }
+
+    while (sender->oldest != sender->next && (sender->acked & 1)) {
+        sender->acked >>= 1;
+        sender->oldest++;
+    }
+}
+
+void initEventReceiver(EventReceiver *receiver, uint32_t delay) {
+    memset(receiver, 0, sizeof(EventReceiver));
+    receiver->delay = delay;
+}
+
+void readEventPacket(EventReceiver *receiver, const EventPacket *packet, uint32_t localTick) {
+    uint32_t count = ntohl(packet->count);
+    if (count > EVENT_WINDOW) return;
+
+    // The latest packet is at most a comm tick old, so the events of its tick play delay ticks from now
+    uint32_t offset = localTick + receiver->delay - ntohl(packet->tick);
+    int32_t drift = (int32_t)(offset - receiver->offset);
+    if (!receiver->synced || drift > EVENT_RESYNC_TICKS || drift < -EVENT_RESYNC_TICKS) {
+        receiver->offset = offset;
+        receiver->synced = true;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const WireEvent *wire = &packet->events[i];
+        uint32_t seq = ntohl(wire->seq);
+        int32_t ahead = (int32_t)(seq - receiver->played);
+
+        // Further than the window it's left unacknowledged, the host sends it again
+        if (ahead >= EVENT_WINDOW) continue;
+        if (ahead < 0 || (receiver->have & (UINT64_C(1) << ahead))) {
+            receiver->duplicates++;
+            continue;
+        }
+
+        receiver->received[seq % EVENT_WINDOW] = (GameEvent) {
+            .tick  = ntohl(wire->tick),
+            .type  = wire->type,
+            .value = wire->value,
+            .ship  = wire->ship,
+        };
+        receiver->have |= UINT64_C(1) << ahead;
+    }
+}
+
+void writeEventAck(const EventReceiver *receiver, EventAck *ack) {
+    ack->next = htonl(receiver->played);
+    ack->received[0] = htonl((uint32_t)receiver->have);
+    ack->received[1] = htonl((uint32_t)(receiver->have >> 32));
+}
+
+bool takeDueEvent(EventReceiver *receiver, uint32_t localTick, GameEvent *event) {
+    if (!(receiver->have & 1)) return false;
+
+    const GameEvent *next = &receiver->received[receiver->played % EVENT_WINDOW];
+    if ((int32_t)(localTick - (next->tick + receiver->offset)) < 0) return false;
+
+    *event = *next;
+    receiver->have >>= 1;
+    receiver->played++;
+    return true;
+}
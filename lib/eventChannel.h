@@ -0,0 +1,97 @@
+#ifndef _EVENT_CHANNEL_H_
+#define _EVENT_CHANNEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "eventBus.h"
+
+// Events sent and not acknowledged yet, and events the receiver holds ahead of the one it plays next
+#define EVENT_WINDOW 64
+
+
+// In network byte order on the wire
+typedef struct WireEvent {
+    uint32_t seq;
+    uint32_t tick;
+    uint8_t  type;
+    uint8_t  value;
+    int8_t   ship;
+    uint8_t  unused;
+} WireEvent;
+
+// Rides in each snapshot: the events not sent yet and those unacknowledged for a round trip
+typedef struct EventPacket {
+    // Tick of the host when it was sent
+    uint32_t  tick;
+    uint32_t  count;
+    WireEvent events[EVENT_WINDOW];
+} EventPacket;
+
+// Rides in each datagram of commands: every seq below next was received, and the bits say which after it
+typedef struct EventAck {
+    uint32_t next;
+    uint32_t received[2];
+} EventAck;
+
+/**
+ * Host side of a reliable ordered channel over the snapshots. Events get consecutive sequence
+ * numbers and are sent again each resendTicks until the remote acknowledges them, the selective
+ * acks let those after a loss go while it's resent.
+ */
+typedef struct EventSender {
+    // By seq modulo the window
+    GameEvent pending[EVENT_WINDOW];
+    // Tick each pending event was last sent on
+    uint32_t  sentAt[EVENT_WINDOW];
+    // Bit i for oldest + i
+    uint64_t  acked;
+    // First seq not acknowledged
+    uint32_t  oldest;
+    // Seq of the next event queued
+    uint32_t  next;
+    // The seqs below were sent at least once
+    uint32_t  sentUpTo;
+    // Ticks an event goes unacknowledged before it's sent again, about a round trip
+    uint32_t  resendTicks;
+    uint32_t  sent;
+    uint32_t  resent;
+    // Queued while the window was full, the remote never gets them
+    uint32_t  dropped;
+    // Same effect on the same tick as one already queued
+    uint32_t  merged;
+} EventSender;
+
+/**
+ * Remote side: the events are played once each, in the order they were queued, delay ticks
+ * after the tick they happened on as seen from the clock of the host. Duplicates and events
+ * ahead of a missing one wait or are dropped without being played twice.
+ */
+typedef struct EventReceiver {
+    // By seq modulo the window
+    GameEvent received[EVENT_WINDOW];
+    // Bit i for played + i
+    uint64_t  have;
+    // Seq of the next event to play
+    uint32_t  played;
+    // Local tick an event plays on minus its tick, set by the first packet
+    uint32_t  offset;
+    uint32_t  delay;
+    bool      synced;
+    uint32_t  duplicates;
+} EventReceiver;
+
+void initEventSender(EventSender *sender, uint32_t resendTicks);
+// Returns false when the window is full, an effect already queued for the same tick is merged with it
+bool queueEvent(EventSender *sender, const GameEvent *event);
+void writeEventPacket(EventSender *sender, EventPacket *packet, uint32_t tick);
+void readEventAck(EventSender *sender, const EventAck *ack);
+
+void initEventReceiver(EventReceiver *receiver, uint32_t delay);
+// localTick is the tick of the receiver when the packet arrived
+void readEventPacket(EventReceiver *receiver, const EventPacket *packet, uint32_t localTick);
+void writeEventAck(const EventReceiver *receiver, EventAck *ack);
+// The next event in order once its tick came, false when there is none yet
+bool takeDueEvent(EventReceiver *receiver, uint32_t localTick, GameEvent *event);
+
+#endif
@@ -2,19 +2,33 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "alloc.h"
+#include "eventBus.h"
+#include "eventChannel.h"
 #include "gameData.h"
 #include "gameLogic.h"
+#include "jobs.h"
+#include "level.h"
+#include "music.h"
 #include "peer.h"
+#include "pipeline.h"
 #include "render.h"
+#include "replay.h"
 
 
-#define PROC_TICK_DURATION 0.016f
+#define FRAME_DURATION 0.016f
 #define COMM_TICK_DURATION 0.05f
 #define MAX_TIME_WITHOUT_COMM 10.0f
+// Ticks run at most in a frame, past that the simulation falls behind the clock instead of spiralling
+#define MAX_SUB_STEPS 16
+// Largest UDP payload, the snapshot goes in one datagram
+#define MAX_DATAGRAM_SIZE 65507
 
 
 double getTimeSecs() {
@@ -23,67 +37,66 @@ double getTimeSecs() {
     return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
 }
 
-void hostLoop(
-    Game *game,
-    SnapshotGameState *snap,
-    Peer *peer,
-    double *lastProcTick,
-    double *lastCommTick,
-    CommandsBufPlayer2 *commandsPlayer2
-) {
-    double now = getTimeSecs();
-    if (now - peer->lastComm > MAX_TIME_WITHOUT_COMM) {
-        game->hotData->gameState = CLOSE;
-        return;
-    }
+// The sounds of the ticks are played from the bus on a thread of their own, the game plays them itself when it fails
+int startAudioEvents(Game *game, EventBus *bus, EventConsumer *audio) {
+    EventRing *ring = subscribeEvents(bus, EVENT_RING_CAPACITY);
+    if (ring == NULL || startEventConsumer(audio, ring, playEventSound, game) < 0) return -1;
 
-    if (now - *lastProcTick >= PROC_TICK_DURATION) {
-        processInput(&game->hotData->input);
-        updateGame(game, commandsPlayer2, PROC_TICK_DURATION);
-        BeginDrawing();
-            drawGame(game);
-        EndDrawing();
+    game->events = bus;
+    return 0;
+}
 
-        *lastProcTick = now;
-    }
+// Before the sounds are unloaded, what is queued is played first
+void stopAudioEvents(Game *game, EventConsumer *audio) {
+    game->events = NULL;
+    stopEventConsumer(audio);
+}
 
-    if (now - *lastCommTick >= COMM_TICK_DURATION) {
-        if (game->hotData->gameState == PLAYING) {
-            int recvResult = recvData(
-                peer,
-                (char *)commandsPlayer2->input,
-                sizeof(Input) * commandsPlayer2->capacity
-            );
+// The render stage of the host, on the thread of the window: samples the input and draws the latest tick
+StageTiming hostLoop(Game *game, const SnapshotView *view, HostPipeline *pipeline) {
+    StageTiming frames = {0};
+    double lastFrame = monotonicSecs() - FRAME_DURATION;
 
-            if (recvResult == 0) {
-                peer->lastComm = now;
-            } else if (recvResult == -2) {
-                perror("error receiving commands from player 2.\n");
-                game->hotData->gameState = CLOSE;
-                return;
-            }
+    for (;;) {
+        double now = monotonicSecs();
+        if (now - lastFrame < FRAME_DURATION) {
+            sleepSecs(FRAME_DURATION - (now - lastFrame));
+            continue;
         }
+        lastFrame = now;
 
-        buildSnapshot(game, snap);
-        int sendResult = sendData(peer, (char *)snap, sizeof(SnapshotGameState));
-        if (sendResult == -2) {
-            perror("error sending snapshot.\n");
-            game->hotData->gameState = CLOSE;
-            return;
-        }
+        Input input;
+        processInput(&input);
+        pushPlayerInput(pipeline, input);
 
-        // NOTE: I want to update that only if the communication was a success?
-        *lastCommTick = now;
+        bool fresh;
+        SnapshotGameState *snap = latestSnapshot(pipeline, &fresh);
+        if (snap != NULL && ntohl(snap->gameState) == CLOSE) break;
+
+        BeginDrawing();
+            if (snap != NULL) {
+                drawSnapshot(game, view, snap);
+            } else {
+                ClearBackground(BLACK);
+            }
+            DrawFPS(10, 10);
+        EndDrawing();
+        addStageTime(&frames, monotonicSecs() - now);
     }
+
+    return frames;
 }
 
 void remoteLoop(
     Game *game,
+    const SnapshotView *view,
     SnapshotGameState *snap,
     Peer *peer,
+    double *lastFrame,
     double *lastProcTick,
     double *lastCommTick,
-    CommandsBufPlayer2 *commandsBuf
+    CommandsBufPlayer2 *commandsBuf,
+    EventReceiver *receiver
 ) {
     double now = getTimeSecs();
     if (now - peer->lastComm > MAX_TIME_WITHOUT_COMM) {
@@ -91,34 +104,47 @@ void remoteLoop(
         return;
     }
 
-    if (now - *lastProcTick >= PROC_TICK_DURATION) {
-        int currentCommand = commandsBuf->size;
-        processInput(&commandsBuf->input[currentCommand]);
+    if (now - *lastFrame >= FRAME_DURATION) {
+        // A command per tick of the host, the last one is overwritten when the commands are late
+        int steps = 0;
+        for (; now - *lastProcTick >= game->tickDuration && steps < MAX_SUB_STEPS; ++steps) {
+            Input *command = &commandsBuf->input[commandsBuf->size];
+            processInput(command);
+            if (steps > 0) *command &= HELD_INPUTS;
+            if (commandsBuf->size < commandsBuf->capacity - 1) commandsBuf->size++;
+            *lastProcTick += game->tickDuration;
+            game->tick++;
+        }
+        if (steps == MAX_SUB_STEPS) *lastProcTick = now;
+
         processMusic(game, snap);
-        processSoundFX(game, snap);
+        GameEvent event;
+        while (takeDueEvent(receiver, game->tick, &event)) {
+            playEventSound(game, &event);
+        }
         BeginDrawing();
-            drawSnapshot(game, snap);
+            drawSnapshot(game, view, snap);
         EndDrawing();
 
-        *lastProcTick = now;
+        *lastFrame = now;
     }
 
     if (now - *lastCommTick >= COMM_TICK_DURATION) {
-        if (game->hotData->gameState == PLAYING) {
-            int sendResult = sendData(
-                peer, (char *)commandsBuf->input, sizeof(Input) * commandsBuf->capacity
-            );
-
-            if (sendResult == -2) {
-                perror("error sending commands.\n");
-                game->hotData->gameState = CLOSE;
-                return;
-            }
+        // Sent in every state, the host needs the acks of the menu sounds too
+        if (game->hotData->gameState != PLAYING) memset(commandsBuf->input, 0, sizeof(Input) * commandsBuf->capacity);
+        writeEventAck(receiver, commandsBuf->ack);
+        int sendResult = sendData(peer, (char *)commandsBuf->datagram, commandsDatagramSize(commandsBuf));
+        if (sendResult == -2) {
+            perror("error sending commands.\n");
+            game->hotData->gameState = CLOSE;
+            return;
         }
+        memset(commandsBuf->input, 0, sizeof(Input) * commandsBuf->capacity);
 
-        int recvResult = recvData(peer, (char *)snap, sizeof(SnapshotGameState));
+        int recvResult = recvData(peer, (char *)snap, snapshotSize(&game->snapshotLayout));
         if (recvResult == 0) {
             peer->lastComm = now;
+            readEventPacket(receiver, &snap->events, game->tick);
             game->hotData->menuButton = ntohl(snap->menuButton);
             game->hotData->gameState = ntohl(snap->gameState);
         } else if (recvResult == -2) {
@@ -132,12 +158,53 @@ void remoteLoop(
     }
 }
 
-int mainLoop(const char *player) {
+int mainLoop(
+    const char *player,
+    const char *replayPath,
+    const char *levelPath,
+    float tickDuration,
+    GameConfig config,
+    int nThreads
+) {
     Game game;
+    Level level = {0};
+    EventBus events;
+    EventConsumer audio;
+    bool audioEvents = false;
+    MusicStreamer music;
+    bool musicStreamer = false;
+    EventRing *replication = NULL;
+    EventSender sender;
+    EventReceiver receiver;
+    JobSystem jobs;
+    JobSystem *activeJobs = NULL;
     Peer selfPeer;
-    SnapshotGameState snap = {0};
+    ReplayWriter recorder;
+    ReplayWriter *activeRecorder = NULL;
+    SnapshotGameState *snap;
+    SnapshotView view;
     double lastCommTick;
     double lastProcTick;
+    double lastFrame;
+
+    // The waves of the level share its grid
+    if (levelPath != NULL) {
+        if (openLevel(&level, levelPath) < 0) return -1;
+        config.hordeRows = level.header->hordeRows;
+        config.hordeColumns = level.header->hordeColumns;
+    }
+
+    if (checkGameConfig(&config) < 0) {
+        closeLevel(&level);
+        return -1;
+    }
+
+    SnapshotLayout layout = buildSnapshotLayout(&config);
+    if (snapshotSize(&layout) > MAX_DATAGRAM_SIZE) {
+        fprintf(stderr, "%u entities don't fit in a snapshot datagram.\n", layout.nEntities);
+        closeLevel(&level);
+        return -1;
+    }
 
     int peerInitResult;
     // Initialize network
@@ -149,50 +216,197 @@ int mainLoop(const char *player) {
 
     if (peerInitResult < 0) {
         perror("failed to initialize network.\n");
+        closeLevel(&level);
         return -1;
     }
 
     SetConfigFlags(FLAG_MSAA_4X_HINT);
     InitWindow(1920.0f, 1080.0f, "Space Invaders Clone");
     InitAudioDevice();
-    initGame(&game);
+    if (initGame(&game, false, config) < 0) {
+        close(selfPeer.sockFD);
+        closeLevel(&level);
+        CloseAudioDevice();
+        CloseWindow();
+        return -1;
+    }
+    setTickDuration(&game, tickDuration);
+    if (levelPath != NULL) setLevel(&game, &level);
+    snap = createSnapshot(&game.snapshotLayout);
+    initSnapshotView(&view, &game);
     SetExitKey(KEY_NULL);
+    if (startMusicStreamer(&music, game.sounds) == 0) {
+        musicStreamer = true;
+        game.music = &music;
+    }
 
-    CommandsBufPlayer2 *commandsPlayer2 = initCommandsBuf((int)(COMM_TICK_DURATION/PROC_TICK_DURATION));
-    lastCommTick = lastProcTick = selfPeer.lastComm = getTimeSecs();
+    // Only the host simulates and builds snapshots
+    if (nThreads > 1 && strcmp(player, "host") == 0 && createJobSystem(&jobs, nThreads) == 0) {
+        activeJobs = &jobs;
+        game.jobs = activeJobs;
+    }
+    initEventBus(&events);
+    if (strcmp(player, "host") == 0) {
+        replication = subscribeEvents(&events, EVENT_RING_CAPACITY);
+        audioEvents = startAudioEvents(&game, &events, &audio) == 0;
+    }
+
+    // The remote samples a command per tick, so both peers must run the same tick rate
+    int commandsPerComm = (int)(COMM_TICK_DURATION / tickDuration);
+    CommandsBufPlayer2 *commandsPlayer2 = initCommandsBuf(commandsPerComm > 1 ? commandsPerComm : 1);
+
+    // Only the host simulates, so only the host can record
+    if (replayPath != NULL && strcmp(player, "host") == 0) {
+        if (openReplayWriter(
+            &recorder, replayPath, &game, commandsPlayer2->capacity, tickDuration, (uint32_t)time(NULL)
+        ) == 0) {
+            activeRecorder = &recorder;
+        }
+    }
+
+    // The events play a comm tick behind the host, the time the next snapshot may take
+    initEventSender(&sender, 2 * (uint32_t)(COMM_TICK_DURATION / tickDuration + 0.5f));
+    initEventReceiver(&receiver, (uint32_t)(COMM_TICK_DURATION / tickDuration) + 1);
+    lastCommTick = lastProcTick = lastFrame = selfPeer.lastComm = getTimeSecs();
 
     // Initialize game loop
     if (strcmp(player, "host") == 0) {
-        while (game.hotData->gameState != CLOSE) {
-            hostLoop(
-                &game,
-                &snap,
-                &selfPeer,
-                &lastProcTick,
-                &lastCommTick,
-                commandsPlayer2
-            );
+        HostPipeline pipeline;
+        if (startHostPipeline(
+            &pipeline, &game, &selfPeer, commandsPlayer2, activeRecorder, replication, &sender,
+            COMM_TICK_DURATION, MAX_TIME_WITHOUT_COMM
+        ) == 0) {
+            StageTiming frames = hostLoop(&game, &view, &pipeline);
+            stopHostPipeline(&pipeline);
+
+            printf("host pipeline:\n");
+            printStageTiming(stdout, "tick late", &pipeline.jitter);
+            printStageTiming(stdout, "tick", &pipeline.tick);
+            printStageTiming(stdout, "exchange", &pipeline.exchange);
+            printStageTiming(stdout, "frame", &frames);
         }
     } else if (strcmp(player, "remote") == 0) {
         while (game.hotData->gameState != CLOSE) {
             remoteLoop(
                 &game,
-                &snap,
+                &view,
+                snap,
                 &selfPeer,
+                &lastFrame,
                 &lastProcTick,
                 &lastCommTick,
-                commandsPlayer2
+                commandsPlayer2,
+                &receiver
             );
-
-            commandsPlayer2->size++;
-            commandsPlayer2->size %= commandsPlayer2->capacity;
         }
     }
     
+    if (activeRecorder != NULL) closeReplayWriter(activeRecorder);
+    if (audioEvents) stopAudioEvents(&game, &audio);
+    if (musicStreamer) {
+        stopMusicStreamer(&music);
+        printMusicStats(stdout, &music);
+    }
+    destroyEventBus(&events);
     close(selfPeer.sockFD);
     cleanupCommandsBuf(&commandsPlayer2);
+    gameFree(snap);
     cleanupGame(&game);
+    if (activeJobs != NULL) destroyJobSystem(activeJobs);
+    closeLevel(&level);
     CloseAudioDevice();
     CloseWindow();
     return 0;
 }
+
+int replayLoop(const char *replayPath, uint32_t startTick, const char *levelPath) {
+    Game game;
+    ReplayReader reader;
+    Level level = {0};
+    EventBus events;
+    EventConsumer audio;
+    MusicStreamer music;
+
+    if (openReplayReader(&reader, replayPath) < 0) {
+        return -1;
+    }
+
+    if (levelPath != NULL && openLevel(&level, levelPath) < 0) {
+        closeReplayReader(&reader);
+        return -1;
+    }
+
+    // The waves index the arrays of the session the replay sizes, only its own level fits them
+    if (levelPath != NULL && (
+        level.header->hordeRows != reader.header->hordeRows ||
+        level.header->hordeColumns != reader.header->hordeColumns ||
+        level.header->checksum != reader.header->levelChecksum
+    )) {
+        fprintf(stderr, "the replay wasn't recorded with this level.\n");
+        closeLevel(&level);
+        closeReplayReader(&reader);
+        return -1;
+    }
+
+    // The replay brings the sizes of the session it recorded
+    GameConfig config = {
+        .hordeRows    = reader.header->hordeRows,
+        .hordeColumns = reader.header->hordeColumns,
+        .nBullets     = reader.header->nBullets,
+        .nPowerups    = reader.header->nPowerups,
+    };
+    if (checkGameConfig(&config) < 0) {
+        closeLevel(&level);
+        closeReplayReader(&reader);
+        return -1;
+    }
+
+    SetConfigFlags(FLAG_MSAA_4X_HINT);
+    InitWindow(1920.0f, 1080.0f, "Space Invaders Clone - Replay");
+    InitAudioDevice();
+    if (initGame(&game, false, config) < 0) {
+        closeLevel(&level);
+        closeReplayReader(&reader);
+        CloseAudioDevice();
+        CloseWindow();
+        return -1;
+    }
+    if (levelPath != NULL) setLevel(&game, &level);
+    SetExitKey(KEY_NULL);
+
+    CommandsBufPlayer2 *commands = initCommandsBuf(reader.header->commandsPerTick);
+    int result = replaySeek(&reader, &game, commands, startTick);
+    initEventBus(&events);
+    bool audioEvents = startAudioEvents(&game, &events, &audio) == 0;
+    // Started after the seek, with the streams playing at its tick
+    bool musicStreamer = startMusicStreamer(&music, game.sounds) == 0;
+    if (musicStreamer) {
+        game.music = &music;
+        if (game.musicEvents & 1) queueMusic(&music, PLAY_BACKGROUND_MUSIC);
+        if (game.musicEvents & (1 << 1)) queueMusic(&music, PLAY_ENEMY_SHIP_MUSIC);
+    }
+
+    double lastProcTick = getTimeSecs();
+    while (result == 0 && !WindowShouldClose()) {
+        double now = getTimeSecs();
+        if (now - lastProcTick >= reader.header->tickDuration) {
+            result = replayStep(&reader, &game, commands);
+            BeginDrawing();
+                drawGame(&game);
+            EndDrawing();
+
+            lastProcTick = now;
+        }
+    }
+
+    if (audioEvents) stopAudioEvents(&game, &audio);
+    if (musicStreamer) stopMusicStreamer(&music);
+    destroyEventBus(&events);
+    cleanupCommandsBuf(&commands);
+    cleanupGame(&game);
+    closeLevel(&level);
+    closeReplayReader(&reader);
+    CloseAudioDevice();
+    CloseWindow();
+    return result < 0 ? result : 0;
+}
@@ -1,7 +1,26 @@
 #ifndef _GAME_H_
 #define _GAME_H_
 
+#include <stdint.h>
 
-int mainLoop(const char *argc);
+#include "gameData.h"
+
+
+double getTimeSecs();
+/**
+ * The host records the session into replayPath when it isn't NULL.
+ * tickDuration, config and the level must match between the peers, a level replaces the grid of config.
+ * With nThreads above 1 the host splits the large stages of its ticks across that many threads.
+ */
+int mainLoop(
+    const char *player,
+    const char *replayPath,
+    const char *levelPath,
+    float tickDuration,
+    GameConfig config,
+    int nThreads
+);
+// levelPath is the level the replay was recorded with, or NULL
+int replayLoop(const char *replayPath, uint32_t startTick, const char *levelPath);
 
 #endif
@@ -1,70 +1,89 @@
 #include "gameData.h"
 
+#include <errno.h>
 #include <raylib.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "aabb.h"
+#include "alloc.h"
+#include "arena.h"
+#include "broadphase.h"
 #include "entity.h"
+#include "jobs.h"
+#include "level.h"
+#include "music.h"
+#include "rng.h"
+#include "spriteBatch.h"
 
 
-ColdGameData *initColdGameData() {
-    const float shipSpeeds[]       = {300.0f, 450.0f};
-    const float shipDelaysToFire[] = {0.5f, 0.1f};
-    const float screenLimits[]     = {250.0f, 1670.0f};
+#define DEFAULT_SEED 0x5eed
+// Slots per job of a snapshot built in parallel, below twice as many it's built on the calling thread
+#define SNAPSHOT_JOB_GRAIN 1024
+
+
+static void resetColdGameData(ColdGameData *gameData) {
+    const Scalar shipSpeeds[]       = {SC(300.0f), SC(450.0f)};
+    const Scalar shipDelaysToFire[] = {SC(0.5f), SC(0.1f)};
+    const Scalar screenLimits[]     = {SC(250.0f), SC(1670.0f)};
 
-    ColdGameData *
-    gameData = (ColdGameData *)malloc(sizeof(ColdGameData));
     *gameData = (ColdGameData) {
-        .enemyShipDelayToFire = 0.25f,
-        .projectileSpeed      = 600.0f,
-        .powerupDuration      = 2.0f,
-        .hordeSpeedIncrease   = 25.0f,
-        .hordeStepY           = 100.0f,
-        .enemyShipSleepTime   = 4.0f,
-        .alienTimePerFrame    = 0.1f,
+        .enemyShipDelayToFire = SC(0.25f),
+        .projectileSpeed      = SC(600.0f),
+        .powerupDuration      = SC(2.0f),
+        .hordeSpeedIncrease   = SC(25.0f),
+        .hordeStepY           = SC(100.0f),
+        .enemyShipSleepTime   = SC(4.0f),
+        .alienTimePerFrame    = SC(0.1f),
+        .alienFireChance      = 1.0f / 3000.0f,
+        .powerupDropChance    = 0.15f,
     };
 
     memcpy(
         &gameData->shipSpeeds,
         shipSpeeds,
-        2*sizeof(float)
+        2*sizeof(Scalar)
     );
 
     memcpy(
         &gameData->shipDelaysToFire,
         shipDelaysToFire,
-        2*sizeof(float)
+        2*sizeof(Scalar)
     );
 
-    memcpy(&gameData->screenLimits, screenLimits, 2*sizeof(float));
+    memcpy(&gameData->screenLimits, screenLimits, 2*sizeof(Scalar));
+}
+
+ColdGameData *initColdGameData(Arena *arena) {
+    ColdGameData *
+    gameData = (ColdGameData *)arenaAlloc(arena, sizeof(ColdGameData));
+    resetColdGameData(gameData);
 
     return gameData;
 }
 
-HotGameData *initHotGameData() {
-    HotGameData *
-    gameData = (HotGameData *)malloc(sizeof(HotGameData));
+static void resetHotGameData(HotGameData *gameData) {
     *gameData = (HotGameData){
-        .hordeSpeed                   = 100.0f,
-        .enemyShipSpeed               = -450.0f,
-        .gameState                    = MENU,
-        .menuButton                   = START,
-        .shipsTimers = {
-            .remainingTimeFastMove = {0.0f, 0.0f},
-            .remainingTimeFastShot = {0.0f, 0.0f},
-            .remainingTimeToFire   = {0.0f, 0.0f}
-        },
-        .enemyShipTimers = {
-            .remainingTimeAlarm  = 4.0f,
-            .remainingTimeToFire = 0.0f
-        }
+        .hordeSpeed     = SC(100.0f),
+        .enemyShipSpeed = SC(-450.0f),
+        .gameState      = MENU,
+        .menuButton     = START,
     };
+}
+
+HotGameData *initHotGameData(Arena *arena) {
+    HotGameData *
+    gameData = (HotGameData *)arenaAlloc(arena, sizeof(HotGameData));
+    resetHotGameData(gameData);
 
     return gameData;
 }
 
-Sounds *initSounds() {
-    Sounds *sounds = (Sounds *)malloc(sizeof(Sounds));
+Sounds *initSounds(Arena *arena) {
+    Sounds *sounds = (Sounds *)arenaAlloc(arena, sizeof(Sounds));
+    // The music thread estimates how full the streams are from their size
+    SetAudioStreamBufferSizeDefault(MUSIC_BUFFER_FRAMES);
     *sounds = (Sounds){
         .background     = LoadMusicStream("assets/sounds/background.ogg"),
         .enemyShip      = LoadMusicStream("assets/sounds/enemyShip.ogg"),
@@ -92,12 +111,11 @@ void cleanupSounds(Sounds **sounds) {
     UnloadSound((*sounds)->lose);
     UnloadSound((*sounds)->victory);
     UnloadSound((*sounds)->menu);
-    free(*sounds);
     *sounds = NULL;
 }
 
-Textures *initTextures() {
-    Textures *tex = (Textures *)malloc(sizeof(Textures));
+Textures *initTextures(Arena *arena) {
+    Textures *tex = (Textures *)arenaAlloc(arena, sizeof(Textures));
     *tex = (Textures) {
         .ship        = LoadTexture("assets/textures/ship.png"),
         .enemyShip   = LoadTexture("assets/textures/enemyShip.png"),
@@ -121,178 +139,666 @@ void cleanupTextures(Textures **textures) {
     UnloadTexture((*textures)->bullet);
     UnloadTexture((*textures)->shotPowerup);
     UnloadTexture((*textures)->movePowerup);
-
-    free(*textures);
     *textures = NULL;
 }
 
-Animation *initAnimation() {
-    Animation *animation = (Animation *)malloc(sizeof(Animation));
+static void resetAnimation(Animation *animation) {
     *animation = (Animation) {
         .aliensFrame    = {.height = 16.0f, .width = 16.0f, .x = 0.0f, .y = 0.0f},
         .shipFrame      = {.height = 12.0f, .width = 16.0f, .x = 0.0f, .y = 0.0f},
         .bulletFrame    = {.height = 8.0f, .width = 4.0f, .x = 0.0f, .y =0.0f},
         .enemyShipFrame = {.height = 10.0f, .width = 16.0f, .x = 0.0f, .y = 0.0f},
         .powerupFrame   = {.height = 18.0f, .width = 18.0f, .x = 0.0f, .y = 0.0f},
-        .timeRemainingToChangeFrame = 0.1f,
-        .alienCurrentFrame          = 0,
+        .alienCurrentFrame = 0,
     };
+}
+
+Animation *initAnimation(Arena *arena) {
+    Animation *animation = (Animation *)arenaAlloc(arena, sizeof(Animation));
+    resetAnimation(animation);
 
     return animation;
 }
 
-void cleanupAnimation(Animation **animation) {
-    free(*animation);
-    *animation = NULL;
+int checkGameConfig(const GameConfig *config) {
+    // The slot of an alien is its cell, and a pool holds up to 65535 entities
+    if (config->hordeRows == 0 || config->hordeColumns == 0 || config->hordeRows * config->hordeColumns > 0xffff) {
+        fprintf(stderr, "the horde must have between 1 and 65535 aliens.\n");
+        return -1;
+    }
+
+    if (config->nBullets == 0 || config->nPowerups == 0) {
+        fprintf(stderr, "the game needs room for bullets and powerups.\n");
+        return -2;
+    }
+
+    return 0;
+}
+
+int parseCount(const char *text, long max, long *count) {
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < 1 || value > max) {
+        fprintf(stderr, "%s isn't a whole number from 1 to %ld.\n", text, max);
+        return -1;
+    }
+
+    *count = value;
+    return 0;
+}
+
+int parseHordeSize(const char *text, GameConfig *config) {
+    char *end;
+    errno = 0;
+    long rows = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != 'x') {
+        fprintf(stderr, "the horde is given as <rows>x<columns>.\n");
+        return -1;
+    }
+
+    long columns;
+    if (parseCount(end + 1, 0xffff, &columns) < 0) return -1;
+    // Checked whole, before they're narrowed
+    if (rows < 1 || rows > 0xffff || rows * columns > 0xffff) {
+        fprintf(stderr, "the horde must have between 1 and 65535 aliens.\n");
+        return -1;
+    }
+
+    config->hordeRows = (uint16_t)rows;
+    config->hordeColumns = (uint16_t)columns;
+    return 0;
 }
 
-void initGame(Game *game) {
-    uint16_t nPowerups = 20;
-    uint16_t nBullets  = 40;
+uint32_t gameSpriteCapacity(const GameConfig *config) {
+    return 3 + config->hordeRows * config->hordeColumns + 2 * config->nBullets + config->nPowerups;
+}
+
+size_t gameArenaSize(const GameConfig *config, bool headless) {
+    const uint16_t capacities[N_PROXY_POOLS] = {config->nBullets, config->nBullets, config->nPowerups};
+    size_t size = arenaBytes(sizeof(HotGameData))
+        + arenaBytes(sizeof(Animation))
+        + arenaBytes(2 * sizeof(Entity))
+        + entityPoolBytes(config->hordeRows * config->hordeColumns)
+        + formationBytes(config->hordeRows, config->hordeColumns)
+        + 2 * entityPoolBytes(config->nBullets)
+        + entityPoolBytes(config->nPowerups)
+        + broadPhaseBytes(capacities)
+        + arenaBytes(config->nBullets * sizeof(uint16_t))
+        + arenaBytes(sizeof(ColdGameData));
+
+    if (!headless) {
+        size += arenaBytes(sizeof(Sounds)) + arenaBytes(sizeof(Textures)) + spriteBatchBytes(gameSpriteCapacity(config));
+    }
+    return size;
+}
+
+// Carves everything but the hot data, given, from arena
+static void placeGame(Game *game, bool headless, GameConfig config, Arena *arena, HotGameData *hotData) {
     *game = (Game) {
-        .ships          = createPlayerShips(),
+        .hotData        = hotData,
         .enemyShip      = createEnemyShip(),
-        .horde          = createHorde(),
-        .bullets        = createBulletsArray(nBullets),
-        .powerups       = createPowerupsArray(nPowerups),
-        .coldData       = initColdGameData(),
-        .hotData        = initHotGameData(),
-        .sounds         = initSounds(),
-        .textures       = initTextures(),
-        .animation      = initAnimation(),
-        .nBullets       = nBullets,
-        .nPowerups      = nPowerups,
         // plus 1 from the enemy ship
-        .enemiesAlive   = nRowsAliens*nColsAliens + 1,
-        .hordeLastAlive = nRowsAliens*nColsAliens - 1,
+        .enemiesAlive   = config.hordeRows*config.hordeColumns + 1,
+        .config         = config,
+        .snapshotLayout = buildSnapshotLayout(&config),
         .screenHeight   = 1080.0f,
         .screenWidth    = 1920.0f,
-        .soundEventsBuf = initSoundEventsBuf(CAP_SOUND_EVENT_BUF),
         .musicEvents    = 0,
+        .muted          = headless,
+        .arena          = game->arena,
     };
 
-    game->sounds->background.looping = true;
-    game->sounds->enemyShip.looping = true;
+    // In about the order a tick goes through it
+    game->animation      = initAnimation(arena);
+    game->ships          = createPlayerShips(arena);
+    game->horde          = createHorde(arena, config.hordeRows, config.hordeColumns);
+    game->formation      = createFormation(arena, &game->horde, config.hordeRows, config.hordeColumns);
+    game->bulletsUp      = createBulletsPool(arena, config.nBullets);
+    game->bulletsDown    = createBulletsPool(arena, config.nBullets);
+    game->powerups       = createPowerupsPool(arena, config.nPowerups);
+    initBroadPhase(game, arena);
+    game->alienHits      = (uint16_t *)arenaAlloc(arena, config.nBullets * sizeof(uint16_t));
+    game->coldData       = initColdGameData(arena);
+    game->sounds         = headless ? NULL : initSounds(arena);
+    game->textures       = headless ? NULL : initTextures(arena);
+    game->sprites        = headless ? NULL : createSpriteBatch(arena, gameSpriteCapacity(&config));
+    setTickDuration(game, DEFAULT_TICK_DURATION);
+
+    if (!headless) {
+        game->sounds->background.looping = true;
+        game->sounds->enemyShip.looping = true;
+    }
+
+    seedGame(game, DEFAULT_SEED);
+}
+
+int initGame(Game *game, bool headless, GameConfig config) {
+    if (createArena(&game->arena, ALLOC_GAME, gameArenaSize(&config, headless)) < 0) {
+        *game = (Game) {0};
+        return -1;
+    }
+
+    // Hot first
+    placeGame(game, headless, config, &game->arena, initHotGameData(&game->arena));
+    return 0;
+}
+
+void initHeadlessGameIn(Game *game, GameConfig config, Arena *arena, HotGameData *hotData) {
+    game->arena = (Arena) {0};
+    placeGame(game, true, config, arena, hotData);
+}
+
+void seedGame(Game *game, uint64_t seed) {
+    seedRng(&game->hotData->rng, seed, 0);
+    game->hotData->alienFireSkip = rngGeometric(&game->hotData->rng, game->coldData->alienFireRate);
+}
+
+void setTickDuration(Game *game, float tickDuration) {
+    ColdGameData *coldData = game->coldData;
+    game->tickDuration = tickDuration;
+
+    // In Q32.32 seconds, exact from the floats, so the results don't depend on the float math of the build
+    uint64_t tick = tickDuration > 0 ? (uint64_t)((double)tickDuration * (double)RNG_FIXED_ONE) : 0;
+    uint64_t defaultTick = (uint64_t)((double)DEFAULT_TICK_DURATION * (double)RNG_FIXED_ONE);
+    coldData->tickDurationFixed = tick > 0 ? tick : 1;
+
+    // Not firing in a tick is not firing in each of its fractions of the default tick
+    uint32_t ticks = (uint32_t)((coldData->tickDurationFixed << 16) / defaultTick);
+    coldData->alienFireRate = geometricRate(chanceToFixed(coldData->alienFireChance), ticks);
+    coldData->powerupDropPercent = (uint32_t)((chanceToFixed(coldData->powerupDropChance) * 100 + RNG_FIXED_ONE / 2) >> 32);
 }
 
 void cleanupGame(Game *game) {
-    cleanupSounds(&game->sounds);
-    cleanupTextures(&game->textures);
-    cleanupAnimation(&game->animation);
-    cleanupSoundEventsBuf(&game->soundEventsBuf);
-    destroyPlayerShips(&game->ships);
-    destroyHorde(&game->horde);
-    destroyBullets(&game->bullets);
-    destroyPowerups(&game->powerups);
-
-    free(game->hotData);
-    free(game->coldData);
-    free(game->ships);
+    if (game->sounds != NULL) cleanupSounds(&game->sounds);
+    if (game->textures != NULL) cleanupTextures(&game->textures);
+    destroyArena(&game->arena);
+
     game->hotData = NULL;
     game->coldData = NULL;
 }
 
 void rebootGame(Game *game) {
-    cleanupGame(game);
-    initGame(game);
-    game->hotData->gameState = PLAYING;
+    const GameConfig *config = &game->config;
+    HotGameData *hotData = game->hotData;
+    // The new round keeps drawing from the same stream
+    Rng rng = hotData->rng;
+    uint32_t alienFireSkip = hotData->alienFireSkip;
+
+    resetHotGameData(hotData);
+    resetColdGameData(game->coldData);
+    resetAnimation(game->animation);
+    setTickDuration(game, game->tickDuration);
+
+    resetPlayerShips(game->ships);
+    game->enemyShip = createEnemyShip();
+    resetHorde(&game->horde, config->hordeRows, config->hordeColumns);
+    resetFormation(&game->formation, &game->horde);
+    game->enemiesAlive = config->hordeRows*config->hordeColumns + 1;
+    resetEntityPool(&game->bulletsUp);
+    resetEntityPool(&game->bulletsDown);
+    resetEntityPool(&game->powerups);
+    resetBroadPhase(game);
+    game->musicEvents = 0;
+    if (game->level != NULL) setLevel(game, game->level);
+
+    hotData->rng = rng;
+    hotData->alienFireSkip = alienFireSkip;
+    hotData->gameState = PLAYING;
 }
 
-void buildSnapshot(Game *game, SnapshotGameState *snap) {
-    snap->gameState = htonl(game->hotData->gameState);
-    snap->menuButton = htonl(game->hotData->menuButton);
-    snap->musicEvents = game->musicEvents;
+SnapshotLayout buildSnapshotLayout(const GameConfig *config) {
+    SnapshotLayout layout = {0};
+    uint32_t j = 0;
 
-    memcpy(
-        &snap->soundEvents,
-        game->soundEventsBuf->soundEvents,
-        CAP_SOUND_EVENT_BUF * sizeof(SoundEvents)
-    );
+    // A range per band of rows with the same type of alien
+    for (int row = 0; row < config->hordeRows; ++row) {
+        EntityType type = hordeRowType(row, config->hordeRows);
+        if (layout.nRanges == 0 || layout.ranges[layout.nRanges - 1].type != type) {
+            layout.ranges[layout.nRanges++] = (SnapshotRange) {.type = type, .first = j};
+        }
+        layout.ranges[layout.nRanges - 1].count += config->hordeColumns;
+        j += config->hordeColumns;
+    }
+
+    const uint16_t nFastMoves = config->nPowerups / 2;
+    const SnapshotRange sections[] = {
+        {.type = ENEMY_SHIP, .count = 1},
+        {.type = SHIP,       .count = 2},
+        {.type = FAST_MOVE,  .count = nFastMoves},
+        {.type = FAST_SHOT,  .count = config->nPowerups - nFastMoves},
+        {.type = BULLET,     .count = config->nBullets},
+    };
+    uint32_t *firsts[] = {&layout.enemyShip, &layout.ships, &layout.fastMoves, &layout.fastShots, &layout.bullets};
+
+    for (int i = 0; i < 5; ++i) {
+        *firsts[i] = j;
+        layout.ranges[layout.nRanges] = sections[i];
+        layout.ranges[layout.nRanges++].first = j;
+        j += sections[i].count;
+    }
+
+    layout.nEntities = j;
+    return layout;
+}
 
-    memset(&snap->entities, 0, N_ENTITIES * sizeof(EntityBounds));
-    int j = 0;
-    for (int i = 0; i < 55; ++i) {
-        if (game->horde[i].state == ACTIVE) {
-            snap->entities[j++] = (EntityBounds) {
-                .x = htons((uint16_t)game->horde[i].bounds.x),
-                .y = htons((uint16_t)game->horde[i].bounds.y)
-            };
-        } else j++;
+size_t snapshotSize(const SnapshotLayout *layout) {
+    return sizeof(SnapshotGameState) + layout->nEntities * sizeof(EntityBounds);
+}
+
+SnapshotGameState *createSnapshot(const SnapshotLayout *layout) {
+    return (SnapshotGameState *)gameCalloc(ALLOC_SNAPSHOT, 1, snapshotSize(layout));
+}
+
+// Visits the live entities of the pool in [begin, end) from the slot first on, up to the slot end
+static void visitPool(
+    EntityPool *pool, SnapshotVisitor visit, void *dst, uint32_t first, uint32_t last, uint32_t begin, uint32_t end
+) {
+    for (uint32_t i = begin; i < end && first + i < last; ++i) {
+        visit(dst, first + i, pool->x[i], pool->y[i]);
     }
+}
+
+// The slot of an alien is its cell
+static void visitHorde(Game *game, SnapshotVisitor visit, void *dst, uint32_t begin, uint32_t end) {
+    EntityPool *horde = &game->horde;
+    Formation *formation = &game->formation;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        visit(dst, handleSlot(horde->handles[i]), formation->x + horde->x[i], formation->y + horde->y[i]);
+    }
+}
+
+// The ships and the powerups, whose slots depend on the ones before them
+static void visitFew(Game *game, SnapshotVisitor visit, void *dst) {
+    const SnapshotLayout *layout = &game->snapshotLayout;
 
     if (game->enemyShip.state == ACTIVE) {
-        snap->entities[j++] = (EntityBounds) {
-            .x = htons((uint16_t)game->enemyShip.bounds.x),
-            .y = htons((uint16_t)game->enemyShip.bounds.y)
-        };
-    } else j++;
-
-    if (game->ships[0].state == ACTIVE) {
-        snap->entities[j++] = (EntityBounds) {
-            .x = htons((uint16_t)game->ships[0].bounds.x),
-            .y = htons((uint16_t)game->ships[0].bounds.y)
-        };
-    } else j++;
-
-    if (game->ships[1].state == ACTIVE) {
-        snap->entities[j++] = (EntityBounds) {
-            .x = htons((uint16_t)game->ships[1].bounds.x),
-            .y = htons((uint16_t)game->ships[1].bounds.y)
-        };
-    } else j++;
-
-    for (int i = 0; i < game->nPowerups; ++i) {
-        if (game->powerups[i].state == ACTIVE) {
-            snap->entities[j++] = (EntityBounds) {
-                .x = htons((uint16_t)game->powerups[i].bounds.x),
-                .y = htons((uint16_t)game->powerups[i].bounds.y)
-            };
-        } else j++;
+        visit(dst, layout->enemyShip, game->enemyShip.bounds.x, game->enemyShip.bounds.y);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (game->ships[i].state == ACTIVE) {
+            visit(dst, layout->ships + i, game->ships[i].bounds.x, game->ships[i].bounds.y);
+        }
+    }
+
+    EntityPool *powerups = &game->powerups;
+    uint32_t fastMove = layout->fastMoves, fastShot = layout->fastShots;
+    for (int i = 0; i < powerups->count; ++i) {
+        if (powerups->types[i] == FAST_MOVE && fastMove < layout->fastShots) {
+            visit(dst, fastMove++, powerups->x[i], powerups->y[i]);
+        } else if (powerups->types[i] == FAST_SHOT && fastShot < layout->bullets) {
+            visit(dst, fastShot++, powerups->x[i], powerups->y[i]);
+        }
+    }
+}
+
+// The bullets down follow the bullets up
+static uint32_t bulletsDownSlot(Game *game) {
+    uint32_t first = game->snapshotLayout.bullets + game->bulletsUp.count;
+    return first < game->snapshotLayout.nEntities ? first : game->snapshotLayout.nEntities;
+}
+
+// Static so each caller below gets a copy with its visitor inlined
+static void visitSnapshotEntities(Game *game, SnapshotVisitor visit, void *dst) {
+    const SnapshotLayout *layout = &game->snapshotLayout;
+
+    visitHorde(game, visit, dst, 0, game->horde.count);
+    visitFew(game, visit, dst);
+    visitPool(&game->bulletsUp, visit, dst, layout->bullets, layout->nEntities, 0, game->bulletsUp.count);
+    visitPool(&game->bulletsDown, visit, dst, bulletsDownSlot(game), layout->nEntities, 0, game->bulletsDown.count);
+}
+
+static void addToSnapshot(void *dst, uint32_t slot, Scalar x, Scalar y) {
+    ((SnapshotGameState *)dst)->entities[slot] = (EntityBounds) {
+        .x = htons((uint16_t)scToInt(x)),
+        .y = htons((uint16_t)scToInt(y))
+    };
+}
+
+typedef struct SnapshotJob {
+    Game              *game;
+    SnapshotGameState *snap;
+} SnapshotJob;
+
+void clearSnapshotJob(void *data, uint32_t begin, uint32_t end) {
+    SnapshotJob *job = (SnapshotJob *)data;
+    memset(&job->snap->entities[begin], 0, (end - begin) * sizeof(EntityBounds));
+}
+
+void hordeSnapshotJob(void *data, uint32_t begin, uint32_t end) {
+    SnapshotJob *job = (SnapshotJob *)data;
+    visitHorde(job->game, addToSnapshot, job->snap, begin, end);
+}
+
+void bulletsUpSnapshotJob(void *data, uint32_t begin, uint32_t end) {
+    SnapshotJob *job = (SnapshotJob *)data;
+    const SnapshotLayout *layout = &job->game->snapshotLayout;
+    visitPool(&job->game->bulletsUp, addToSnapshot, job->snap, layout->bullets, layout->nEntities, begin, end);
+}
+
+void bulletsDownSnapshotJob(void *data, uint32_t begin, uint32_t end) {
+    SnapshotJob *job = (SnapshotJob *)data;
+    const SnapshotLayout *layout = &job->game->snapshotLayout;
+    visitPool(&job->game->bulletsDown, addToSnapshot, job->snap, bulletsDownSlot(job->game), layout->nEntities, begin, end);
+}
+
+void fewSnapshotJob(void *data, uint32_t begin, uint32_t end) {
+    (void)begin;
+    (void)end;
+    SnapshotJob *job = (SnapshotJob *)data;
+    visitFew(job->game, addToSnapshot, job->snap);
+}
+
+// The slots are cleared, then each group of entities writes its own slots
+void buildSnapshotEntitiesInJobs(Game *game, SnapshotGameState *snap) {
+    SnapshotJob job = {.game = game, .snap = snap};
+    JobGraph graph;
+    initJobGraph(&graph);
+
+    JobRange clear = addParallelFor(
+        &graph, game->jobs, clearSnapshotJob, &job, game->snapshotLayout.nEntities, SNAPSHOT_JOB_GRAIN
+    );
+    JobRange writes[] = {
+        addParallelFor(&graph, game->jobs, hordeSnapshotJob, &job, game->horde.count, SNAPSHOT_JOB_GRAIN),
+        addParallelFor(&graph, game->jobs, bulletsUpSnapshotJob, &job, game->bulletsUp.count, SNAPSHOT_JOB_GRAIN),
+        addParallelFor(&graph, game->jobs, bulletsDownSnapshotJob, &job, game->bulletsDown.count, SNAPSHOT_JOB_GRAIN),
+        {.first = (uint16_t)addJob(&graph, fewSnapshotJob, &job, 0, 1), .count = 1},
+    };
+    for (int i = 0; i < 4; ++i) {
+        addRangeDependency(&graph, clear, writes[i]);
     }
 
-    for (int i = 0; i < game->nBullets; ++i) {
-        if (game->bullets[i].state == ACTIVE) {
-            snap->entities[j++] = (EntityBounds) {
-                .x = htons((uint16_t)game->bullets[i].bounds.x),
-                .y = htons((uint16_t)game->bullets[i].bounds.y)
-            };
-        } else j++;
+    runJobGraph(game->jobs, &graph);
+}
+
+void buildSnapshot(Game *game, SnapshotGameState *snap) {
+    beginNoAllocZone("buildSnapshot");
+    snap->gameState = htonl(game->hotData->gameState);
+    snap->menuButton = htonl(game->hotData->menuButton);
+    snap->tick = htonl(game->tick);
+    snap->musicEvents = game->musicEvents;
+    snap->alienFrame = (uint8_t)game->animation->alienCurrentFrame;
+    snap->wave = htons(game->hotData->wave);
+
+    if (game->jobs != NULL && game->snapshotLayout.nEntities >= 2 * SNAPSHOT_JOB_GRAIN) {
+        buildSnapshotEntitiesInJobs(game, snap);
+    } else {
+        memset(snap->entities, 0, game->snapshotLayout.nEntities * sizeof(EntityBounds));
+        visitSnapshotEntities(game, addToSnapshot, snap);
     }
+    endNoAllocZone();
+}
+
+static void addToObservation(void *dst, uint32_t slot, Scalar x, Scalar y) {
+    Observation *observation = (Observation *)dst;
+    observation->positions[2 * slot] = scToFloat(x);
+    observation->positions[2 * slot + 1] = scToFloat(y);
+    observation->alive[slot] = 1;
+}
+
+void observeGame(Game *game, Observation *observation) {
+    memset(observation->alive, 0, game->snapshotLayout.nEntities);
+    visitSnapshotEntities(game, addToObservation, observation);
 }
 
 CommandsBufPlayer2 *initCommandsBuf(int capacity) {
-    CommandsBufPlayer2 *commands = (CommandsBufPlayer2 *)malloc(sizeof(CommandsBufPlayer2));
+    CommandsBufPlayer2 *commands = (CommandsBufPlayer2 *)gameAlloc(ALLOC_COMMANDS, sizeof(CommandsBufPlayer2));
+    uint8_t *datagram = (uint8_t *)gameCalloc(ALLOC_COMMANDS, 1, sizeof(EventAck) + capacity * sizeof(Input));
     *commands = (CommandsBufPlayer2) {
+        .datagram = datagram,
+        .ack      = (EventAck *)datagram,
+        .input    = (Input *)(datagram + sizeof(EventAck)),
         .capacity = capacity,
-        .size = 0,
-        .input = (Input *)calloc(capacity, sizeof(Input))
+        .size     = 0,
     };
 
     return commands;
 }
 
 void cleanupCommandsBuf(CommandsBufPlayer2 **buf) {
-    free((*buf)->input);
-    free(*buf);
+    gameFree((*buf)->datagram);
+    gameFree(*buf);
     *buf = NULL;
 }
 
-SoundEventsBuf *initSoundEventsBuf(int capacity) {
-    SoundEventsBuf *buf = (SoundEventsBuf *)malloc(sizeof(SoundEventsBuf));
-    buf->soundEvents = (SoundEvents *)calloc(capacity, sizeof(SoundEvents));
-    buf->currentIdx = 0;
+size_t commandsDatagramSize(const CommandsBufPlayer2 *buf) {
+    return sizeof(EventAck) + buf->capacity * sizeof(Input);
+}
+
+size_t poolStateSize(EntityPool *pool) {
+    return pool->capacity * (2 * sizeof(Scalar) + sizeof(uint8_t) + sizeof(EntityHandle) + 3 * sizeof(uint16_t))
+        + sizeof(pool->sweepY)
+        + sizeof(pool->count)
+        + sizeof(pool->nFree);
+}
 
-    return buf;
+uint8_t *writeBytes(uint8_t *dst, const void *src, size_t size) {
+    memcpy(dst, src, size);
+    return dst + size;
 }
 
-void cleanupSoundEventsBuf(SoundEventsBuf **buf) {
-    free((*buf)->soundEvents);
-    free((*buf));
-    *buf = NULL;
+const uint8_t *readBytes(const uint8_t *src, void *dst, size_t size) {
+    memcpy(dst, src, size);
+    return src + size;
+}
+
+// Field by field into a zeroed copy, so its padding is saved as zeros
+uint8_t *saveEntityState(const Entity *entity, uint8_t *dst) {
+    Entity copy;
+    memset(&copy, 0, sizeof(Entity));
+    copy.bounds = entity->bounds;
+    copy.type = entity->type;
+    copy.state = entity->state;
+    copy.up = entity->up;
+
+    memcpy(dst, &copy, sizeof(Entity));
+    return dst + sizeof(Entity);
+}
+
+// The whole capacity is saved so every keyframe of a session has the same size
+uint8_t *savePoolState(EntityPool *pool, uint8_t *dst) {
+    dst = writeBytes(dst, pool->x, pool->capacity * sizeof(Scalar));
+    dst = writeBytes(dst, pool->y, pool->capacity * sizeof(Scalar));
+    dst = writeBytes(dst, pool->types, pool->capacity * sizeof(uint8_t));
+    dst = writeBytes(dst, pool->handles, pool->capacity * sizeof(EntityHandle));
+    dst = writeBytes(dst, pool->denseIdx, pool->capacity * sizeof(uint16_t));
+    dst = writeBytes(dst, pool->generations, pool->capacity * sizeof(uint16_t));
+    dst = writeBytes(dst, pool->freeSlots, pool->capacity * sizeof(uint16_t));
+    dst = writeBytes(dst, &pool->sweepY, sizeof(pool->sweepY));
+    dst = writeBytes(dst, &pool->count, sizeof(pool->count));
+    return writeBytes(dst, &pool->nFree, sizeof(pool->nFree));
+}
+
+const uint8_t *loadPoolState(EntityPool *pool, const uint8_t *src) {
+    src = readBytes(src, pool->x, pool->capacity * sizeof(Scalar));
+    src = readBytes(src, pool->y, pool->capacity * sizeof(Scalar));
+    src = readBytes(src, pool->types, pool->capacity * sizeof(uint8_t));
+    src = readBytes(src, pool->handles, pool->capacity * sizeof(EntityHandle));
+    src = readBytes(src, pool->denseIdx, pool->capacity * sizeof(uint16_t));
+    src = readBytes(src, pool->generations, pool->capacity * sizeof(uint16_t));
+    src = readBytes(src, pool->freeSlots, pool->capacity * sizeof(uint16_t));
+    src = readBytes(src, &pool->sweepY, sizeof(pool->sweepY));
+    src = readBytes(src, &pool->count, sizeof(pool->count));
+    return readBytes(src, &pool->nFree, sizeof(pool->nFree));
+}
+
+size_t formationStateSize(Formation *formation) {
+    return hitWords(formation->nRows * formation->nColumns) * sizeof(uint64_t)
+        + (formation->nColumns + formation->nRows) * sizeof(uint16_t)
+        + 2 * sizeof(Scalar)
+        + sizeof(formation->nAlive)
+        + 3 * sizeof(uint16_t);
+}
+
+// The pitches and sizes come from the config
+uint8_t *saveFormationState(Formation *formation, uint8_t *dst) {
+    dst = writeBytes(dst, formation->alive, hitWords(formation->nRows * formation->nColumns) * sizeof(uint64_t));
+    dst = writeBytes(dst, formation->columnCount, formation->nColumns * sizeof(uint16_t));
+    dst = writeBytes(dst, formation->rowCount, formation->nRows * sizeof(uint16_t));
+    dst = writeBytes(dst, &formation->x, sizeof(Scalar));
+    dst = writeBytes(dst, &formation->y, sizeof(Scalar));
+    dst = writeBytes(dst, &formation->nAlive, sizeof(formation->nAlive));
+    dst = writeBytes(dst, &formation->minColumn, sizeof(uint16_t));
+    dst = writeBytes(dst, &formation->maxColumn, sizeof(uint16_t));
+    return writeBytes(dst, &formation->maxRow, sizeof(uint16_t));
+}
+
+const uint8_t *loadFormationState(Formation *formation, const uint8_t *src) {
+    src = readBytes(src, formation->alive, hitWords(formation->nRows * formation->nColumns) * sizeof(uint64_t));
+    src = readBytes(src, formation->columnCount, formation->nColumns * sizeof(uint16_t));
+    src = readBytes(src, formation->rowCount, formation->nRows * sizeof(uint16_t));
+    src = readBytes(src, &formation->x, sizeof(Scalar));
+    src = readBytes(src, &formation->y, sizeof(Scalar));
+    src = readBytes(src, &formation->nAlive, sizeof(formation->nAlive));
+    src = readBytes(src, &formation->minColumn, sizeof(uint16_t));
+    src = readBytes(src, &formation->maxColumn, sizeof(uint16_t));
+    return readBytes(src, &formation->maxRow, sizeof(uint16_t));
+}
+
+size_t timerWheelStateSize(void) {
+    return sizeof(uint32_t)
+        + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS * sizeof(uint16_t)
+        + MAX_TIMERS * (sizeof(uint32_t) + 3 * sizeof(uint16_t));
+}
+
+uint8_t *saveTimerWheel(const TimerWheel *wheel, uint8_t *dst) {
+    dst = writeBytes(dst, &wheel->now, sizeof(wheel->now));
+    dst = writeBytes(dst, wheel->slots, sizeof(wheel->slots));
+    for (int i = 0; i < MAX_TIMERS; ++i) {
+        dst = writeBytes(dst, &wheel->timers[i].expires, sizeof(uint32_t));
+        dst = writeBytes(dst, &wheel->timers[i].next, sizeof(uint16_t));
+        dst = writeBytes(dst, &wheel->timers[i].prev, sizeof(uint16_t));
+        dst = writeBytes(dst, &wheel->timers[i].slot, sizeof(uint16_t));
+    }
+    return dst;
 }
 
-void addSound(SoundEventsBuf *buf, SoundSelect sound) {
-    if (buf->currentIdx < CAP_SOUND_EVENT_BUF) {
-        buf->soundEvents[buf->currentIdx] |= 1 << sound;
+const uint8_t *loadTimerWheel(TimerWheel *wheel, const uint8_t *src) {
+    src = readBytes(src, &wheel->now, sizeof(wheel->now));
+    src = readBytes(src, wheel->slots, sizeof(wheel->slots));
+    for (int i = 0; i < MAX_TIMERS; ++i) {
+        src = readBytes(src, &wheel->timers[i].expires, sizeof(uint32_t));
+        src = readBytes(src, &wheel->timers[i].next, sizeof(uint16_t));
+        src = readBytes(src, &wheel->timers[i].prev, sizeof(uint16_t));
+        src = readBytes(src, &wheel->timers[i].slot, sizeof(uint16_t));
     }
+    return src;
+}
+
+size_t hotStateSize(HotGameData *hotData) {
+    return 2 * sizeof(Scalar)
+        + sizeof(hotData->gameState)
+        + sizeof(hotData->menuButton)
+        + sizeof(hotData->hordeDown)
+        + sizeof(hotData->input)
+        + 2 * sizeof(uint64_t)
+        + sizeof(hotData->alienFireSkip)
+        + sizeof(hotData->wave)
+        + timerWheelStateSize();
+}
+
+uint8_t *saveHotState(const HotGameData *hotData, uint8_t *dst) {
+    dst = writeBytes(dst, &hotData->enemyShipSpeed, sizeof(Scalar));
+    dst = writeBytes(dst, &hotData->hordeSpeed, sizeof(Scalar));
+    dst = writeBytes(dst, &hotData->gameState, sizeof(hotData->gameState));
+    dst = writeBytes(dst, &hotData->menuButton, sizeof(hotData->menuButton));
+    dst = writeBytes(dst, &hotData->hordeDown, sizeof(hotData->hordeDown));
+    dst = writeBytes(dst, &hotData->input, sizeof(hotData->input));
+    dst = writeBytes(dst, &hotData->rng.state, sizeof(uint64_t));
+    dst = writeBytes(dst, &hotData->rng.inc, sizeof(uint64_t));
+    dst = writeBytes(dst, &hotData->alienFireSkip, sizeof(hotData->alienFireSkip));
+    dst = writeBytes(dst, &hotData->wave, sizeof(hotData->wave));
+    return saveTimerWheel(&hotData->timers, dst);
+}
+
+const uint8_t *loadHotState(HotGameData *hotData, const uint8_t *src) {
+    src = readBytes(src, &hotData->enemyShipSpeed, sizeof(Scalar));
+    src = readBytes(src, &hotData->hordeSpeed, sizeof(Scalar));
+    src = readBytes(src, &hotData->gameState, sizeof(hotData->gameState));
+    src = readBytes(src, &hotData->menuButton, sizeof(hotData->menuButton));
+    src = readBytes(src, &hotData->hordeDown, sizeof(hotData->hordeDown));
+    src = readBytes(src, &hotData->input, sizeof(hotData->input));
+    src = readBytes(src, &hotData->rng.state, sizeof(uint64_t));
+    src = readBytes(src, &hotData->rng.inc, sizeof(uint64_t));
+    src = readBytes(src, &hotData->alienFireSkip, sizeof(hotData->alienFireSkip));
+    src = readBytes(src, &hotData->wave, sizeof(hotData->wave));
+    return loadTimerWheel(&hotData->timers, src);
+}
+
+// The frames are whole Rectangles of floats, only the alien frame index sits apart
+size_t animationStateSize(void) {
+    return 5 * sizeof(Rectangle) + sizeof(int);
+}
+
+uint8_t *saveAnimationState(const Animation *animation, uint8_t *dst) {
+    dst = writeBytes(dst, &animation->aliensFrame, sizeof(Rectangle));
+    dst = writeBytes(dst, &animation->shipFrame, sizeof(Rectangle));
+    dst = writeBytes(dst, &animation->bulletFrame, sizeof(Rectangle));
+    dst = writeBytes(dst, &animation->enemyShipFrame, sizeof(Rectangle));
+    dst = writeBytes(dst, &animation->powerupFrame, sizeof(Rectangle));
+    return writeBytes(dst, &animation->alienCurrentFrame, sizeof(int));
+}
+
+const uint8_t *loadAnimationState(Animation *animation, const uint8_t *src) {
+    src = readBytes(src, &animation->aliensFrame, sizeof(Rectangle));
+    src = readBytes(src, &animation->shipFrame, sizeof(Rectangle));
+    src = readBytes(src, &animation->bulletFrame, sizeof(Rectangle));
+    src = readBytes(src, &animation->enemyShipFrame, sizeof(Rectangle));
+    src = readBytes(src, &animation->powerupFrame, sizeof(Rectangle));
+    return readBytes(src, &animation->alienCurrentFrame, sizeof(int));
+}
+
+size_t gameStateSize(Game *game) {
+    return hotStateSize(game->hotData)
+        + animationStateSize()
+        + sizeof(Entity) * 3
+        + poolStateSize(&game->horde)
+        + formationStateSize(&game->formation)
+        + poolStateSize(&game->bulletsUp)
+        + poolStateSize(&game->bulletsDown)
+        + poolStateSize(&game->powerups)
+        + sizeof(game->enemiesAlive)
+        + sizeof(game->musicEvents);
+}
+
+/**
+ * The layout only has to match between saveGameState and loadGameState of the same build.
+ * Every part is written field by field, so no padding is saved and equal states give equal keyframes.
+ */
+void saveGameState(Game *game, uint8_t *dst) {
+    dst = saveHotState(game->hotData, dst);
+    dst = saveAnimationState(game->animation, dst);
+    dst = saveEntityState(&game->enemyShip, dst);
+    dst = saveEntityState(&game->ships[0], dst);
+    dst = saveEntityState(&game->ships[1], dst);
+    dst = savePoolState(&game->horde, dst);
+    dst = saveFormationState(&game->formation, dst);
+    dst = savePoolState(&game->bulletsUp, dst);
+    dst = savePoolState(&game->bulletsDown, dst);
+    dst = savePoolState(&game->powerups, dst);
+    memcpy(dst, &game->enemiesAlive, sizeof(game->enemiesAlive));
+    dst += sizeof(game->enemiesAlive);
+    memcpy(dst, &game->musicEvents, sizeof(game->musicEvents));
+}
+
+void loadGameState(Game *game, const uint8_t *src) {
+    src = loadHotState(game->hotData, src);
+    src = loadAnimationState(game->animation, src);
+    memcpy(&game->enemyShip, src, sizeof(Entity));
+    src += sizeof(Entity);
+    memcpy(game->ships, src, 2 * sizeof(Entity));
+    src += 2 * sizeof(Entity);
+    src = loadPoolState(&game->horde, src);
+    src = loadFormationState(&game->formation, src);
+    src = loadPoolState(&game->bulletsUp, src);
+    src = loadPoolState(&game->bulletsDown, src);
+    src = loadPoolState(&game->powerups, src);
+    // Its state is derived from the pools, the proxies are made again on the next tick
+    resetBroadPhase(game);
+    if (game->level != NULL) applyWaveTunings(game);
+    memcpy(&game->enemiesAlive, src, sizeof(game->enemiesAlive));
+    src += sizeof(game->enemiesAlive);
+    memcpy(&game->musicEvents, src, sizeof(game->musicEvents));
 }
@@ -3,19 +3,31 @@
 
 #include <arpa/inet.h>
 #include <raylib.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "arena.h"
+#include "broadphase.h"
 #include "entity.h"
-#include "render.h"
+#include "eventChannel.h"
+#include "rng.h"
+#include "scalar.h"
+#include "timerWheel.h"
 
 #define Input uint8_t
-#define SoundEvents uint8_t
 #define MusicEvents uint8_t
-#define N_ENTITIES 118
-#define CAP_SOUND_EVENT_BUF 3
+#define MAX_SNAPSHOT_RANGES 8
+// Tick the tunings per tick are given for, about 60 Hz
+#define DEFAULT_TICK_DURATION 0.016f
 #define HOST_PORT 2112
 #define REMOTE_PORT 2113
 
+typedef struct EventBus EventBus;
+typedef struct JobSystem JobSystem;
+typedef struct Level Level;
+typedef struct MusicStreamer MusicStreamer;
+typedef struct SpriteBatch SpriteBatch;
+
 typedef enum GameState {
     MENU,
     PLAYING,
@@ -58,17 +70,37 @@ typedef enum MusicSelect {
     STOP_ENEMY_SHIP_MUSIC,
 } MusicSelect;
 
+// Timers of the wheel of a game, those of a ship are the first plus its number
+typedef enum GameTimer {
+    TIMER_SHIP_FIRE        = 0,
+    TIMER_FAST_MOVE        = 2,
+    TIMER_FAST_SHOT        = 4,
+    TIMER_ENEMY_SHIP_ALARM = 6,
+    TIMER_ENEMY_SHIP_FIRE,
+    TIMER_ALIEN_FRAME,
+    N_GAME_TIMERS,
+} GameTimer;
+
+// Sizes of a session, fixed from initGame on
+typedef struct GameConfig {
+    uint16_t hordeRows;
+    uint16_t hordeColumns;
+    // Bullets alive at once, going up and down together
+    uint16_t nBullets;
+    uint16_t nPowerups;
+} GameConfig;
+
+#define DEFAULT_GAME_CONFIG ((GameConfig) {.hordeRows = 5, .hordeColumns = 11, .nBullets = 40, .nPowerups = 20})
+
+// The inputs go to the host after the acks of the events the remote received, in one datagram
 typedef struct CommandsBufPlayer2 {
-    Input *input;
+    uint8_t  *datagram;
+    EventAck *ack;
+    Input    *input;
     int capacity;
     int size;
 } CommandsBufPlayer2;
 
-typedef struct SoundEventsBuf {
-    SoundEvents *soundEvents;
-    int currentIdx;
-} SoundEventsBuf;
-
 typedef struct Peer {
     int sockFD;
     struct sockaddr_in selfAddr, remoteAddr;
@@ -82,53 +114,93 @@ typedef struct EntityBounds {
     uint16_t x, y;
 } EntityBounds;
 
-// TODO: send or predict the frame of the aliens
+// Slots of the snapshot holding one type of entity
+typedef struct SnapshotRange {
+    uint8_t  type;
+    uint32_t first;
+    uint32_t count;
+} SnapshotRange;
+
+/**
+ * Where each entity goes in the snapshot, the remote host gets the type of an entity from its slot.
+ * Both hosts build it from the same GameConfig: the aliens by cell, the enemy ship, the 2 players,
+ * the fast moves on the first half of the powerups, the fast shots on the second one and the bullets.
+ */
+typedef struct SnapshotLayout {
+    SnapshotRange ranges[MAX_SNAPSHOT_RANGES];
+    int           nRanges;
+    uint32_t      nEntities;
+    // First slot of each section
+    uint32_t      enemyShip;
+    uint32_t      ships;
+    uint32_t      fastMoves;
+    uint32_t      fastShots;
+    uint32_t      bullets;
+} SnapshotLayout;
+
+// Called with the slot in the layout and the position of an entity
+typedef void (*SnapshotVisitor)(void *dst, uint32_t slot, Scalar x, Scalar y);
+
+// Flat view of a session for bots, the slots of the snapshot layout
+typedef struct Observation {
+    // x and y of each slot, 2 * nEntities
+    float   *positions;
+    // 1 for the slots holding a live entity, nEntities
+    uint8_t *alive;
+} Observation;
+
 typedef struct SnapshotGameState {
-    /**
-     * 22 alien1s, 11 alien2s, 22 alien 3s, 1 enemy ship, 2 players,
-     * 10 fast shots, 10 fast moves and 40 bullets
-     */
-    EntityBounds entities[N_ENTITIES];
     GameState gameState;
     MenuButton menuButton;
-    SoundEvents soundEvents[CAP_SOUND_EVENT_BUF];
+    // Tick of the host it was built on
+    uint32_t tick;
     MusicEvents musicEvents;
+    uint8_t alienFrame;
+    // Wave of the level, gives the types of the aliens
+    uint16_t wave;
+    // Filled by the host when it sends, buildSnapshot leaves it alone
+    EventPacket events;
+    // nEntities of the layout
+    EntityBounds entities[];
 } SnapshotGameState;
 
 typedef struct ColdGameData {
-    float shipSpeeds[2];
-    float shipDelaysToFire[2];
-    float screenLimits[2];
-    float enemyShipDelayToFire;
-    float projectileSpeed;
-    float powerupDuration;
-    float hordeSpeedIncrease;
-    float hordeStepY;
-    float enemyShipSleepTime;
-    float alienTimePerFrame;
+    Scalar shipSpeeds[2];
+    Scalar shipDelaysToFire[2];
+    Scalar screenLimits[2];
+    Scalar enemyShipDelayToFire;
+    Scalar projectileSpeed;
+    Scalar powerupDuration;
+    Scalar hordeSpeedIncrease;
+    Scalar hordeStepY;
+    Scalar enemyShipSleepTime;
+    Scalar alienTimePerFrame;
+    // Chance of each living alien firing in DEFAULT_TICK_DURATION
+    float alienFireChance;
+    float powerupDropChance;
+    // Derived from the above by setTickDuration in integers, the ticks take no float math
+    uint64_t tickDurationFixed;
+    // rngGeometric rate of the fire chance over the tick duration of the session
+    uint64_t alienFireRate;
+    uint32_t powerupDropPercent;
 } ColdGameData;
 
-typedef struct ShipsTimers {
-    float remainingTimeFastShot[2];
-    float remainingTimeFastMove[2];
-    float remainingTimeToFire[2];
-} ShipsTimers;
-
-typedef struct EnemyShipTimers {
-    float remainingTimeAlarm;
-    float remainingTimeToFire;
-} EnemyShipTimers;
-
 typedef struct HotGameData {
-    ShipsTimers     shipsTimers;
-    EnemyShipTimers enemyShipTimers;
-    float           enemyShipSpeed;
-    float           hordeSpeed;
+    Scalar          enemyShipSpeed;
+    Scalar          hordeSpeed;
     GameState       gameState;
     MenuButton      menuButton;
     // TODO: Revisit that name and logic
     bool            hordeDown;
     Input           input;
+    // Per session so replays and parallel sessions are reproducible
+    Rng             rng;
+    // Living aliens left to skip before the next one fires
+    uint32_t        alienFireSkip;
+    // Of the level being played, if any
+    uint16_t        wave;
+    // Counts the ticks played, the GameTimers run on it
+    TimerWheel      timers;
 } HotGameData;
 
 typedef struct Sounds {
@@ -161,39 +233,94 @@ typedef struct Animation {
     Rectangle bulletFrame;
     Rectangle enemyShipFrame;
     Rectangle powerupFrame;
-    float timeRemainingToChangeFrame;
     int alienCurrentFrame;
 } Animation;
 
+/**
+ * Everything the game allocates is in its arena, the hot simulation state first and the cold
+ * tunings and asset handles after it. The fields follow the same split.
+ */
 typedef struct Game {
+    HotGameData*    hotData;
+    EntityPool      horde;
+    // Out of the hot data, its arrays are saved on their own by the keyframes
+    Formation       formation;
+    EntityPool      bulletsUp;
+    EntityPool      bulletsDown;
+    EntityPool      powerups;
+    Entity*         ships;
     Entity          enemyShip;
+    uint32_t        enemiesAlive;
     int             screenHeight;
-    Entity*         ships;
-    Entity*         horde;
-    Entity*         bullets;
-    Entity*         powerups;
+    int             screenWidth;
+    MusicEvents     musicEvents;
+    // Headless sessions (replays, benchmarks) don't load assets, muted ones don't play audio
+    bool            muted;
+    Animation*      animation;
+    BroadPhase      broadPhase;
+    // Alien cell each bullet up hit, by slot, gathered in parallel before the hits are applied
+    uint16_t*       alienHits;
     ColdGameData*   coldData;
-    HotGameData*    hotData;
+    // Splits the large stages of a tick across threads when set, not owned, the results don't change
+    JobSystem*      jobs;
+    // Where the events of the ticks are published when set, not owned
+    EventBus*       events;
+    // Where the music changes go when set, not owned
+    MusicStreamer*  music;
+    // Ticks run since the creation, by updateGame or the remote sampling its commands, stamps the events
+    uint32_t        tick;
+    // Waves to play instead of the single default horde, not owned
+    Level*          level;
     Sounds*         sounds;
     Textures*       textures;
-    Animation*      animation;
-    SoundEventsBuf* soundEventsBuf;
-    int             screenWidth;
-    uint16_t        nBullets;
-    uint16_t        nPowerups;
-    uint16_t        enemiesAlive;
-    uint8_t         hordeLastAlive;
-    MusicEvents     musicEvents;
+    // Where the frames are drawn from, a quad for every entity there can be
+    SpriteBatch*    sprites;
+    GameConfig      config;
+    SnapshotLayout  snapshotLayout;
+    // Duration of a simulation tick in seconds, set with setTickDuration
+    float           tickDuration;
+    Arena           arena;
 } Game;
 
-void initGame(Game *game);
+// Returns a negative value, with the reason on stderr, for sizes the game can't hold
+int checkGameConfig(const GameConfig *config);
+// A whole number from 1 to max, from all of text. Returns a negative value, with the reason on stderr, otherwise
+int parseCount(const char *text, long max, long *count);
+// "<rows>x<columns>" into the grid of config, when the horde has 1 to 65535 aliens
+int parseHordeSize(const char *text, GameConfig *config);
+// Sprites a frame can draw at most, every entity of config
+uint32_t gameSpriteCapacity(const GameConfig *config);
+// Bytes of the arena of a game of config
+size_t gameArenaSize(const GameConfig *config, bool headless);
+// The config must pass checkGameConfig. Returns a negative value when the arena can't be allocated
+int initGame(Game *game, bool headless, GameConfig config);
+HotGameData *initHotGameData(Arena *arena);
+/**
+ * A headless session in an arena shared with others, which cleanupGame leaves alone. Its hot data
+ * comes from initHotGameData on the same arena, the rest after it, gameArenaSize in all.
+ */
+void initHeadlessGameIn(Game *game, GameConfig config, Arena *arena, HotGameData *hotData);
+void seedGame(Game *game, uint64_t seed);
+/**
+ * Scales what is drawn per tick to keep the rates per second, the timers already count seconds.
+ * Also derives the integer rates of the tunings, again each time these change.
+ */
+void setTickDuration(Game *game, float tickDuration);
+// Starts a new round without allocating or reloading the assets
 void rebootGame(Game* game);
 void cleanupGame(Game *game);
+SnapshotLayout buildSnapshotLayout(const GameConfig *config);
+size_t snapshotSize(const SnapshotLayout *layout);
+SnapshotGameState *createSnapshot(const SnapshotLayout *layout);
 void buildSnapshot(Game *game, SnapshotGameState *);
+// Same slots as the snapshot, the positions of the dead ones are left as they were
+void observeGame(Game *game, Observation *observation);
 CommandsBufPlayer2 *initCommandsBuf(int capacity);
 void cleanupCommandsBuf(CommandsBufPlayer2 **buf);
-SoundEventsBuf *initSoundEventsBuf(int capacity);
-void cleanupSoundEventsBuf(SoundEventsBuf **buf);
-void addSound(SoundEventsBuf *, SoundSelect);
+size_t commandsDatagramSize(const CommandsBufPlayer2 *buf);
+// Serialization of everything updateGame mutates, used by the replay keyframes
+size_t gameStateSize(Game *game);
+void saveGameState(Game *game, uint8_t *dst);
+void loadGameState(Game *game, const uint8_t *src);
 
 #endif
\ No newline at end of file
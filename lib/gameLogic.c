@@ -5,75 +5,168 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "aabb.h"
+#include "alloc.h"
+#include "broadphase.h"
 #include "entity.h"
+#include "eventBus.h"
 #include "gameData.h"
+#include "jobs.h"
+#include "level.h"
+#include "music.h"
+#include "timerWheel.h"
 
+// Items per job, and below twice as many a stage runs on the calling thread
+#define JOB_GRAIN 256
+#define NO_ALIEN_HIT 0xffff
 
-void playSoundFX(Game *game, SoundSelect sound) {
+_Static_assert(N_GAME_TIMERS <= MAX_TIMERS, "the game has more timers than its wheel");
+
+
+static void playSound(Sounds *sounds, SoundSelect sound) {
     switch (sound) {
         case ALIEN_EXPLOSION_FX:
         {
-            PlaySound(game->sounds->alienExplosion);
+            PlaySound(sounds->alienExplosion);
         } break;
         case ALIEN_FIRE_FX:
         {
-            PlaySound(game->sounds->alienFire);
+            PlaySound(sounds->alienFire);
         } break;
         case LOSE_FX:
         {
-            PlaySound(game->sounds->lose);
+            PlaySound(sounds->lose);
         } break;
         case MENU_FX:
         {
-            PlaySound(game->sounds->menu);
+            PlaySound(sounds->menu);
         } break;
         case POWERUP_FX:
         {
-            PlaySound(game->sounds->powerup);
+            PlaySound(sounds->powerup);
         } break;
         case SHIP_EXPLOSION_FX:
         {
-            PlaySound(game->sounds->shipExplosion);
+            PlaySound(sounds->shipExplosion);
         } break;
         case SHIP_FIRE_FX:
         {
-            PlaySound(game->sounds->shipFire);
+            PlaySound(sounds->shipFire);
         } break;
         case VICTORY_FX:
         {
-            PlaySound(game->sounds->victory);
+            PlaySound(sounds->victory);
         } break;
-        default: return;
+        default: break;
+    }
+}
+
+void publishGameEvent(Game *game, GameEventType type, int value, int shipNumber) {
+    if (game->events == NULL) return;
+
+    GameEvent event = {.tick = game->tick, .type = type, .value = (uint8_t)value, .ship = (int8_t)shipNumber};
+    publishEvent(game->events, &event);
+}
+
+void playSoundFX(Game *game, SoundSelect sound) {
+    if ((unsigned)sound > VICTORY_FX) return;
+
+    if (!game->muted) {
+        // With a bus the sound is played by its audio consumer, off the simulation thread
+        if (game->events != NULL) {
+            publishGameEvent(game, EVENT_SOUND, sound, -1);
+        } else {
+            playSound(game->sounds, sound);
+        }
     }
+}
 
-    addSound(game->soundEventsBuf, sound);
+void playEventSound(void *data, const GameEvent *event) {
+    Game *game = (Game *)data;
+    if (event->type == EVENT_SOUND) playSound(game->sounds, (SoundSelect)event->value);
 }
 
 void manageMusic(Game *game, MusicSelect music) {
+    publishGameEvent(game, EVENT_MUSIC, music, -1);
+    if (!game->muted && game->music != NULL) queueMusic(game->music, music);
+
     switch (music) {
         case PLAY_BACKGROUND_MUSIC:
         {
-            PlayMusicStream(game->sounds->background);
             game->musicEvents |= 1;
         } break;
         case STOP_BACKGROUND_MUSIC:
         {
-            StopMusicStream(game->sounds->background);
             game->musicEvents &= ~1;
         } break;
         case PLAY_ENEMY_SHIP_MUSIC:
         {
-            PlayMusicStream(game->sounds->enemyShip);
             game->musicEvents |= 1 << 1;
         } break;
         case STOP_ENEMY_SHIP_MUSIC:
         {
-            StopMusicStream(game->sounds->enemyShip);
             game->musicEvents &= ~(1 << 1);
         } break;
     }
 }
 
+// A duration in Q32.32 seconds, exact from either Scalar
+static uint64_t durationToFixed(Scalar duration) {
+#ifdef FIXED_POINT_SIM
+    return (uint64_t)duration << (32 - SCALAR_FRAC_BITS);
+#else
+    return (uint64_t)((double)duration * (double)RNG_FIXED_ONE);
+#endif
+}
+
+// Ticks a countdown of duration takes at the tick of the session, the slack keeps exact multiples (2 s at 16 ms) from rounding up
+uint32_t durationTicks(Game *game, Scalar duration) {
+    if (duration <= SC(0.0f)) return 0;
+
+    // Rounded up once a ten thousandth of a tick is taken off
+    uint64_t tick = game->coldData->tickDurationFixed;
+    uint64_t ticks = (durationToFixed(duration) + tick - 1 - tick / 10000) / tick;
+    if (ticks > UINT32_MAX) return UINT32_MAX;
+    return ticks > 1 ? (uint32_t)ticks : 1;
+}
+
+// Runs for duration from this tick, a duration of 0 stops it
+void startGameTimer(Game *game, GameTimer timer, Scalar duration) {
+    TimerWheel *timers = &game->hotData->timers;
+    uint32_t ticks = durationTicks(game, duration);
+
+    if (ticks == 0) {
+        cancelTimer(timers, timer);
+    } else {
+        scheduleTimer(timers, timer, timers->now + ticks);
+    }
+}
+
+bool gameTimerRunning(Game *game, GameTimer timer) {
+    return timerPending(&game->hotData->timers, timer);
+}
+
+// The cooldowns and powerups only matter while they run, nothing happens when they end
+void gameTimerExpired(void *data, uint16_t timer) {
+    Game *game = (Game *)data;
+
+    switch (timer) {
+        case TIMER_ENEMY_SHIP_ALARM:
+        {
+            game->enemyShip.state = ACTIVE;
+            manageMusic(game, PLAY_ENEMY_SHIP_MUSIC);
+        } break;
+        case TIMER_ALIEN_FRAME:
+        {
+            Animation *animation = game->animation;
+            startGameTimer(game, TIMER_ALIEN_FRAME, game->coldData->alienTimePerFrame);
+            animation->alienCurrentFrame = (animation->alienCurrentFrame + 1) % 4;
+            animation->aliensFrame.x = animation->alienCurrentFrame * animation->aliensFrame.width;
+        } break;
+        default: break;
+    }
+}
+
 void processInput(Input *input) {
     *input = 0;
 
@@ -144,88 +237,114 @@ void loseGame(Game *game) {
     playSoundFX(game, LOSE_FX);
 }
 
-void activatePowerup(Game *game, Entity *powerup, int shipNumber) {
-    powerup->state = INACTIVE;
-    ShipsTimers *shipsTimers = &game->hotData->shipsTimers;
+void activatePowerup(Game *game, EntityType type, int shipNumber) {
+    publishGameEvent(game, EVENT_POWERUP, type, shipNumber);
 
-    switch (powerup->type) {
+    switch (type) {
         case FAST_MOVE:
         {
-            shipsTimers->remainingTimeFastMove[shipNumber] = game->coldData->powerupDuration;
+            startGameTimer(game, TIMER_FAST_MOVE + shipNumber, game->coldData->powerupDuration);
         } break;
         case FAST_SHOT:
         {
-            shipsTimers->remainingTimeFastShot[shipNumber] = game->coldData->powerupDuration;
-            shipsTimers->remainingTimeToFire[shipNumber]   = 0.0f;
+            startGameTimer(game, TIMER_FAST_SHOT + shipNumber, game->coldData->powerupDuration);
+            cancelTimer(&game->hotData->timers, TIMER_SHIP_FIRE + shipNumber);
         } break;
         default: break;
     }
 }
 
 void checkShipPowerupCollision(Game *game) {
-    EntitiesIterator it = createIterator(game->powerups, POWERUPS, game->nPowerups);
+    BroadPhase *broadPhase = &game->broadPhase;
 
-    while (!iteratorReachedEnd(&it)) {
-        Entity *powerup = getCurrentEntity(&it);
+    for (int shipNumber = 0; shipNumber < 2; ++shipNumber) {
+        uint32_t n = overlapPairs(game, PROXY_POWERUP, shipNumber, game->ships[shipNumber].bounds);
 
-        if (CheckCollisionRecs(powerup->bounds, game->ships[0].bounds)) {
-            activatePowerup(game, powerup, 0);
+        for (uint32_t word = 0; word < hitWords(n); ++word) {
+            for (uint64_t hits = broadPhase->hits[word]; hits; hits &= hits - 1) {
+                int idx = lookupInPool(&game->powerups, broadPhase->narrowHandles[word * 64 + __builtin_ctzll(hits)]);
+                activatePowerup(game, (EntityType)game->powerups.types[idx], shipNumber);
+                removeFromPool(&game->powerups, idx);
+            }
         }
-
-        iteratorNext(&it);
     }
+}
 
-    resetIterator(&it);
-    while (!iteratorReachedEnd(&it)) {
-        Entity *powerup = getCurrentEntity(&it);
-
-        if (CheckCollisionRecs(powerup->bounds, game->ships[1].bounds)) {
-            activatePowerup(game, powerup, 1);
-        }
+void findAlienHitsJob(void *data, uint32_t begin, uint32_t end) {
+    Game *game = (Game *)data;
+    EntityPool *bullets = &game->bulletsUp;
+    EntityPool *horde = &game->horde;
 
-        iteratorNext(&it);
+    for (uint32_t i = begin; i < end; ++i) {
+        int alien = findAlienHit(horde, &game->formation, poolSweepStart(bullets, i), bullets->sweepY);
+        game->alienHits[handleSlot(bullets->handles[i])] = alien < 0 ? NO_ALIEN_HIT : handleSlot(horde->handles[alien]);
     }
 }
 
-void checkAlienBulletCollision(Game *game) {
-    CollisionIterator it = createCollisionIterator(game->bullets, game->horde, game->nBullets, nRowsAliens*nColsAliens);
-    int dropCheck = 15;
-    Entity *bullet, *alien;
-
-    while (!collisionIteratorReachedEnd(&it)) {
-        bullet = getCurrentEntity(&it.bullets);
-        alien = getCurrentEntity(&it.aliens);
-        if (CheckCollisionRecs(getCurrentEntity(&it.aliens)->bounds, getCurrentEntity(&it.bullets)->bounds)) {
-            bullet->state = INACTIVE;
-            alien->state = DEAD;
-            game->enemiesAlive--;
-            playSoundFX(game, ALIEN_EXPLOSION_FX);
-            if (rand() % 100 < dropCheck) {
-                generatePowerup(&alien->bounds, game->powerups, game->nPowerups);
-            }
+/**
+ * Alien the bullet i hits, from what findAlienHitsJob found against the horde of the start of the tick.
+ * Killing aliens can't give a bullet a hit it didn't have, nor change it while its alien lives,
+ * only when an earlier bullet took that alien is it searched again, as the single threaded path does.
+ */
+int gatheredAlienHit(Game *game, int i) {
+    EntityPool *bullets = &game->bulletsUp;
+    uint16_t cell = game->alienHits[handleSlot(bullets->handles[i])];
+
+    if (cell == NO_ALIEN_HIT) return -1;
+    if (game->formation.alive[cell / 64] & (UINT64_C(1) << (cell % 64))) return game->horde.denseIdx[cell];
+    return findAlienHit(&game->horde, &game->formation, poolSweepStart(bullets, i), bullets->sweepY);
+}
 
-            if (it.aliens.currentIndex == game->hordeLastAlive) {
-                for (; game->hordeLastAlive > 0 && game->horde[game->hordeLastAlive].state == DEAD; --game->hordeLastAlive);
-            }
+void checkAlienBulletCollision(Game *game) {
+    EntityPool *bullets = &game->bulletsUp;
+    EntityPool *horde = &game->horde;
+    HotGameData *hotData = game->hotData;
+    uint32_t dropCheck = game->coldData->powerupDropPercent;
+
+    // The searches run in parallel, the kills are applied below in the order of the bullets
+    bool gathered = game->jobs != NULL && bullets->count >= 2 * JOB_GRAIN;
+    if (gathered) {
+        JobGraph graph;
+        initJobGraph(&graph);
+        addParallelFor(&graph, game->jobs, findAlienHitsJob, game, bullets->count, JOB_GRAIN);
+        runJobGraph(game->jobs, &graph);
+    }
+
+    for (int i = 0; i < bullets->count;) {
+        int alien = gathered
+            ? gatheredAlienHit(game, i)
+            : findAlienHit(horde, &game->formation, poolSweepStart(bullets, i), bullets->sweepY);
+        if (alien < 0) {
+            ++i;
+            continue;
         }
 
-        collisionIteratorNext(&it);
+        Bounds alienBounds = formationBounds(&game->formation, horde, alien);
+        publishGameEvent(game, EVENT_KILL, horde->types[alien], -1);
+        killInFormation(&game->formation, handleSlot(horde->handles[alien]));
+        removeFromPool(horde, alien);
+        removeFromPool(bullets, i);
+        game->enemiesAlive--;
+        playSoundFX(game, ALIEN_EXPLOSION_FX);
+        if (rngBelow(&hotData->rng, 100) < dropCheck) {
+            generatePowerup(&alienBounds, &game->powerups, &hotData->rng);
+        }
     }
 }
 
 void checkShipBulletCollision(Game *game, int shipNumber) {
-    EntitiesIterator it = createIterator(game->bullets, BULLETS_AT_SHIP, game->nBullets);
+    BroadPhase *broadPhase = &game->broadPhase;
+
+    if (game->ships[shipNumber].state == ACTIVE) {
+        Bounds ship = game->ships[shipNumber].bounds;
+        int hit = firstImpact(game, PROXY_BULLET_DOWN, overlapPairs(game, PROXY_BULLET_DOWN, shipNumber, ship), ship);
 
-    while (game->ships[shipNumber].state == ACTIVE && !iteratorReachedEnd(&it)) {
-        Entity *currBullet = getCurrentEntity(&it);
-        if (CheckCollisionRecs(currBullet->bounds, game->ships[shipNumber].bounds)) {
-            currBullet->state = INACTIVE;
+        if (hit >= 0) {
+            removeFromPool(&game->bulletsDown, lookupInPool(&game->bulletsDown, broadPhase->narrowHandles[hit]));
             game->ships[shipNumber].state = DEAD;
+            publishGameEvent(game, EVENT_KILL, SHIP, shipNumber);
             playSoundFX(game, SHIP_EXPLOSION_FX);
-            break;
         }
-
-        iteratorNext(&it);
     }
 
     if (game->ships[0].state == DEAD && game->ships[1].state == DEAD) {
@@ -234,87 +353,92 @@ void checkShipBulletCollision(Game *game, int shipNumber) {
 }
 
 void checkEnemyShipBulletCollision(Game *game) {
-    if (game->enemyShip.state == ACTIVE) {
-        EntitiesIterator it = createIterator(game->bullets, BULLETS_AT_ENEMIES, game->nBullets);
-    
-        while (!iteratorReachedEnd(&it)) {
-            Entity *bullet = getCurrentEntity(&it);
-            if (CheckCollisionRecs(bullet->bounds, game->enemyShip.bounds)) {
-                game->enemyShip.state = DEAD;
-                bullet->state  = INACTIVE;
-                game->enemiesAlive--;
-                playSoundFX(game, SHIP_EXPLOSION_FX);
-            }
-    
-            iteratorNext(&it);
-        }
+    BroadPhase *broadPhase = &game->broadPhase;
+    if (game->enemyShip.state != ACTIVE) return;
+
+    Bounds enemyShip = game->enemyShip.bounds;
+    int hit = firstImpact(game, PROXY_BULLET_UP, overlapPairs(game, PROXY_BULLET_UP, 2, enemyShip), enemyShip);
+
+    if (hit >= 0) {
+        game->enemyShip.state = DEAD;
+        removeFromPool(&game->bulletsUp, lookupInPool(&game->bulletsUp, broadPhase->narrowHandles[hit]));
+        game->enemiesAlive--;
+        publishGameEvent(game, EVENT_KILL, ENEMY_SHIP, -1);
+        playSoundFX(game, SHIP_EXPLOSION_FX);
     }
 }
 
-void checkCollisions(Game *game) {
+/**
+ * The broad phase runs once per tick, after the aliens took their bullets.
+ * The projectiles are swept over their move of the last tick against the targets where they are now,
+ * so a step longer than the boxes can't jump over one.
+ * reach is how far the player 2 ship can go with its buffered inputs, it's checked after each one.
+ */
+void checkCollisions(Game *game, Scalar reach) {
     checkAlienBulletCollision(game);
+    updateBroadPhase(game, reach);
     checkEnemyShipBulletCollision(game);
     checkShipBulletCollision(game, 0);
     checkShipBulletCollision(game, 1);
     checkShipPowerupCollision(game);
 }
 
-void fire(Game* game, Entity *entity, int shipNumber) {
-    switch (entity->type) {
+// Both directions share the budget of the single bullets array they were split from
+void spawnBullet(Game *game, Bounds *bounds, bool up) {
+    if (game->bulletsUp.count + game->bulletsDown.count < game->config.nBullets) {
+        generateBullet(bounds, up ? &game->bulletsUp : &game->bulletsDown, up);
+    }
+}
+
+void fire(Game* game, EntityType type, Bounds *bounds, int shipNumber) {
+    switch (type) {
         case SHIP:
         {
-            ShipsTimers *shipsTimers = &game->hotData->shipsTimers;
-            if (shipsTimers->remainingTimeToFire[shipNumber] <= 0.0) {
-                generateBullet(&entity->bounds, game->bullets, true, game->nBullets);
+            if (!gameTimerRunning(game, TIMER_SHIP_FIRE + shipNumber)) {
+                spawnBullet(game, bounds, true);
+                publishGameEvent(game, EVENT_SHOT, type, shipNumber);
                 playSoundFX(game, SHIP_FIRE_FX);
-                if (shipsTimers->remainingTimeFastShot[shipNumber] > 0.0) {
-                    shipsTimers->remainingTimeToFire[shipNumber] = game->coldData->shipDelaysToFire[BUFFED];
-                } else {
-                    shipsTimers->remainingTimeToFire[shipNumber] = game->coldData->shipDelaysToFire[REGULAR];
-                }
+                Ship ship = gameTimerRunning(game, TIMER_FAST_SHOT + shipNumber) ? BUFFED : REGULAR;
+                startGameTimer(game, TIMER_SHIP_FIRE + shipNumber, game->coldData->shipDelaysToFire[ship]);
             }
         } break;
         case ENEMY_SHIP:
         {
-            EnemyShipTimers *enemyShipTimers = &game->hotData->enemyShipTimers;
-            generateBullet(&entity->bounds, game->bullets, false, game->nBullets);
+            spawnBullet(game, bounds, false);
+            publishGameEvent(game, EVENT_SHOT, type, -1);
             playSoundFX(game, SHIP_FIRE_FX);
-            enemyShipTimers->remainingTimeToFire = game->coldData->enemyShipDelayToFire;
+            startGameTimer(game, TIMER_ENEMY_SHIP_FIRE, game->coldData->enemyShipDelayToFire);
         } break;
         case ALIEN1:
         case ALIEN2:
         case ALIEN3:
         {
-            generateBullet(&entity->bounds, game->bullets, false, game->nBullets);
+            spawnBullet(game, bounds, false);
+            publishGameEvent(game, EVENT_SHOT, type, -1);
             playSoundFX(game, ALIEN_FIRE_FX);
         } break;
         default: break;
     }
 }
 
-void updateShip(Game *game, Input *input, float deltaTime, int shipNumber) {
+void updateShip(Game *game, Input *input, Scalar deltaTime, int shipNumber) {
     if (game->ships[shipNumber].state != ACTIVE) return;
 
-    ShipsTimers *shipsTimers = &game->hotData->shipsTimers;
-
-    // NOTE: that can work if I simulate the projectiles properly
-    shipsTimers->remainingTimeFastMove[shipNumber]   -= deltaTime;
-    shipsTimers->remainingTimeFastShot[shipNumber]   -= deltaTime;
-    shipsTimers->remainingTimeToFire[shipNumber]     -= deltaTime;
+    bool fastMove = gameTimerRunning(game, TIMER_FAST_MOVE + shipNumber);
 
     if ((*input) & (1 << 2)) {
-        if (shipsTimers->remainingTimeFastMove[shipNumber] > 0.0) {
-            game->ships[shipNumber].bounds.x -= game->coldData->shipSpeeds[BUFFED] * deltaTime;
+        if (fastMove) {
+            game->ships[shipNumber].bounds.x -= scMul(game->coldData->shipSpeeds[BUFFED], deltaTime);
         } else {
-            game->ships[shipNumber].bounds.x -= game->coldData->shipSpeeds[REGULAR] * deltaTime;
+            game->ships[shipNumber].bounds.x -= scMul(game->coldData->shipSpeeds[REGULAR], deltaTime);
         }
     }
 
     if ((*input) & (1 << 3)) {
-        if (shipsTimers->remainingTimeFastMove[shipNumber] > 0.0) {
-            game->ships[shipNumber].bounds.x += game->coldData->shipSpeeds[BUFFED] * deltaTime;
+        if (fastMove) {
+            game->ships[shipNumber].bounds.x += scMul(game->coldData->shipSpeeds[BUFFED], deltaTime);
         } else {
-            game->ships[shipNumber].bounds.x += game->coldData->shipSpeeds[REGULAR] * deltaTime;
+            game->ships[shipNumber].bounds.x += scMul(game->coldData->shipSpeeds[REGULAR], deltaTime);
         }
     }
 
@@ -326,37 +450,32 @@ void updateShip(Game *game, Input *input, float deltaTime, int shipNumber) {
     }
 
     if ((*input) & (1 << 4)) {
-        fire(game, &game->ships[shipNumber], shipNumber);
+        fire(game, SHIP, &game->ships[shipNumber].bounds, shipNumber);
     }
 
     *input = 0;
 }
 
-void updateEnemyShip(Game *game, float deltaTime) {
-    EnemyShipTimers *enemyShipTimers = &game->hotData->enemyShipTimers;
+void updateEnemyShip(Game *game, Scalar deltaTime) {
     if (game->enemyShip.state == INACTIVE) {
-        enemyShipTimers->remainingTimeAlarm -= deltaTime;
-        if (enemyShipTimers->remainingTimeAlarm <= 0.0f) {
-            game->enemyShip.state = ACTIVE;
-            manageMusic(game, PLAY_ENEMY_SHIP_MUSIC);
+        // Set off on the first tick it sleeps, the ship shows up when it rings
+        if (!gameTimerRunning(game, TIMER_ENEMY_SHIP_ALARM)) {
+            startGameTimer(game, TIMER_ENEMY_SHIP_ALARM, game->coldData->enemyShipSleepTime);
         }
     } else if (game->enemyShip.state == ACTIVE) {
-        enemyShipTimers->remainingTimeToFire -= deltaTime;
-        UpdateMusicStream(game->sounds->enemyShip);
-        game->enemyShip.bounds.x += game->hotData->enemyShipSpeed * deltaTime;
+        game->enemyShip.bounds.x += scMul(game->hotData->enemyShipSpeed, deltaTime);
 
-        if (enemyShipTimers->remainingTimeToFire <= 0.0) {
-            fire(game, &game->enemyShip, -1);
+        if (!gameTimerRunning(game, TIMER_ENEMY_SHIP_FIRE)) {
+            fire(game, ENEMY_SHIP, &game->enemyShip.bounds, -1);
         }
 
-        if (game->hotData->enemyShipSpeed > 0.0f) {
-            if (game->enemyShip.bounds.x > game->screenWidth) {
+        if (game->hotData->enemyShipSpeed > SC(0.0f)) {
+            if (game->enemyShip.bounds.x > scFromInt(game->screenWidth)) {
                 game->enemyShip.state = INACTIVE;
                 game->hotData->enemyShipSpeed *= -1;
                 manageMusic(game, STOP_ENEMY_SHIP_MUSIC);
-                enemyShipTimers->remainingTimeAlarm = game->coldData->enemyShipSleepTime;
             }
-        } else if (game->hotData->enemyShipSpeed < 0.0f) {
+        } else if (game->hotData->enemyShipSpeed < SC(0.0f)) {
             if (game->enemyShip.bounds.x < game->coldData->screenLimits[LEFT]) {
                 game->enemyShip.bounds.x = game->coldData->screenLimits[LEFT];
                 game->hotData->enemyShipSpeed *= -1;
@@ -366,111 +485,92 @@ void updateEnemyShip(Game *game, float deltaTime) {
 
 }
 
-float getAliensMaxHorizontalPos(EntitiesIterator *it) {
-    if (!iteratorReachedEnd(it)) {
-        float maxHorizontalPos = getCurrentEntity(it)->bounds.x;
-        while (!iteratorReachedEnd(it)) {
-            float currentX = getCurrentEntity(it)->bounds.x;
-            maxHorizontalPos = currentX > maxHorizontalPos ? currentX : maxHorizontalPos; 
-    
-            iteratorNext(it);
-        }
-    
-        return maxHorizontalPos;
+void updateHorde(Game *game, Scalar deltaTime) {
+    // Started on the first tick played, then each frame starts the next
+    if (!gameTimerRunning(game, TIMER_ALIEN_FRAME)) {
+        startGameTimer(game, TIMER_ALIEN_FRAME, game->coldData->alienTimePerFrame);
     }
-}
 
-float getAliensMinHorizontalPos(EntitiesIterator *it) {
-    if (!iteratorReachedEnd(it)) {
-        float minHorizontalPos = getCurrentEntity(it)->bounds.x;
-        while (!iteratorReachedEnd(it)) {
-            float currentX = getCurrentEntity(it)->bounds.x;
-            minHorizontalPos = currentX < minHorizontalPos ? currentX : minHorizontalPos;
-    
-            iteratorNext(it);
-        }
-    
-        return minHorizontalPos;
-    }
-}
+    HotGameData *hotData = game->hotData;
+    EntityPool *horde = &game->horde;
 
-void updateHorde(Game *game, float deltaTime) {
-    game->animation->timeRemainingToChangeFrame -= deltaTime;
-    if (game->animation->timeRemainingToChangeFrame <= 0.0f) {
-        game->animation->timeRemainingToChangeFrame = game->coldData->alienTimePerFrame;
-        game->animation->alienCurrentFrame = (game->animation->alienCurrentFrame + 1) % 4;
-        game->animation->aliensFrame.x = game->animation->alienCurrentFrame * game->animation->aliensFrame.width;
+    /**
+     * Every living alien is a Bernoulli trial, instead of drawing once per alien
+     * the gap to the next success is drawn from the geometric distribution,
+     * so only the aliens that fire are visited.
+     */
+    uint32_t next = 0;
+    while (hotData->alienFireSkip < horde->count - next) {
+        next += hotData->alienFireSkip;
+        Bounds alienBounds = formationBounds(&game->formation, horde, next);
+        fire(game, (EntityType)horde->types[next], &alienBounds, -1);
+        hotData->alienFireSkip = rngGeometric(&hotData->rng, game->coldData->alienFireRate);
+        next++;
     }
+    hotData->alienFireSkip -= horde->count - next;
 
-    EntitiesIterator hordeIt = createIterator(game->horde, ALIENS, nRowsAliens*nColsAliens);
-    int dropCheck = 1;
+    Formation *formation = &game->formation;
+    formation->x += scMul(hotData->hordeSpeed, deltaTime);
+    if (hotData->hordeDown) formation->y += game->coldData->hordeStepY;
+    hotData->hordeDown = false;
 
-    // It's possible to look for the leftest and the rightest alien inside that while!!
-    while (!iteratorReachedEnd(&hordeIt)) {
-        Entity *current = getCurrentEntity(&hordeIt);
-        if (rand() % 3000 < dropCheck) fire(game, current, -1);
-
-        current->bounds.x += game->hotData->hordeSpeed * deltaTime;
-        if (game->hotData->hordeDown) {
-            current->bounds.y += game->coldData->hordeStepY;
-        }
-        iteratorNext(&hordeIt);
-    }
-
-    game->hotData->hordeDown = false;
-    resetIterator(&hordeIt);
+    // An empty formation has no extents
+    if (formation->nAlive == 0) return;
 
     // Checks collision with the screen bounds
-    if (game->hotData->hordeSpeed > 0.0f) {
-        float maxHorizontalPos = getAliensMaxHorizontalPos(&hordeIt);
-        if (maxHorizontalPos + game->horde[0].bounds.width >= game->coldData->screenLimits[RIGHT]) {
-            game->hotData->hordeSpeed += game->coldData->hordeSpeedIncrease;
-            game->hotData->hordeSpeed *= -1;
-            game->hotData->hordeDown = true;
+    if (hotData->hordeSpeed > SC(0.0f)) {
+        if (formationMaxX(formation) + horde->width >= game->coldData->screenLimits[RIGHT]) {
+            hotData->hordeSpeed += game->coldData->hordeSpeedIncrease;
+            hotData->hordeSpeed *= -1;
+            hotData->hordeDown = true;
         }
-    } else if (game->hotData->hordeSpeed < 0.0f) {
-        float minHorizontalPos = getAliensMinHorizontalPos(&hordeIt);
-        if (minHorizontalPos <= game->coldData->screenLimits[LEFT]) {
-            game->hotData->hordeSpeed -= game->coldData->hordeSpeedIncrease;
-            game->hotData->hordeSpeed *= -1;
-            game->hotData->hordeDown = true;
+    } else if (hotData->hordeSpeed < SC(0.0f)) {
+        if (formationMinX(formation) <= game->coldData->screenLimits[LEFT]) {
+            hotData->hordeSpeed -= game->coldData->hordeSpeedIncrease;
+            hotData->hordeSpeed *= -1;
+            hotData->hordeDown = true;
         }
     }
 
     // Lose when aliens reach player's ship level
-    Entity *lastAlive = &game->horde[game->hordeLastAlive];
-    if (lastAlive->bounds.y + lastAlive->bounds.height > game->ships[0].bounds.y) {
+    if (formationMaxY(formation) + horde->height > game->ships[0].bounds.y) {
         loseGame(game);
     }
 }
 
-void updateProjectiles(Game *game, float deltaTime) {
-    EntitiesIterator bulletsIt = createIterator(game->bullets, BULLETS, game->nBullets);
-    EntitiesIterator powerupsIt = createIterator(game->powerups, POWERUPS, game->nPowerups);
+typedef struct ShiftJob {
+    EntityPool *pool;
+    Scalar     dy;
+} ShiftJob;
 
-    while (!iteratorReachedEnd(&bulletsIt)) {
-        Entity *current = getCurrentEntity(&bulletsIt);
-        if (current->up) {
-            current->bounds.y -= game->coldData->projectileSpeed * deltaTime;
-        } else {
-            current->bounds.y += game->coldData->projectileSpeed * deltaTime;
-        }
+void shiftPoolJob(void *data, uint32_t begin, uint32_t end) {
+    ShiftJob *job = (ShiftJob *)data;
+    shiftPoolRange(job->pool, job->dy, begin, end);
+}
 
-        if (current->bounds.y >= game->screenHeight || current->bounds.y <= -current->bounds.height) {
-            current->state = INACTIVE;
-        }
+void updateProjectiles(Game *game, Scalar deltaTime) {
+    Scalar step = scMul(game->coldData->projectileSpeed, deltaTime);
+    Scalar bottom = scFromInt(game->screenHeight);
 
-        iteratorNext(&bulletsIt);
+    if (game->jobs == NULL || game->bulletsUp.count + game->bulletsDown.count + game->powerups.count < 2 * JOB_GRAIN) {
+        movePoolVertically(&game->bulletsUp, -step, bottom);
+        movePoolVertically(&game->bulletsDown, step, bottom);
+        movePoolVertically(&game->powerups, step, bottom);
+        return;
     }
 
-    while (!iteratorReachedEnd(&powerupsIt)) {
-        Entity *current = getCurrentEntity(&powerupsIt);
-        current->bounds.y += game->coldData->projectileSpeed * deltaTime;
-        if (current->bounds.y >= game->screenHeight || current->bounds.y <= -current->bounds.height) {
-            current->state = INACTIVE;
-        }
+    // The moves are split, the removals reorder the pools so they stay on this thread
+    ShiftJob jobs[] = {{&game->bulletsUp, -step}, {&game->bulletsDown, step}, {&game->powerups, step}};
+    JobGraph graph;
+    initJobGraph(&graph);
+    for (int i = 0; i < 3; ++i) {
+        jobs[i].pool->sweepY = jobs[i].dy;
+        addParallelFor(&graph, game->jobs, shiftPoolJob, &jobs[i], jobs[i].pool->count, JOB_GRAIN);
+    }
+    runJobGraph(game->jobs, &graph);
 
-        iteratorNext(&powerupsIt);
+    for (int i = 0; i < 3; ++i) {
+        cullPool(jobs[i].pool, bottom);
     }
 }
 
@@ -497,32 +597,38 @@ void updateMenu(Game *game) {
     }
 }
 
-void updatePlayer2(Game *game, CommandsBufPlayer2 *commands, float delta) {
+void updatePlayer2(Game *game, CommandsBufPlayer2 *commands, Scalar delta) {
     for (int i = 0; i < commands->capacity; ++i) {
         updateShip(game, &commands->input[i], delta, 1);
         checkShipBulletCollision(game, 1);
     }
 }
 
-void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, float deltaTime) {
-    game->soundEventsBuf->soundEvents[game->soundEventsBuf->currentIdx] = 0;
+void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, Scalar deltaTime) {
+    beginNoAllocZone("updateGame");
+    GameState state = game->hotData->gameState;
 
     switch (game->hotData->gameState) {
         case PLAYING:
         {
-            UpdateMusicStream(game->sounds->background);
+            advanceTimerWheel(&game->hotData->timers, gameTimerExpired, game);
 
             if (game->hotData->input & (1 << 6)) {
                 game->hotData->gameState = PAUSED;
             }
-            checkCollisions(game);
+            checkCollisions(
+                game,
+                scMul(game->coldData->shipSpeeds[BUFFED], deltaTime) * commandsPlayer2->capacity
+            );
             updateShip(game, &game->hotData->input, deltaTime, 0);
             updatePlayer2(game, commandsPlayer2, deltaTime);
             updateEnemyShip(game, deltaTime);
             updateHorde(game, deltaTime);
             updateProjectiles(game, deltaTime);
 
-            if (game->enemiesAlive <= 0) {
+            if (game->enemiesAlive <= 0 && game->level != NULL && game->hotData->wave + 1 < game->level->header->nWaves) {
+                startWave(game, game->hotData->wave + 1);
+            } else if (game->enemiesAlive <= 0) {
                 game->hotData->gameState = WIN;
                 manageMusic(game, STOP_BACKGROUND_MUSIC);
                 playSoundFX(game, VICTORY_FX);
@@ -531,7 +637,6 @@ void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, float deltaTime
         case MENU:
         case PAUSED:
         {
-            UpdateMusicStream(game->sounds->background);
             updateMenu(game);
             if (game->hotData->input & (1 << 5)) {
                 if (game->hotData->menuButton == START) {
@@ -558,66 +663,20 @@ void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, float deltaTime
         default: break;
     }
 
-    game->soundEventsBuf->currentIdx = (game->soundEventsBuf->currentIdx + 1) % CAP_SOUND_EVENT_BUF;
+    if (game->hotData->gameState != state) publishGameEvent(game, EVENT_STATE, game->hotData->gameState, -1);
+    game->tick++;
+    endNoAllocZone();
 }
 
+// The remote follows the music of the host, from the streams playing in its snapshots
 void processMusic(Game *game, SnapshotGameState *snap) {
-    UpdateMusicStream(game->sounds->background);
-    UpdateMusicStream(game->sounds->enemyShip);
-
-    if ((snap->musicEvents & 1) && !IsMusicStreamPlaying(game->sounds->background)) {
-        PlayMusicStream(game->sounds->background);
-    }
-
-    if (!(snap->musicEvents & 1) && IsMusicStreamPlaying(game->sounds->background)) {
-        StopMusicStream(game->sounds->background);
-    }
-
-    if ((snap->musicEvents & (1 << 1)) && !IsMusicStreamPlaying(game->sounds->enemyShip)) {
-        PlayMusicStream(game->sounds->enemyShip);
-    }
+    MusicEvents changed = snap->musicEvents ^ game->musicEvents;
 
-    if (!(snap->musicEvents & (1 << 1)) && IsMusicStreamPlaying(game->sounds->enemyShip)) {
-        StopMusicStream(game->sounds->enemyShip);
+    if (changed & 1) {
+        manageMusic(game, snap->musicEvents & 1 ? PLAY_BACKGROUND_MUSIC : STOP_BACKGROUND_MUSIC);
     }
 
-    snap->musicEvents = 0;
-}
-
-void processSoundFX(Game *game, SnapshotGameState *snap) {
-    for (int i = 0; i < CAP_SOUND_EVENT_BUF; ++i) {
-        if (snap->soundEvents[i] & 1) {
-            PlaySound(game->sounds->alienExplosion);
-        }
-
-        if (snap->soundEvents[i] & (1 << 1)) {
-            PlaySound(game->sounds->alienFire);
-        }
-
-        if (snap->soundEvents[i] & (1 << 2)) {
-            PlaySound(game->sounds->lose);
-        }
-
-        if (snap->soundEvents[i] & (1 << 3)) {
-            PlaySound(game->sounds->menu);
-        }
-
-        if (snap->soundEvents[i] & (1 << 4)) {
-            PlaySound(game->sounds->powerup);
-        }
-
-        if (snap->soundEvents[i] & (1 << 5)) {
-            PlaySound(game->sounds->shipExplosion);
-        }
-
-        if (snap->soundEvents[i] & (1 << 6)) {
-            PlaySound(game->sounds->shipFire);
-        }
-
-        if (snap->soundEvents[i] & (1 << 7)) {
-            PlaySound(game->sounds->victory);
-        }
-
-        snap->soundEvents[i] = 0;
+    if (changed & (1 << 1)) {
+        manageMusic(game, snap->musicEvents & (1 << 1) ? PLAY_ENEMY_SHIP_MUSIC : STOP_ENEMY_SHIP_MUSIC);
     }
 }
@@ -4,11 +4,17 @@
 #include "gameData.h" 
 
 typedef struct Game Game;
+typedef struct GameEvent GameEvent;
 typedef struct SnapshotGameState SnapshotGameState;
 
+// Left and right, the only inputs held rather than pressed, so the only ones the later sub-steps of a frame repeat
+#define HELD_INPUTS ((1 << 2) | (1 << 3))
+
 void processInput(Input *input);
-void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, float deltaTime);
+void manageMusic(Game *game, MusicSelect music);
+// EventHandler of the audio consumer, data is the Game whose sounds are played
+void playEventSound(void *data, const GameEvent *event);
+void updateGame(Game *game, CommandsBufPlayer2 *commandsPlayer2, Scalar deltaTime);
 void processMusic(Game *, SnapshotGameState *);
-void processSoundFX(Game *, SnapshotGameState *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "jobs.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+
+void pushJob(JobDeque *deque, uint16_t job) {
+    pthread_mutex_lock(&deque->lock);
+    deque->items[deque->bottom++] = job;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+bool popJob(JobDeque *deque, uint16_t *job) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found) *job = deque->items[--deque->bottom];
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+// Takes the oldest job, the one the owner would have run last
+bool stealJob(JobDeque *deque, uint16_t *job) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found) *job = deque->items[deque->top++];
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+void runJob(JobSystem *system, JobWorker *worker, uint16_t id) {
+    JobGraph *graph = system->graph;
+    Job *job = &graph->jobs[id];
+    job->function(job->data, job->begin, job->end);
+
+    // The dependents made ready go to this worker, their inputs are likely in its cache
+    for (int i = 0; i < job->nDependents; ++i) {
+        JobRange range = job->dependents[i];
+        for (uint16_t next = range.first; next < range.first + range.count; ++next) {
+            if (atomic_fetch_sub(&graph->jobs[next].pending, 1) == 1) pushJob(&worker->deque, next);
+        }
+    }
+
+    // Last, the graph can go away as soon as it drops to 0
+    atomic_fetch_sub(&system->remaining, 1);
+}
+
+// Runs jobs until the graph is done, from its own deque first then from the others
+void workOnGraph(JobSystem *system, JobWorker *worker) {
+    while (atomic_load(&system->remaining) > 0) {
+        uint16_t id;
+        bool found = popJob(&worker->deque, &id);
+
+        for (int i = 1; !found && i < system->nWorkers; ++i) {
+            found = stealJob(&system->workers[(worker->index + i) % system->nWorkers].deque, &id);
+            if (found) atomic_fetch_add(&system->steals, 1);
+        }
+
+        if (found) {
+            runJob(system, worker, id);
+        } else {
+            // What is left is running on the other workers
+            sched_yield();
+        }
+    }
+}
+
+void *jobWorker(void *arg) {
+    JobWorker *worker = (JobWorker *)arg;
+    JobSystem *system = worker->system;
+    uint32_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&system->lock);
+        while (system->generation == seen && !system->stopping) {
+            pthread_cond_wait(&system->wake, &system->lock);
+        }
+        seen = system->generation;
+        bool stopping = system->stopping;
+        pthread_mutex_unlock(&system->lock);
+
+        if (stopping) break;
+        // The graphs are parts of the stages of a tick, which must not allocate
+        beginNoAllocZone("jobs");
+        workOnGraph(system, worker);
+        endNoAllocZone();
+    }
+
+    return NULL;
+}
+
+int createJobSystem(JobSystem *system, int nWorkers) {
+    if (nWorkers <= 0) nWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers < 1) nWorkers = 1;
+
+    *system = (JobSystem) {
+        .workers  = (JobWorker *)gameCalloc(ALLOC_JOBS, nWorkers, sizeof(JobWorker)),
+        .nWorkers = nWorkers,
+    };
+    if (system->workers == NULL) return -1;
+
+    pthread_mutex_init(&system->lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+    for (int i = 0; i < nWorkers; ++i) {
+        system->workers[i].system = system;
+        system->workers[i].index = i;
+        pthread_mutex_init(&system->workers[i].deque.lock, NULL);
+    }
+
+    // The workers wait for the lock before reading nWorkers, it's settled once they get it
+    pthread_mutex_lock(&system->lock);
+    for (int i = 1; i < nWorkers; ++i) {
+        if (pthread_create(&system->workers[i].thread, NULL, jobWorker, &system->workers[i]) != 0) {
+            perror("failed to start a job worker, running with fewer threads.\n");
+            system->nWorkers = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&system->lock);
+
+    return 0;
+}
+
+void destroyJobSystem(JobSystem *system) {
+    pthread_mutex_lock(&system->lock);
+    system->stopping = true;
+    pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->lock);
+
+    for (int i = 1; i < system->nWorkers; ++i) {
+        pthread_join(system->workers[i].thread, NULL);
+    }
+
+    // Every deque was initialized, even the ones of the workers that failed to start
+    for (int i = 0; i < system->nWorkers; ++i) {
+        pthread_mutex_destroy(&system->workers[i].deque.lock);
+    }
+    pthread_cond_destroy(&system->wake);
+    pthread_mutex_destroy(&system->lock);
+    gameFree(system->workers);
+    *system = (JobSystem) {0};
+}
+
+void initJobGraph(JobGraph *graph) {
+    graph->nJobs = 0;
+}
+
+int addJob(JobGraph *graph, JobFunction function, void *data, uint32_t begin, uint32_t end) {
+    if (graph->nJobs == MAX_JOBS) return -1;
+
+    int id = graph->nJobs++;
+    Job *job = &graph->jobs[id];
+    job->function = function;
+    job->data = data;
+    job->begin = begin;
+    job->end = end;
+    job->nDependents = 0;
+    atomic_init(&job->pending, 0);
+
+    return id;
+}
+
+bool addRangeDependency(JobGraph *graph, JobRange before, JobRange after) {
+    for (uint16_t i = before.first; i < before.first + before.count; ++i) {
+        if (graph->jobs[i].nDependents == MAX_JOB_DEPENDENTS) return false;
+    }
+
+    for (uint16_t i = before.first; i < before.first + before.count; ++i) {
+        graph->jobs[i].dependents[graph->jobs[i].nDependents++] = after;
+    }
+    for (uint16_t i = after.first; i < after.first + after.count; ++i) {
+        atomic_fetch_add(&graph->jobs[i].pending, before.count);
+    }
+
+    return true;
+}
+
+bool addJobDependency(JobGraph *graph, int before, int after) {
+    return addRangeDependency(
+        graph, (JobRange) {.first = (uint16_t)before, .count = 1}, (JobRange) {.first = (uint16_t)after, .count = 1}
+    );
+}
+
+JobRange addParallelFor(JobGraph *graph, JobSystem *system, JobFunction function, void *data, uint32_t n, uint32_t grain) {
+    JobRange range = {.first = graph->nJobs};
+    if (n == 0) return range;
+
+    uint32_t count = grain > 0 ? n / grain : n;
+    if (count > 4 * (uint32_t)system->nWorkers) count = 4 * system->nWorkers;
+    if (count > (uint32_t)(MAX_JOBS - graph->nJobs)) count = MAX_JOBS - graph->nJobs;
+    if (count == 0 && graph->nJobs < MAX_JOBS) count = 1;
+
+    for (uint32_t k = 0; k < count; ++k) {
+        addJob(graph, function, data, (uint32_t)((uint64_t)n * k / count), (uint32_t)((uint64_t)n * (k + 1) / count));
+    }
+
+    range.count = (uint16_t)count;
+    return range;
+}
+
+void runJobGraph(JobSystem *system, JobGraph *graph) {
+    if (graph->nJobs == 0) return;
+
+    // The deques are empty between graphs
+    system->graph = graph;
+    for (int i = 0; i < system->nWorkers; ++i) {
+        JobDeque *deque = &system->workers[i].deque;
+        pthread_mutex_lock(&deque->lock);
+        deque->top = deque->bottom = 0;
+        pthread_mutex_unlock(&deque->lock);
+    }
+    atomic_store(&system->remaining, graph->nJobs);
+
+    // The jobs without predecessors are dealt round-robin, the stealing evens out the rest
+    int next = 0;
+    for (uint16_t id = 0; id < graph->nJobs; ++id) {
+        if (atomic_load(&graph->jobs[id].pending) == 0) {
+            pushJob(&system->workers[next++ % system->nWorkers].deque, id);
+        }
+    }
+
+    if (system->nWorkers > 1) {
+        pthread_mutex_lock(&system->lock);
+        system->generation++;
+        pthread_cond_broadcast(&system->wake);
+        pthread_mutex_unlock(&system->lock);
+    }
+
+    workOnGraph(system, &system->workers[0]);
+}
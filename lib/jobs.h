@@ -0,0 +1,96 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_JOBS 256
+#define MAX_JOB_DEPENDENTS 8
+
+
+// Runs the items [begin, end) of data
+typedef void (*JobFunction)(void *data, uint32_t begin, uint32_t end);
+
+// Consecutive jobs of a graph, as added by addParallelFor
+typedef struct JobRange {
+    uint16_t first;
+    uint16_t count;
+} JobRange;
+
+typedef struct Job {
+    JobFunction function;
+    void        *data;
+    uint32_t    begin;
+    uint32_t    end;
+    // Predecessors not done yet, the job is queued when it drops to 0
+    atomic_int  pending;
+    JobRange    dependents[MAX_JOB_DEPENDENTS];
+    uint16_t    nDependents;
+} Job;
+
+// Jobs and their dependencies, built for a single run
+typedef struct JobGraph {
+    Job      jobs[MAX_JOBS];
+    uint16_t nJobs;
+} JobGraph;
+
+// Ids of runnable jobs, the owner pushes and pops at the bottom and the thieves take from the top
+typedef struct JobDeque {
+    uint16_t        items[MAX_JOBS];
+    int             top;
+    int             bottom;
+    pthread_mutex_t lock;
+} JobDeque;
+
+typedef struct JobSystem JobSystem;
+
+typedef struct JobWorker {
+    JobSystem *system;
+    JobDeque  deque;
+    pthread_t thread;
+    int       index;
+} JobWorker;
+
+/**
+ * Small work-stealing pool for the jobs of a tick. Each worker runs what its deque holds and
+ * steals from the others when it's empty, the caller of runJobGraph is worker 0 and helps.
+ * The jobs of a graph must write disjoint data: whatever has to be ordered is left to the
+ * caller once the graph is done, so the results don't depend on the scheduling.
+ */
+struct JobSystem {
+    JobWorker       *workers;
+    int             nWorkers;
+    JobGraph        *graph;
+    // Jobs of the running graph not done yet
+    atomic_int      remaining;
+    // Jobs taken from another worker since the creation, to see how the load spreads
+    atomic_uint     steals;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    // Bumped for each graph, the idle workers sleep until it changes
+    uint32_t        generation;
+    bool            stopping;
+};
+
+// nWorkers counts the caller, 0 for one per online core. Returns a negative value on failure.
+int createJobSystem(JobSystem *system, int nWorkers);
+void destroyJobSystem(JobSystem *system);
+
+void initJobGraph(JobGraph *graph);
+// Returns the id of the job or -1 when the graph is full
+int addJob(JobGraph *graph, JobFunction function, void *data, uint32_t begin, uint32_t end);
+// Returns false when before has no room for another dependent
+bool addJobDependency(JobGraph *graph, int before, int after);
+/**
+ * Splits [0, n) in jobs of at least grain items, a few per worker so the stealing can even them out.
+ * The range is empty when n is 0 or the graph is full.
+ */
+JobRange addParallelFor(JobGraph *graph, JobSystem *system, JobFunction function, void *data, uint32_t n, uint32_t grain);
+// Every job of after waits for all the jobs of before, returns false when one of before has no room
+bool addRangeDependency(JobGraph *graph, JobRange before, JobRange after);
+// Runs the graph to completion, with the caller as one of the workers
+void runJobGraph(JobSystem *system, JobGraph *graph);
+
+#endif
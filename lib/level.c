@@ -0,0 +1,420 @@
+#include "level.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "entity.h"
+#include "gameData.h"
+#include "gameLogic.h"
+#include "timerWheel.h"
+
+
+static const char levelMagic[4] = {'S', 'I', 'W', 'V'};
+
+static size_t levelCells(const LevelHeader *header) {
+    return (size_t)header->hordeRows * header->hordeColumns;
+}
+
+// FNV-1a
+uint32_t hashBytes(uint32_t hash, const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ ((const uint8_t *)data)[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Finite tunings, speeds and times not negative, chances between 0 and 1
+static bool checkWaveRecord(const WaveRecord *record) {
+    const float amounts[] = {
+        record->hordeSpeed, record->hordeSpeedIncrease, record->hordeStepY,
+        record->enemyShipSpeed, record->enemyShipSleepTime, record->enemyShipDelayToFire,
+    };
+    for (size_t i = 0; i < sizeof(amounts) / sizeof(amounts[0]); ++i) {
+        if (!isfinite(amounts[i]) || amounts[i] < 0) return false;
+    }
+
+    // Written so that NaN fails
+    return record->alienFireChance >= 0 && record->alienFireChance <= 1
+        && record->powerupDropChance >= 0 && record->powerupDropChance <= 1;
+}
+
+int openLevel(Level *level, const char *path) {
+    *level = (Level) {0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("failed to open the level file.\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(LevelHeader)) {
+        fprintf(stderr, "level file is too small.\n");
+        close(fd);
+        return -2;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("failed to map the level file.\n");
+        return -3;
+    }
+
+    level->data   = (const uint8_t *)data;
+    level->size   = st.st_size;
+    level->header = (const LevelHeader *)level->data;
+
+    const LevelHeader *header = level->header;
+    GameConfig config = DEFAULT_GAME_CONFIG;
+    config.hordeRows = header->hordeRows;
+    config.hordeColumns = header->hordeColumns;
+
+    if (
+        memcmp(header->magic, levelMagic, sizeof(levelMagic)) != 0 ||
+        header->version != LEVEL_VERSION ||
+        header->nWaves == 0 ||
+        checkGameConfig(&config) < 0 ||
+        header->waveStride < sizeof(WaveRecord) + levelCells(header) ||
+        header->waveStride % sizeof(uint64_t) != 0 ||
+        sizeof(LevelHeader) + (size_t)header->nWaves * header->waveStride != level->size
+    ) {
+        fprintf(stderr, "invalid level file.\n");
+        closeLevel(level);
+        return -4;
+    }
+
+    for (uint16_t wave = 0; wave < header->nWaves; ++wave) {
+        if (!checkWaveRecord(levelWave(level, wave))) {
+            fprintf(stderr, "invalid tunings in wave %d of the level file.\n", wave + 1);
+            closeLevel(level);
+            return -4;
+        }
+    }
+
+    // The replays tell the levels apart by it, the waves must be the ones it was computed from
+    if (hashBytes(2166136261u, level->data + sizeof(LevelHeader), level->size - sizeof(LevelHeader)) != header->checksum) {
+        fprintf(stderr, "the checksum of the level file doesn't match its waves.\n");
+        closeLevel(level);
+        return -4;
+    }
+
+    return 0;
+}
+
+void closeLevel(Level *level) {
+    if (level->data != NULL) {
+        munmap((void *)level->data, level->size);
+    }
+
+    *level = (Level) {0};
+}
+
+const WaveRecord *levelWave(const Level *level, uint16_t wave) {
+    return (const WaveRecord *)(level->data + sizeof(LevelHeader) + (size_t)wave * level->header->waveStride);
+}
+
+int waveCellType(const Level *level, uint16_t wave, int cell) {
+    const uint8_t *types = (const uint8_t *)(levelWave(level, wave) + 1);
+    if (types[cell] < 1 || types[cell] > 3) return -1;
+
+    return ALIEN1 + types[cell] - 1;
+}
+
+void prefetchWave(const Level *level, uint16_t wave) {
+    if (wave >= level->header->nWaves) return;
+
+    // madvise wants a page aligned start
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = sizeof(LevelHeader) + (size_t)wave * level->header->waveStride;
+    size_t end = start + level->header->waveStride;
+    start -= start % pageSize;
+    madvise((void *)(level->data + start), end - start, MADV_WILLNEED);
+}
+
+void setLevel(Game *game, Level *level) {
+    game->level = level;
+    startWave(game, 0);
+}
+
+void applyWaveTunings(Game *game) {
+    const WaveRecord *record = levelWave(game->level, game->hotData->wave);
+    ColdGameData *coldData = game->coldData;
+
+    coldData->hordeSpeedIncrease   = scFromFloat(record->hordeSpeedIncrease);
+    coldData->hordeStepY           = scFromFloat(record->hordeStepY);
+    coldData->enemyShipSleepTime   = scFromFloat(record->enemyShipSleepTime);
+    coldData->enemyShipDelayToFire = scFromFloat(record->enemyShipDelayToFire);
+    coldData->alienFireChance      = record->alienFireChance;
+    coldData->powerupDropChance    = record->powerupDropChance;
+    // Scales the fire chance to the tick
+    setTickDuration(game, game->tickDuration);
+}
+
+void startWave(Game *game, uint16_t wave) {
+    const Level *level = game->level;
+    const WaveRecord *record = levelWave(level, wave);
+    const uint16_t nRows = level->header->hordeRows;
+    const uint16_t nColumns = level->header->hordeColumns;
+    HotGameData *hotData = game->hotData;
+
+    hotData->wave = wave;
+    applyWaveTunings(game);
+
+    // The slot of an alien stays its cell, so the empty cells are filled then emptied
+    resetHorde(&game->horde, nRows, nColumns);
+    resetFormation(&game->formation, &game->horde);
+    for (int cell = 0; cell < nRows * nColumns; ++cell) {
+        uint16_t i = game->horde.denseIdx[cell];
+        int type = waveCellType(level, wave, cell);
+        if (type >= 0) {
+            game->horde.types[i] = (uint8_t)type;
+        } else {
+            killInFormation(&game->formation, cell);
+            removeFromPool(&game->horde, i);
+        }
+    }
+    // plus 1 from the enemy ship
+    game->enemiesAlive = game->horde.count + 1;
+
+    hotData->hordeSpeed = scFromFloat(record->hordeSpeed);
+    hotData->hordeDown = false;
+    hotData->enemyShipSpeed = -scFromFloat(record->enemyShipSpeed);
+    // The ship sleeps the time of the new wave, then fires as it shows up
+    cancelTimer(&hotData->timers, TIMER_ENEMY_SHIP_ALARM);
+    cancelTimer(&hotData->timers, TIMER_ENEMY_SHIP_FIRE);
+    if (game->enemyShip.state == ACTIVE) manageMusic(game, STOP_ENEMY_SHIP_MUSIC);
+    game->enemyShip = createEnemyShip();
+
+    // Read while this wave plays, so reaching the next one doesn't wait on the disk
+    prefetchWave(level, wave + 1);
+}
+
+typedef struct LevelSource {
+    WaveRecord *waves;
+    // Type maps of the waves, one after another
+    uint8_t    *types;
+    int         nWaves;
+    int         capacity;
+    uint16_t    nRows;
+    uint16_t    nColumns;
+} LevelSource;
+
+// Sets the tuning named key, returns false for an unknown one
+bool setWaveTuning(WaveRecord *record, const char *key, float value) {
+    static const struct { const char *key; size_t offset; } tunings[] = {
+        {"horde_speed",      offsetof(WaveRecord, hordeSpeed)},
+        {"speed_increase",   offsetof(WaveRecord, hordeSpeedIncrease)},
+        {"step_y",           offsetof(WaveRecord, hordeStepY)},
+        {"fire_chance",      offsetof(WaveRecord, alienFireChance)},
+        {"drop_chance",      offsetof(WaveRecord, powerupDropChance)},
+        {"enemy_speed",      offsetof(WaveRecord, enemyShipSpeed)},
+        {"enemy_sleep",      offsetof(WaveRecord, enemyShipSleepTime)},
+        {"enemy_fire_delay", offsetof(WaveRecord, enemyShipDelayToFire)},
+    };
+
+    for (int i = 0; i < (int)(sizeof(tunings) / sizeof(tunings[0])); ++i) {
+        if (strcmp(key, tunings[i].key) == 0) {
+            *(float *)((uint8_t *)record + tunings[i].offset) = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns the number of aliens of the row, or -1 when it isn't one
+int parseFormationRow(const char *line, uint8_t *types, uint16_t nColumns) {
+    int aliens = 0;
+    for (int col = 0; col < nColumns; ++col) {
+        if (line[col] == '.') {
+            types[col] = 0;
+        } else if (line[col] >= '1' && line[col] <= '3') {
+            types[col] = (uint8_t)(line[col] - '0');
+            aliens++;
+        } else {
+            return -1;
+        }
+    }
+
+    return line[nColumns] == '\0' ? aliens : -1;
+}
+
+int parseLevelSource(FILE *src, LevelSource *source) {
+    char *buf = NULL;
+    size_t bufSize = 0;
+    int result = 0;
+    WaveRecord defaults = DEFAULT_WAVE;
+    WaveRecord *record = &defaults;
+    // Rows of the formation still to read, and the aliens of the current wave
+    int formationRows = 0;
+    int aliens = 0;
+
+    for (int lineNumber = 1; getline(&buf, &bufSize, src) >= 0; ++lineNumber) {
+        char *line = buf;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        while (isspace((unsigned char)*line)) line++;
+        char *end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*line == '\0') continue;
+
+        char key[64];
+        float value;
+        int rows, columns;
+
+        if (formationRows > 0) {
+            uint16_t row = source->nRows - formationRows--;
+            size_t cells = (size_t)source->nRows * source->nColumns;
+            uint8_t *types = source->types + (source->nWaves - 1) * cells + row * source->nColumns;
+            int rowAliens = parseFormationRow(line, types, source->nColumns);
+            if (rowAliens < 0) {
+                fprintf(stderr, "line %d: a formation row is %u of '.', '1', '2' or '3'.\n", lineNumber, source->nColumns);
+                result = -1;
+                break;
+            }
+            aliens += rowAliens;
+        } else if (sscanf(line, "grid %d %d", &rows, &columns) == 2) {
+            GameConfig config = DEFAULT_GAME_CONFIG;
+            config.hordeRows = (uint16_t)rows;
+            config.hordeColumns = (uint16_t)columns;
+            if (source->nRows != 0 || rows <= 0 || columns <= 0 || checkGameConfig(&config) < 0) {
+                fprintf(stderr, "line %d: the grid is given once, before the waves.\n", lineNumber);
+                result = -1;
+                break;
+            }
+            source->nRows = (uint16_t)rows;
+            source->nColumns = (uint16_t)columns;
+        } else if (strcmp(line, "wave") == 0) {
+            if (source->nRows == 0) {
+                fprintf(stderr, "line %d: the grid must come before the waves.\n", lineNumber);
+                result = -1;
+                break;
+            }
+            if (source->nWaves > 0 && aliens == 0) {
+                fprintf(stderr, "line %d: the previous wave has no aliens.\n", lineNumber);
+                result = -1;
+                break;
+            }
+            if (source->nWaves == 0xffff) {
+                fprintf(stderr, "line %d: too many waves.\n", lineNumber);
+                result = -1;
+                break;
+            }
+
+            size_t cells = (size_t)source->nRows * source->nColumns;
+            if (source->nWaves == source->capacity) {
+                source->capacity = source->capacity > 0 ? 2 * source->capacity : 16;
+                source->waves = (WaveRecord *)gameRealloc(ALLOC_LEVEL, source->waves, source->capacity * sizeof(WaveRecord));
+                source->types = (uint8_t *)gameRealloc(ALLOC_LEVEL, source->types, source->capacity * cells);
+            }
+
+            record = &source->waves[source->nWaves];
+            *record = defaults;
+            memset(source->types + source->nWaves * cells, 0, cells);
+            source->nWaves++;
+            aliens = 0;
+        } else if (strcmp(line, "formation") == 0) {
+            if (record == &defaults) {
+                fprintf(stderr, "line %d: a formation belongs to a wave.\n", lineNumber);
+                result = -1;
+                break;
+            }
+            formationRows = source->nRows;
+        } else if (sscanf(line, "%63s %f", key, &value) == 2) {
+            if (!setWaveTuning(record, key, value)) {
+                fprintf(stderr, "line %d: unknown tuning %s.\n", lineNumber, key);
+                result = -1;
+                break;
+            }
+        } else {
+            fprintf(stderr, "line %d: can't parse \"%s\".\n", lineNumber, line);
+            result = -1;
+            break;
+        }
+    }
+
+    free(buf);
+    if (result < 0) return result;
+
+    if (formationRows > 0) {
+        fprintf(stderr, "the last formation is missing %d rows.\n", formationRows);
+        return -1;
+    }
+    if (source->nWaves == 0 || aliens == 0) {
+        fprintf(stderr, "the level needs waves, each with aliens.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int convertLevel(const char *srcPath, const char *dstPath) {
+    LevelSource source = {0};
+    FILE *src = fopen(srcPath, "r");
+    if (src == NULL) {
+        perror("failed to open the level source.\n");
+        return -1;
+    }
+
+    int result = parseLevelSource(src, &source);
+    fclose(src);
+    for (int i = 0; result == 0 && i < source.nWaves; ++i) {
+        if (!checkWaveRecord(&source.waves[i])) {
+            fprintf(stderr, "wave %d: tunings are finite, speeds and times not negative, chances from 0 to 1.\n", i + 1);
+            result = -1;
+        }
+    }
+    if (result < 0) {
+        gameFree(source.waves);
+        gameFree(source.types);
+        return -2;
+    }
+
+    size_t cells = (size_t)source.nRows * source.nColumns;
+    LevelHeader header = {
+        .version      = LEVEL_VERSION,
+        .nWaves       = (uint16_t)source.nWaves,
+        .hordeRows    = source.nRows,
+        .hordeColumns = source.nColumns,
+        .waveStride   = (uint32_t)((sizeof(WaveRecord) + cells + 7) / 8 * 8),
+        .checksum     = 2166136261u,
+    };
+    memcpy(header.magic, levelMagic, sizeof(levelMagic));
+
+    // The header is written again once the checksum is known
+    uint8_t *wave = (uint8_t *)gameCalloc(ALLOC_LEVEL, 1, header.waveStride);
+    FILE *dst = fopen(dstPath, "wb");
+    if (dst == NULL) {
+        perror("failed to create the level file.\n");
+        result = -3;
+    } else {
+        result = fwrite(&header, sizeof(LevelHeader), 1, dst) == 1 ? 0 : -4;
+        for (int i = 0; result == 0 && i < source.nWaves; ++i) {
+            memcpy(wave, &source.waves[i], sizeof(WaveRecord));
+            memcpy(wave + sizeof(WaveRecord), source.types + i * cells, cells);
+            header.checksum = hashBytes(header.checksum, wave, header.waveStride);
+            if (fwrite(wave, header.waveStride, 1, dst) != 1) result = -4;
+        }
+        if (result == 0 && (fseek(dst, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(LevelHeader), 1, dst) != 1)) {
+            result = -4;
+        }
+        if (fclose(dst) != 0) result = -4;
+        if (result < 0) perror("failed to write the level file.\n");
+    }
+
+    gameFree(wave);
+    gameFree(source.waves);
+    gameFree(source.types);
+    return result;
+}
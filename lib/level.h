@@ -0,0 +1,87 @@
+#ifndef _LEVEL_H_
+#define _LEVEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gameData.h"
+
+#define LEVEL_VERSION 1
+
+// The tunings of initColdGameData and initHotGameData, what a wave gets for the keys it leaves out
+#define DEFAULT_WAVE ((WaveRecord) {          \
+    .hordeSpeed           = 100.0f,           \
+    .hordeSpeedIncrease   = 25.0f,            \
+    .hordeStepY           = 100.0f,           \
+    .alienFireChance      = 1.0f / 3000.0f,   \
+    .powerupDropChance    = 0.15f,            \
+    .enemyShipSpeed       = 450.0f,           \
+    .enemyShipSleepTime   = 4.0f,             \
+    .enemyShipDelayToFire = 0.25f,            \
+})
+
+
+/**
+ * File layout, in the byte order of the machine that converted it:
+ *   LevelHeader
+ *   for every wave: WaveRecord, hordeRows * hordeColumns alien types, padding to waveStride
+ * Every wave shares the grid of the header, the session is created with it.
+ * An alien type is 0 for an empty cell and 1 to 3 for ALIEN1 to ALIEN3.
+ */
+typedef struct LevelHeader {
+    char     magic[4];
+    uint16_t version;
+    uint16_t nWaves;
+    uint16_t hordeRows;
+    uint16_t hordeColumns;
+    uint32_t waveStride;
+    // Of the waves, tells the replays recorded with another level apart
+    uint32_t checksum;
+    uint32_t padding;
+} LevelHeader;
+
+// Speeds in pixels per second, times in seconds
+typedef struct WaveRecord {
+    float hordeSpeed;
+    float hordeSpeedIncrease;
+    float hordeStepY;
+    // Chance of each living alien firing in DEFAULT_TICK_DURATION
+    float alienFireChance;
+    float powerupDropChance;
+    float enemyShipSpeed;
+    // Between two passes of the enemy ship, and before the first one
+    float enemyShipSleepTime;
+    float enemyShipDelayToFire;
+} WaveRecord;
+
+// The file is memory-mapped, the waves are read in place
+typedef struct Level {
+    const uint8_t     *data;
+    size_t             size;
+    const LevelHeader *header;
+} Level;
+
+int openLevel(Level *level, const char *path);
+void closeLevel(Level *level);
+const WaveRecord *levelWave(const Level *level, uint16_t wave);
+// Type of the alien in cell, or -1 when it's empty
+int waveCellType(const Level *level, uint16_t wave, int cell);
+// Asks the kernel to read the pages of the wave ahead, it returns right away
+void prefetchWave(const Level *level, uint16_t wave);
+
+// Plays the level from its first wave, the game must have been created with its grid
+void setLevel(Game *game, Level *level);
+// Replaces the horde with the one of the wave and applies its tunings, the next wave is prefetched
+void startWave(Game *game, uint16_t wave);
+// Puts back the cold tunings of the current wave, after its hot state was loaded
+void applyWaveTunings(Game *game);
+
+/**
+ * Writes the binary level of a text source: "grid <rows> <columns>", then a "wave" line per wave,
+ * each followed by its tunings as "<key> <value>" and a "formation" line with a line per row,
+ * '.' for an empty cell and '1' to '3' for an alien. Tunings given before the first wave are
+ * the defaults of the next ones, '#' starts a comment.
+ */
+int convertLevel(const char *srcPath, const char *dstPath);
+
+#endif
@@ -0,0 +1,111 @@
+#include "music.h"
+
+#include <raylib.h>
+
+#include "alloc.h"
+
+// How long the thread sleeps between its passes, a small part of the buffer
+#define MUSIC_POLL_SECS 0.005
+#define MUSIC_COMMANDS 64
+#define N_MUSIC_STREAMS 2
+
+
+static void applyMusic(MusicStreamer *streamer, Music *streams[N_MUSIC_STREAMS], MusicSelect music, double now) {
+    // The play and stop of a stream follow each other in MusicSelect
+    int stream = music / 2;
+    if (stream >= N_MUSIC_STREAMS) return;
+
+    if (music % 2 == 0) {
+        // Played from the start with an empty buffer, refilled on this pass
+        PlayMusicStream(*streams[stream]);
+        streamer->playing |= 1 << stream;
+        streamer->refilledAt[stream] = now;
+    } else {
+        StopMusicStream(*streams[stream]);
+        streamer->playing &= ~(1 << stream);
+    }
+}
+
+static void *streamMusic(void *arg) {
+    MusicStreamer *streamer = (MusicStreamer *)arg;
+    Music *streams[N_MUSIC_STREAMS] = {&streamer->sounds->background, &streamer->sounds->enemyShip};
+    uint8_t command;
+
+    while (!atomic_load(&streamer->stopping)) {
+        double now = monotonicSecs();
+        while (popSpsc(&streamer->commands, &command)) {
+            applyMusic(streamer, streams, (MusicSelect)command, now);
+        }
+
+        uint32_t fill = 1000;
+        for (int i = 0; i < N_MUSIC_STREAMS; ++i) {
+            unsigned int sampleRate = streams[i]->stream.sampleRate;
+            if (!(streamer->playing & (1 << i)) || sampleRate == 0) continue;
+
+            // Full after a refill, then drained at the rate of the device
+            double left = 1.0 - (now - streamer->refilledAt[i]) * sampleRate / (2.0 * MUSIC_BUFFER_FRAMES);
+            uint32_t thousandths = left > 0.0 ? (uint32_t)(left * 1000.0) : 0;
+            if (thousandths < streamer->lowestFill) streamer->lowestFill = thousandths;
+
+            if (IsAudioStreamProcessed(streams[i]->stream)) {
+                if (thousandths == 0) streamer->underruns++;
+                UpdateMusicStream(*streams[i]);
+                streamer->refilledAt[i] = now;
+                streamer->refills++;
+                thousandths = 1000;
+            }
+            if (thousandths < fill) fill = thousandths;
+        }
+        atomic_store(&streamer->fill, fill);
+
+        sleepSecs(MUSIC_POLL_SECS);
+    }
+
+    for (int i = 0; i < N_MUSIC_STREAMS; ++i) {
+        if (streamer->playing & (1 << i)) StopMusicStream(*streams[i]);
+    }
+    streamer->playing = 0;
+
+    return NULL;
+}
+
+int startMusicStreamer(MusicStreamer *streamer, Sounds *sounds) {
+    streamer->sounds = sounds;
+    streamer->playing = 0;
+    streamer->lowestFill = 1000;
+    streamer->refills = 0;
+    streamer->underruns = 0;
+    atomic_init(&streamer->stopping, false);
+    atomic_init(&streamer->fill, 1000);
+    atomic_init(&streamer->dropped, 0);
+
+    if (createSpscQueue(&streamer->commands, ALLOC_EVENTS, MUSIC_COMMANDS, sizeof(uint8_t)) < 0) return -1;
+
+    if (pthread_create(&streamer->thread, NULL, streamMusic, streamer) != 0) {
+        perror("failed to start the music thread.\n");
+        destroySpscQueue(&streamer->commands);
+        return -1;
+    }
+
+    return 0;
+}
+
+void stopMusicStreamer(MusicStreamer *streamer) {
+    atomic_store(&streamer->stopping, true);
+    pthread_join(streamer->thread, NULL);
+    destroySpscQueue(&streamer->commands);
+}
+
+void queueMusic(MusicStreamer *streamer, MusicSelect music) {
+    uint8_t command = (uint8_t)music;
+    if (!pushSpsc(&streamer->commands, &command)) atomic_fetch_add(&streamer->dropped, 1);
+}
+
+float musicFillLevel(MusicStreamer *streamer) {
+    return atomic_load(&streamer->fill) / 1000.0f;
+}
+
+void printMusicStats(FILE *out, const MusicStreamer *streamer) {
+    fprintf(out, "music: %u refills, %u underruns, %.1f%% of the buffer left at the lowest, %u changes dropped\n",
+        streamer->refills, streamer->underruns, streamer->lowestFill / 10.0, atomic_load(&streamer->dropped));
+}
@@ -0,0 +1,52 @@
+#ifndef _MUSIC_H_
+#define _MUSIC_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gameData.h"
+#include "pipeline.h"
+
+// Frames in each half of the buffer of a music stream, about 90 ms at 44.1 kHz
+#define MUSIC_BUFFER_FRAMES 4096
+
+
+/**
+ * The thread feeding the music streams. It alone plays, stops and refills them, so a hitch of
+ * the simulation or of the frames can't starve them, and they keep playing in every state.
+ * The game queues its music changes without ever waiting on it.
+ */
+typedef struct MusicStreamer {
+    Sounds      *sounds;
+    // MusicSelect, a byte each
+    SpscQueue   commands;
+    pthread_t   thread;
+    atomic_bool stopping;
+    // Thousandths of the buffer left to play in the emptiest stream playing, as of the last pass
+    atomic_uint fill;
+    // Queued while the queue was full, from the game
+    atomic_uint dropped;
+
+    // Owned by the thread, read once it's stopped
+    MusicEvents playing;
+    double      refilledAt[2];
+    uint32_t    lowestFill;
+    uint32_t    refills;
+    // Refills that came after the whole buffer had played
+    uint32_t    underruns;
+} MusicStreamer;
+
+// Returns a negative value when the thread can't be started
+int startMusicStreamer(MusicStreamer *streamer, Sounds *sounds);
+// Stops the streams, then joins the thread
+void stopMusicStreamer(MusicStreamer *streamer);
+// From the game, played on the next pass of the thread
+void queueMusic(MusicStreamer *streamer, MusicSelect music);
+// Between 0 and 1, estimated from the time since each stream was refilled
+float musicFillLevel(MusicStreamer *streamer);
+void printMusicStats(FILE *out, const MusicStreamer *streamer);
+
+#endif
@@ -0,0 +1,312 @@
+#include "pipeline.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "eventBus.h"
+#include "eventChannel.h"
+#include "gameLogic.h"
+#include "peer.h"
+#include "replay.h"
+
+#define TRIPLE_BUFFER_FRESH 4
+#define TRIPLE_BUFFER_SLOT 3
+// Frames of input and datagrams of commands the simulation can fall behind by
+#define PIPELINE_INPUTS 64
+#define PIPELINE_COMMANDS 16
+// Ticks behind its clock past which the simulation starts again from now instead of catching up in a burst
+#define PIPELINE_MAX_BEHIND 16
+
+
+double monotonicSecs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void sleepSecs(double seconds) {
+    struct timespec ts = {.tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+}
+
+int createTripleBuffer(TripleBuffer *buffer, AllocTag tag, size_t size) {
+    *buffer = (TripleBuffer) {.size = size, .back = 0, .front = 2, .started = false};
+    atomic_init(&buffer->middle, 1);
+
+    for (int i = 0; i < 3; ++i) {
+        buffer->slots[i] = (uint8_t *)gameCalloc(tag, 1, size);
+        if (buffer->slots[i] == NULL) {
+            perror("failed to allocate a triple buffer.\n");
+            destroyTripleBuffer(buffer);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void destroyTripleBuffer(TripleBuffer *buffer) {
+    for (int i = 0; i < 3; ++i) {
+        gameFree(buffer->slots[i]);
+        buffer->slots[i] = NULL;
+    }
+}
+
+void *tripleBufferBack(TripleBuffer *buffer) {
+    return buffer->slots[buffer->back];
+}
+
+void publishTripleBuffer(TripleBuffer *buffer) {
+    // Whatever the reader didn't take is recycled as the next back slot
+    buffer->back = atomic_exchange(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH) & TRIPLE_BUFFER_SLOT;
+}
+
+void *acquireTripleBuffer(TripleBuffer *buffer, bool *fresh) {
+    *fresh = (atomic_load(&buffer->middle) & TRIPLE_BUFFER_FRESH) != 0;
+    if (*fresh) {
+        buffer->front = atomic_exchange(&buffer->middle, buffer->front) & TRIPLE_BUFFER_SLOT;
+        buffer->started = true;
+    }
+
+    return buffer->started ? buffer->slots[buffer->front] : NULL;
+}
+
+int createSpscQueue(SpscQueue *queue, AllocTag tag, uint32_t capacity, uint32_t itemSize) {
+    uint32_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    queue->items = (uint8_t *)gameAlloc(tag, (size_t)size * itemSize);
+    if (queue->items == NULL) {
+        perror("failed to allocate a queue.\n");
+        return -1;
+    }
+
+    queue->itemSize = itemSize;
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 0;
+}
+
+void destroySpscQueue(SpscQueue *queue) {
+    gameFree(queue->items);
+    queue->items = NULL;
+}
+
+bool pushSpsc(SpscQueue *queue, const void *item) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) > queue->mask) return false;
+
+    memcpy(queue->items + (size_t)(tail & queue->mask) * queue->itemSize, item, queue->itemSize);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool popSpsc(SpscQueue *queue, void *item) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) return false;
+
+    memcpy(item, queue->items + (size_t)(head & queue->mask) * queue->itemSize, queue->itemSize);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+void addStageTime(StageTiming *timing, double seconds) {
+    timing->count++;
+    timing->total += seconds;
+    if (seconds > timing->worst) timing->worst = seconds;
+}
+
+void printStageTiming(FILE *out, const char *name, const StageTiming *timing) {
+    fprintf(out, "  %-10s %8u times, %9.1f us on average, %9.1f us worst\n",
+        name, timing->count, timing->count ? timing->total * 1e6 / timing->count : 0.0, timing->worst * 1e6);
+}
+
+// The pressed inputs of every frame since the last tick, and the held ones of the latest
+static Input gatherInputs(HostPipeline *pipeline, Input *held) {
+    Input input = 0, sample;
+    while (popSpsc(&pipeline->inputs, &sample)) {
+        input |= sample & ~HELD_INPUTS;
+        *held = sample & HELD_INPUTS;
+    }
+
+    return input | *held;
+}
+
+static void *runSimulation(void *arg) {
+    HostPipeline *pipeline = (HostPipeline *)arg;
+    Game *game = pipeline->game;
+    size_t snapSize = snapshotSize(&game->snapshotLayout);
+    Input held = 0;
+    double next = monotonicSecs();
+
+    while (!atomic_load(&pipeline->stopping)) {
+        double start = monotonicSecs();
+        if (start < next) {
+            sleepSecs(next - start);
+            continue;
+        }
+        addStageTime(&pipeline->jitter, start - next);
+
+        if (atomic_load(&pipeline->disconnected)) game->hotData->gameState = CLOSE;
+        game->hotData->input = gatherInputs(pipeline, &held);
+        // A datagram of commands per tick, in the order they came
+        popSpsc(&pipeline->commands, pipeline->commandsPlayer2->input);
+
+        if (pipeline->recorder != NULL && recordTick(pipeline->recorder, game, pipeline->commandsPlayer2) < 0) {
+            game->hotData->gameState = CLOSE;
+        } else {
+            updateGame(game, pipeline->commandsPlayer2, scFromFloat(game->tickDuration));
+        }
+
+        SnapshotGameState *snap = (SnapshotGameState *)tripleBufferBack(&pipeline->toRender);
+        buildSnapshot(game, snap);
+        memcpy(tripleBufferBack(&pipeline->toNetwork), snap, snapSize);
+        publishTripleBuffer(&pipeline->toRender);
+        publishTripleBuffer(&pipeline->toNetwork);
+        addStageTime(&pipeline->tick, monotonicSecs() - start);
+
+        if (game->hotData->gameState == CLOSE) break;
+        next += game->tickDuration;
+        if (monotonicSecs() - next > PIPELINE_MAX_BEHIND * game->tickDuration) next = monotonicSecs();
+    }
+
+    return NULL;
+}
+
+// The sounds the simulation published since the last comm tick, for the remote
+static void queueReplicatedEvents(EventRing *replication, EventSender *sender) {
+    GameEvent event;
+    while (popEvent(replication, &event)) {
+        if (event.type == EVENT_SOUND) queueEvent(sender, &event);
+    }
+}
+
+static void *runNetwork(void *arg) {
+    HostPipeline *pipeline = (HostPipeline *)arg;
+    Peer *peer = pipeline->peer;
+    CommandsBufPlayer2 *received = pipeline->received;
+    size_t snapSize = snapshotSize(&pipeline->game->snapshotLayout);
+    double next = monotonicSecs();
+    double lastComm = next;
+
+    while (!atomic_load(&pipeline->stopping)) {
+        double start = monotonicSecs();
+        if (start < next) {
+            sleepSecs(next - start);
+            continue;
+        }
+
+        if (start - lastComm > pipeline->timeout) {
+            atomic_store(&pipeline->disconnected, true);
+            break;
+        }
+
+        // Out of a match the inputs are empty, the acks still come
+        int recvResult = recvData(peer, (char *)received->datagram, commandsDatagramSize(received));
+        if (recvResult == 0) {
+            lastComm = start;
+            readEventAck(pipeline->sender, received->ack);
+            pushSpsc(&pipeline->commands, received->input);
+        } else if (recvResult == -2) {
+            perror("error receiving commands from player 2.\n");
+            atomic_store(&pipeline->disconnected, true);
+            break;
+        }
+
+        bool fresh;
+        SnapshotGameState *snap = (SnapshotGameState *)acquireTripleBuffer(&pipeline->toNetwork, &fresh);
+        if (snap != NULL) {
+            if (pipeline->replication != NULL) queueReplicatedEvents(pipeline->replication, pipeline->sender);
+            writeEventPacket(pipeline->sender, &snap->events, ntohl(snap->tick));
+            if (sendData(peer, (char *)snap, snapSize) == -2) {
+                perror("error sending snapshot.\n");
+                atomic_store(&pipeline->disconnected, true);
+                break;
+            }
+        }
+        addStageTime(&pipeline->exchange, monotonicSecs() - start);
+
+        next += pipeline->commDuration;
+        if (monotonicSecs() > next) next = monotonicSecs() + pipeline->commDuration;
+    }
+
+    return NULL;
+}
+
+static void releasePipeline(HostPipeline *pipeline) {
+    cleanupCommandsBuf(&pipeline->received);
+    destroySpscQueue(&pipeline->inputs);
+    destroySpscQueue(&pipeline->commands);
+    destroyTripleBuffer(&pipeline->toRender);
+    destroyTripleBuffer(&pipeline->toNetwork);
+}
+
+int startHostPipeline(
+    HostPipeline *pipeline,
+    Game *game,
+    Peer *peer,
+    CommandsBufPlayer2 *commandsPlayer2,
+    ReplayWriter *recorder,
+    EventRing *replication,
+    EventSender *sender,
+    float commDuration,
+    float timeout
+) {
+    *pipeline = (HostPipeline) {
+        .game            = game,
+        .peer            = peer,
+        .recorder        = recorder,
+        .commandsPlayer2 = commandsPlayer2,
+        .replication     = replication,
+        .sender          = sender,
+        .commDuration    = commDuration,
+        .timeout         = timeout,
+    };
+    atomic_init(&pipeline->stopping, false);
+    atomic_init(&pipeline->disconnected, false);
+
+    size_t snapSize = snapshotSize(&game->snapshotLayout);
+    pipeline->received = initCommandsBuf(commandsPlayer2->capacity);
+    if (
+        createTripleBuffer(&pipeline->toRender, ALLOC_SNAPSHOT, snapSize) < 0 ||
+        createTripleBuffer(&pipeline->toNetwork, ALLOC_SNAPSHOT, snapSize) < 0 ||
+        createSpscQueue(&pipeline->inputs, ALLOC_COMMANDS, PIPELINE_INPUTS, sizeof(Input)) < 0 ||
+        createSpscQueue(&pipeline->commands, ALLOC_COMMANDS, PIPELINE_COMMANDS, commandsPlayer2->capacity * sizeof(Input)) < 0
+    ) {
+        releasePipeline(pipeline);
+        return -1;
+    }
+
+    if (pthread_create(&pipeline->simulation, NULL, runSimulation, pipeline) != 0) {
+        perror("failed to start the simulation thread.\n");
+        releasePipeline(pipeline);
+        return -1;
+    }
+    if (peer != NULL && pthread_create(&pipeline->network, NULL, runNetwork, pipeline) != 0) {
+        perror("failed to start the network thread.\n");
+        atomic_store(&pipeline->stopping, true);
+        pthread_join(pipeline->simulation, NULL);
+        releasePipeline(pipeline);
+        return -1;
+    }
+
+    return 0;
+}
+
+void stopHostPipeline(HostPipeline *pipeline) {
+    atomic_store(&pipeline->stopping, true);
+    pthread_join(pipeline->simulation, NULL);
+    if (pipeline->peer != NULL) pthread_join(pipeline->network, NULL);
+    releasePipeline(pipeline);
+}
+
+void pushPlayerInput(HostPipeline *pipeline, Input input) {
+    pushSpsc(&pipeline->inputs, &input);
+}
+
+SnapshotGameState *latestSnapshot(HostPipeline *pipeline, bool *fresh) {
+    return (SnapshotGameState *)acquireTripleBuffer(&pipeline->toRender, fresh);
+}
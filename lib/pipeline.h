@@ -0,0 +1,132 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "alloc.h"
+#include "gameData.h"
+
+typedef struct EventRing EventRing;
+typedef struct EventSender EventSender;
+typedef struct ReplayWriter ReplayWriter;
+
+
+/**
+ * Hands the latest of a stream of buffers from one writer thread to one reader thread, neither
+ * ever waits: the writer fills its back slot and swaps it with the middle one, the reader swaps
+ * its front slot with the middle one when something new was published there.
+ */
+typedef struct TripleBuffer {
+    uint8_t     *slots[3];
+    size_t      size;
+    // Slot in the middle, with TRIPLE_BUFFER_FRESH while the reader hasn't taken it
+    atomic_uint middle;
+    // Owned by the writer
+    uint32_t    back;
+    // Owned by the reader, with whether it holds a published slot yet
+    uint32_t    front;
+    bool        started;
+} TripleBuffer;
+
+// The slots are zeroed. Returns a negative value when they can't be allocated
+int createTripleBuffer(TripleBuffer *buffer, AllocTag tag, size_t size);
+void destroyTripleBuffer(TripleBuffer *buffer);
+// The slot to fill, the reader never sees it before publishTripleBuffer
+void *tripleBufferBack(TripleBuffer *buffer);
+void publishTripleBuffer(TripleBuffer *buffer);
+// The latest slot published, the reader may write to it until the next call. NULL before the first
+void *acquireTripleBuffer(TripleBuffer *buffer, bool *fresh);
+
+// Bounded lock-free queue of items of a fixed size, for one producer and one consumer thread
+typedef struct SpscQueue {
+    uint8_t     *items;
+    uint32_t    itemSize;
+    uint32_t    mask;
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+} SpscQueue;
+
+// The capacity is rounded up to a power of two. Returns a negative value when it can't be allocated
+int createSpscQueue(SpscQueue *queue, AllocTag tag, uint32_t capacity, uint32_t itemSize);
+void destroySpscQueue(SpscQueue *queue);
+// Returns false when the queue is full
+bool pushSpsc(SpscQueue *queue, const void *item);
+// Returns false when the queue is empty
+bool popSpsc(SpscQueue *queue, void *item);
+
+// Durations of a stage in seconds, kept by the thread running it
+typedef struct StageTiming {
+    uint32_t count;
+    double   total;
+    double   worst;
+} StageTiming;
+
+void addStageTime(StageTiming *timing, double seconds);
+void printStageTiming(FILE *out, const char *name, const StageTiming *timing);
+
+/**
+ * The host split across three threads: the simulation ticks on its own clock, the network
+ * exchanges with the remote each comm tick, and the caller renders and samples the inputs.
+ * The snapshot of each tick goes to the two others through triple buffers, the inputs come
+ * back through queues, so a stalled frame or socket delays neither of the other stages.
+ */
+typedef struct HostPipeline {
+    Game               *game;
+    // NULL for a pipeline without the network stage
+    Peer               *peer;
+    ReplayWriter       *recorder;
+    // The commands the simulation applies, the network stage receives into its own
+    CommandsBufPlayer2 *commandsPlayer2;
+    CommandsBufPlayer2 *received;
+    EventRing          *replication;
+    EventSender        *sender;
+    float              commDuration;
+    float              timeout;
+
+    TripleBuffer       toRender;
+    TripleBuffer       toNetwork;
+    // Input of player 1 for each frame, from the caller
+    SpscQueue          inputs;
+    // Inputs of player 2 for each datagram of commands, from the network stage
+    SpscQueue          commands;
+
+    pthread_t          simulation;
+    pthread_t          network;
+    atomic_bool        stopping;
+    atomic_bool        disconnected;
+
+    // How late each tick started, what it took, and what each exchange took
+    StageTiming        jitter;
+    StageTiming        tick;
+    StageTiming        exchange;
+} HostPipeline;
+
+/**
+ * Starts the simulation and, when peer isn't NULL, the network thread. The game is theirs
+ * until stopHostPipeline: the caller only reads the snapshots. Returns a negative value on failure.
+ */
+int startHostPipeline(
+    HostPipeline *pipeline,
+    Game *game,
+    Peer *peer,
+    CommandsBufPlayer2 *commandsPlayer2,
+    ReplayWriter *recorder,
+    EventRing *replication,
+    EventSender *sender,
+    float commDuration,
+    float timeout
+);
+void stopHostPipeline(HostPipeline *pipeline);
+// From the caller, once per frame. Dropped when the simulation is that far behind
+void pushPlayerInput(HostPipeline *pipeline, Input input);
+// The snapshot of the latest tick, the caller's until the next call. NULL before the first one
+SnapshotGameState *latestSnapshot(HostPipeline *pipeline, bool *fresh);
+double monotonicSecs(void);
+void sleepSecs(double seconds);
+
+#endif
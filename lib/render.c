@@ -5,75 +5,99 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "entity.h"
 #include "gameData.h"
+#include "level.h"
+#include "spriteBatch.h"
 
 
-void drawEntity(Game *game, Entity *entity) {
-    if (entity->state != ACTIVE) return;
-
-    Vector2 origin = {0.0f, 0.0f};
-    float rotation = 0.0f;
-    Texture2D tex;
-    Rectangle sourceRect;
-
-    switch (entity->type) {
+// The texture of a type and the frame of its sheet, the aliens share a frame that changes on its own
+void pushEntitySprite(SpriteBatch *batch, const Animation *animation, EntityType type, Rectangle dest, Rectangle aliensFrame) {
+    switch (type) {
         case SHIP:
         {
-            tex = game->textures->ship;
-            sourceRect = game->animation->shipFrame;
+            pushSprite(batch, SPRITE_SHIP, animation->shipFrame, dest);
         } break;
         case ENEMY_SHIP:
         {
-            tex = game->textures->enemyShip;
-            sourceRect = game->animation->enemyShipFrame;
+            pushSprite(batch, SPRITE_ENEMY_SHIP, animation->enemyShipFrame, dest);
         } break;
         case ALIEN1:
         {
-            tex = game->textures->alien1;
-            sourceRect = game->animation->aliensFrame;
+            pushSprite(batch, SPRITE_ALIEN1, aliensFrame, dest);
         } break;
         case ALIEN2:
         {
-            tex = game->textures->alien2;
-            sourceRect = game->animation->aliensFrame;
+            pushSprite(batch, SPRITE_ALIEN2, aliensFrame, dest);
         } break;
         case ALIEN3:
         {
-            tex = game->textures->alien3;
-            sourceRect = game->animation->aliensFrame;
+            pushSprite(batch, SPRITE_ALIEN3, aliensFrame, dest);
         } break;
         case BULLET:
         {
-            tex = game->textures->bullet;
-            sourceRect = game->animation->bulletFrame;
+            pushSprite(batch, SPRITE_BULLET, animation->bulletFrame, dest);
         } break;
         case FAST_SHOT:
         {
-            tex = game->textures->shotPowerup;
-            sourceRect = game->animation->powerupFrame;
+            pushSprite(batch, SPRITE_SHOT_POWERUP, animation->powerupFrame, dest);
         } break;
         case FAST_MOVE:
         {
-            tex = game->textures->movePowerup;
-            sourceRect = game->animation->powerupFrame;
+            pushSprite(batch, SPRITE_MOVE_POWERUP, animation->powerupFrame, dest);
         } break;
         default: break;
     }
+}
+
+void batchEntity(Game *game, SpriteBatch *batch, Entity *entity) {
+    if (entity->state != ACTIVE) return;
 
-    // NOTE: What is the tint parameter?
-    DrawTexturePro(
-        tex, sourceRect, entity->bounds, origin, rotation, WHITE
+    pushEntitySprite(
+        batch, game->animation, entity->type, boundsToRectangle(entity->bounds), game->animation->aliensFrame
     );
 }
 
-void drawEntities(Game *game, EntitiesIterator *it) {
-    while (!iteratorReachedEnd(it)) {
-        drawEntity(game, getCurrentEntity(it));
-        iteratorNext(it);
+void batchEntities(Game *game, SpriteBatch *batch, EntityPool *pool) {
+    for (int i = 0; i < pool->count; ++i) {
+        pushEntitySprite(
+            batch,
+            game->animation,
+            (EntityType)pool->types[i],
+            boundsToRectangle(poolBounds(pool, i)),
+            game->animation->aliensFrame
+        );
     }
 }
 
+void batchHorde(Game *game, SpriteBatch *batch) {
+    for (int i = 0; i < game->horde.count; ++i) {
+        pushEntitySprite(
+            batch,
+            game->animation,
+            (EntityType)game->horde.types[i],
+            boundsToRectangle(formationBounds(&game->formation, &game->horde, i)),
+            game->animation->aliensFrame
+        );
+    }
+}
+
+void batchGame(Game *game, SpriteBatch *batch) {
+    clearSpriteBatch(batch);
+
+    batchEntity(game, batch, &game->ships[0]);
+    batchEntity(game, batch, &game->ships[1]);
+    batchEntity(game, batch, &game->enemyShip);
+
+    batchHorde(game, batch);
+    batchEntities(game, batch, &game->bulletsUp);
+    batchEntities(game, batch, &game->bulletsDown);
+    batchEntities(game, batch, &game->powerups);
+
+    sortSpriteBatch(batch);
+}
+
 void drawMenuBackground(Rectangle *rec) {
     Vector2 origin = {0.0f, 0.0f};
 
@@ -113,9 +137,9 @@ void drawTextCentered(
     DrawTextEx(font, text, textPosition, fontSize, spacing, BLACK);
 }
 
-void drawEndStatus(Game *game) {
+void drawEndStatus(Game *game, GameState gameState) {
     char message[9];
-    if (game->hotData->gameState == WIN) {
+    if (gameState == WIN) {
         strcpy(message, "VICTORY");
     } else {
         strcpy(message, "DEFEATED");
@@ -125,7 +149,7 @@ void drawEndStatus(Game *game) {
     DrawText(message, posX, 150.0f, 200, RAYWHITE);
 }
 
-void drawMenu(Game *game) {
+void drawMenu(Game *game, GameState gameState, MenuButton menuButton) {
     const float height = 400.0f;
     const float width = 600.0f;
     const float x = (game->screenWidth - width)/2.0f;
@@ -142,7 +166,7 @@ void drawMenu(Game *game) {
     char textTop[8];
     char textBottom[] = "QUIT";
     float fontSizeTop, fontSizeBottom;
-    switch (game->hotData->gameState) {
+    switch (gameState) {
         case WIN:
         case LOSE:
         {
@@ -159,7 +183,7 @@ void drawMenu(Game *game) {
         default: break;
     }
 
-    switch (game->hotData->menuButton) {
+    switch (menuButton) {
         case START:
         {
             fontSizeTop    = 100.0f;
@@ -178,165 +202,90 @@ void drawMenu(Game *game) {
 }
 
 void drawGame(Game *game) {
+    beginNoAllocZone("drawGame");
     ClearBackground(BLACK);
     DrawFPS(10, 10);
 
-    drawEntity(game, &game->ships[0]);
-    drawEntity(game, &game->ships[1]);
-    drawEntity(game, &game->enemyShip);
-    
-    EntitiesIterator hordeIt = createIterator(
-        game->horde, ALIENS, nRowsAliens*nColsAliens
-    );
-    drawEntities(game, &hordeIt);
-
-    EntitiesIterator bulletsIt = createIterator(
-        game->bullets, BULLETS, game->nBullets
-    );
-    drawEntities(game, &bulletsIt);
-
-    EntitiesIterator powerupsIt = createIterator(
-        game->powerups, POWERUPS, game->nPowerups
-    );
-    drawEntities(game, &powerupsIt);
+    batchGame(game, game->sprites);
+    submitSpriteBatch(game->sprites, game->textures);
 
     if (
         game->hotData->gameState != PLAYING  && game->hotData->gameState != CLOSE
     ) {
-        drawMenu(game);
+        drawMenu(game, game->hotData->gameState, game->hotData->menuButton);
     }
 
     if (game->hotData->gameState == WIN || game->hotData->gameState == LOSE) {
-        drawEndStatus(game);
+        drawEndStatus(game, game->hotData->gameState);
     }
+    endNoAllocZone();
 }
 
-void drawEntityNetwork(Game *game, EntityBounds bounds, EntityType type) {
-    Vector2 origin = {0.0f, 0.0f};
-    Texture2D currentTex;
-    Rectangle srcRectangle, dstRectangle;
-    switch (type) {
-        case SHIP:
-        {
-            currentTex = game->textures->ship;
-            srcRectangle = game->animation->shipFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->ships[0].bounds.height,
-                .width  = game->ships[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case ENEMY_SHIP:
-        {
-            currentTex = game->textures->enemyShip;
-            srcRectangle = game->animation->enemyShipFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->enemyShip.bounds.height,
-                .width  = game->enemyShip.bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case ALIEN1:
-        {
-            currentTex = game->textures->alien1;
-            srcRectangle = game->animation->aliensFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->horde[0].bounds.height,
-                .width  = game->horde[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case ALIEN2:
-        {
-            currentTex = game->textures->alien2;
-            srcRectangle = game->animation->aliensFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->horde[0].bounds.height,
-                .width  = game->horde[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case ALIEN3:
-        {
-            currentTex = game->textures->alien3;
-            srcRectangle = game->animation->aliensFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->horde[0].bounds.height,
-                .width  = game->horde[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case BULLET:
-        {
-            currentTex = game->textures->bullet;
-            srcRectangle = game->animation->bulletFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->bullets[0].bounds.height,
-                .width  = game->bullets[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case FAST_MOVE:
-        {
-            currentTex = game->textures->movePowerup;
-            srcRectangle = game->animation->powerupFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->powerups[0].bounds.height,
-                .width  = game->powerups[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        case FAST_SHOT:
-        {
-            currentTex = game->textures->shotPowerup;
-            srcRectangle = game->animation->powerupFrame;
-            dstRectangle = (Rectangle) {
-                .height = game->powerups[0].bounds.height,
-                .width  = game->powerups[0].bounds.width,
-                .x      = (float)ntohs(bounds.x),
-                .y      = (float)ntohs(bounds.y)
-            };
-        } break;
-        default: break;
-    }
-
-    DrawTexturePro(
-        currentTex, srcRectangle, dstRectangle, origin, 0.0f, WHITE
-    );
+void initSnapshotView(SnapshotView *view, const Game *game) {
+    *view = (SnapshotView) {
+        .sizes = {
+            [SHIP]       = game->ships[0].bounds,
+            [ENEMY_SHIP] = game->enemyShip.bounds,
+            [ALIEN1]     = {.width = game->horde.width, .height = game->horde.height},
+            [ALIEN2]     = {.width = game->horde.width, .height = game->horde.height},
+            [ALIEN3]     = {.width = game->horde.width, .height = game->horde.height},
+            [BULLET]     = {.width = game->bulletsUp.width, .height = game->bulletsUp.height},
+            [FAST_SHOT]  = {.width = game->powerups.width, .height = game->powerups.height},
+            [FAST_MOVE]  = {.width = game->powerups.width, .height = game->powerups.height},
+        },
+        .animation = *game->animation,
+        .layout    = game->snapshotLayout,
+        .level     = game->level,
+    };
 }
 
-EntityType getEntityType(int index) {
-    if (index < 22)  return ALIEN1;
-    if (index < 33)  return ALIEN2;
-    if (index < 55)  return ALIEN3;
-    if (index < 56)  return ENEMY_SHIP;
-    if (index < 58)  return SHIP;
-    if (index < 68)  return FAST_MOVE;
-    if (index < 78)  return FAST_SHOT;
-    if (index < 118) return BULLET;
+Rectangle snapshotRectangle(const SnapshotView *view, EntityBounds bounds, EntityType type) {
+    Bounds size = view->sizes[type];
+
+    return (Rectangle) {
+        .height = scToFloat(size.height),
+        .width  = scToFloat(size.width),
+        .x      = (float)ntohs(bounds.x),
+        .y      = (float)ntohs(bounds.y)
+    };
 }
 
-void drawSnapshot(Game *game, SnapshotGameState *snap) {
-    EntityType currentType;
-    ClearBackground(BLACK);
-    for (int i = 0; i < N_ENTITIES; ++i) {
-        if (snap->entities[i].x != 0 || snap->entities[i].y != 0) {
-            drawEntityNetwork(game, snap->entities[i], getEntityType(i));
+void batchSnapshot(const SnapshotView *view, SnapshotGameState *snap, SpriteBatch *batch) {
+    const SnapshotLayout *layout = &view->layout;
+    uint16_t wave = ntohs(snap->wave);
+    const Rectangle *frame = &view->animation.aliensFrame;
+    Rectangle aliensFrame = {.x = snap->alienFrame * frame->width, .y = frame->y, .width = frame->width, .height = frame->height};
+    bool waveTypes = view->level != NULL && wave < view->level->header->nWaves;
+
+    clearSpriteBatch(batch);
+    for (int r = 0; r < layout->nRanges; ++r) {
+        SnapshotRange range = layout->ranges[r];
+        for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+            if (snap->entities[i].x == 0 && snap->entities[i].y == 0) continue;
+
+            // The waves of a level give each cell its own type of alien
+            EntityType type = (EntityType)range.type;
+            if (waveTypes && i < layout->enemyShip) type = (EntityType)waveCellType(view->level, wave, i);
+            if ((unsigned)type >= N_ENTITY_TYPES) continue;
+            pushEntitySprite(batch, &view->animation, type, snapshotRectangle(view, snap->entities[i], type), aliensFrame);
         }
     }
+    sortSpriteBatch(batch);
+}
 
-    if (game->hotData->gameState != PLAYING) {
-        drawMenu(game);
+void drawSnapshot(Game *game, const SnapshotView *view, SnapshotGameState *snap) {
+    beginNoAllocZone("drawSnapshot");
+    GameState gameState = ntohl(snap->gameState);
+    ClearBackground(BLACK);
+    batchSnapshot(view, snap, game->sprites);
+    submitSpriteBatch(game->sprites, game->textures);
+
+    if (gameState != PLAYING) {
+        drawMenu(game, gameState, ntohl(snap->menuButton));
     }
 
-    if (game->hotData->gameState == WIN || game->hotData->gameState == LOSE) {
-        drawEndStatus(game);
+    if (gameState == WIN || gameState == LOSE) {
+        drawEndStatus(game, gameState);
     }
+    endNoAllocZone();
 }
@@ -3,8 +3,9 @@
 
 #include <raylib.h>
 
+#include "entity.h"
+#include "gameData.h"
 
-typedef struct SnapshotGameState SnapshotGameState;
 
 typedef enum VerticalAlignment {
     TOP,
@@ -12,9 +13,28 @@ typedef enum VerticalAlignment {
     BOTTOM,
 } VerticalAlignment;
 
-typedef struct Game Game;
+typedef struct SpriteBatch SpriteBatch;
 
+/**
+ * What drawing a snapshot takes from the game besides the snapshot, copied from it before its
+ * simulation moves to another thread, so the render stage reads nothing the ticks write.
+ */
+typedef struct SnapshotView {
+    // The snapshot only has the positions, the sizes are those of each type
+    Bounds         sizes[N_ENTITY_TYPES];
+    // Only the frame of the aliens changes, it comes with the snapshot
+    Animation      animation;
+    SnapshotLayout layout;
+    // Not owned, read only
+    const Level    *level;
+} SnapshotView;
+
+void initSnapshotView(SnapshotView *view, const Game *game);
+// The sprites of the game or of a snapshot, sorted by texture, without drawing them
+void batchGame(Game *game, SpriteBatch *batch);
+void batchSnapshot(const SnapshotView *view, SnapshotGameState *snap, SpriteBatch *batch);
 void drawGame(Game *game);
-void drawSnapshot(Game *game, SnapshotGameState *);
+// Only the sprites, textures and screen size of the game are used, none of which a tick writes
+void drawSnapshot(Game *game, const SnapshotView *view, SnapshotGameState *);
 
 #endif
\ No newline at end of file
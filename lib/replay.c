@@ -0,0 +1,292 @@
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "gameData.h"
+#include "gameLogic.h"
+#include "level.h"
+
+
+static const char replayMagic[4] = {'S', 'I', 'R', 'P'};
+
+static size_t recordSize(const ReplayHeader *header) {
+    return sizeof(Input) * (1 + header->commandsPerTick);
+}
+
+static void releaseReplayWriter(ReplayWriter *writer) {
+    fclose(writer->file);
+    gameFree(writer->keyframe);
+    gameFree(writer->index);
+    writer->file = NULL;
+    writer->keyframe = NULL;
+    writer->index = NULL;
+}
+
+int openReplayWriter(
+    ReplayWriter *writer,
+    const char *path,
+    Game *game,
+    int commandsPerTick,
+    float tickDuration,
+    uint32_t seed
+) {
+    *writer = (ReplayWriter) {
+        .file = fopen(path, "wb"),
+        .header = {
+            .version          = REPLAY_VERSION,
+            .keyframeInterval = REPLAY_KEYFRAME_INTERVAL,
+            .tickDuration     = tickDuration,
+            .seed             = seed,
+            .keyframeSize     = (uint32_t)gameStateSize(game),
+            .nBullets         = game->config.nBullets,
+            .nPowerups        = game->config.nPowerups,
+            .hordeRows        = game->config.hordeRows,
+            .hordeColumns     = game->config.hordeColumns,
+            .commandsPerTick  = (uint16_t)commandsPerTick,
+            .levelChecksum    = game->level != NULL ? game->level->header->checksum : 0,
+        },
+        .indexCapacity = 64,
+    };
+    memcpy(writer->header.magic, replayMagic, sizeof(replayMagic));
+
+    if (writer->file == NULL) {
+        perror("failed to create the replay file.\n");
+        return -1;
+    }
+
+    // The keyframes carry the RNG state, the seed is only informative
+    setTickDuration(game, tickDuration);
+    seedGame(game, seed);
+
+    writer->keyframe = (uint8_t *)gameAlloc(ALLOC_REPLAY, writer->header.keyframeSize);
+    writer->index = (ReplayIndexEntry *)gameAlloc(ALLOC_REPLAY, writer->indexCapacity * sizeof(ReplayIndexEntry));
+    if (writer->keyframe == NULL || writer->index == NULL) {
+        perror("failed to allocate the replay buffers.\n");
+        releaseReplayWriter(writer);
+        return -3;
+    }
+
+    if (fwrite(&writer->header, sizeof(ReplayHeader), 1, writer->file) != 1) {
+        perror("failed to write the replay header.\n");
+        releaseReplayWriter(writer);
+        return -2;
+    }
+
+    return 0;
+}
+
+int recordTick(ReplayWriter *writer, Game *game, CommandsBufPlayer2 *commandsPlayer2) {
+    if (writer->tick % writer->header.keyframeInterval == 0) {
+        if (writer->nKeyframes == writer->indexCapacity) {
+            ReplayIndexEntry *index = (ReplayIndexEntry *)gameRealloc(
+                ALLOC_REPLAY, writer->index, 2 * writer->indexCapacity * sizeof(ReplayIndexEntry)
+            );
+            if (index == NULL) {
+                perror("failed to grow the replay index.\n");
+                return -3;
+            }
+            writer->index = index;
+            writer->indexCapacity *= 2;
+        }
+
+        writer->index[writer->nKeyframes++] = (ReplayIndexEntry) {
+            .tick   = writer->tick,
+            .offset = (uint64_t)ftell(writer->file),
+        };
+
+        saveGameState(game, writer->keyframe);
+        if (fwrite(writer->keyframe, writer->header.keyframeSize, 1, writer->file) != 1) {
+            perror("failed to write a replay keyframe.\n");
+            return -2;
+        }
+    }
+
+    if (
+        fwrite(&game->hotData->input, sizeof(Input), 1, writer->file) != 1 ||
+        fwrite(commandsPlayer2->input, sizeof(Input), writer->header.commandsPerTick, writer->file)
+            != writer->header.commandsPerTick
+    ) {
+        perror("failed to write the replay inputs.\n");
+        return -2;
+    }
+
+    writer->tick++;
+    return 0;
+}
+
+int closeReplayWriter(ReplayWriter *writer) {
+    int result = 0;
+    ReplayFooter footer = {
+        .indexOffset = (uint64_t)ftell(writer->file),
+        .nKeyframes  = writer->nKeyframes,
+        .nTicks      = writer->tick,
+    };
+    memcpy(footer.magic, replayMagic, sizeof(replayMagic));
+
+    if (
+        fwrite(writer->index, sizeof(ReplayIndexEntry), writer->nKeyframes, writer->file) != writer->nKeyframes ||
+        fwrite(&footer, sizeof(ReplayFooter), 1, writer->file) != 1
+    ) {
+        perror("failed to write the replay index.\n");
+        result = -2;
+    }
+
+    releaseReplayWriter(writer);
+    return result;
+}
+
+/**
+ * A keyframe every keyframeInterval ticks, each followed by the records of its ticks, and the
+ * last ones ending where the index starts: the seeks and steps then stay in the file.
+ */
+static int checkReplayLayout(const ReplayReader *reader) {
+    const ReplayHeader *header = reader->header;
+    const ReplayFooter *footer = &reader->footer;
+    uint64_t interval = header->keyframeInterval;
+
+    if ((uint64_t)footer->nKeyframes != ((uint64_t)footer->nTicks + interval - 1) / interval) return -1;
+
+    uint64_t expected = sizeof(ReplayHeader);
+    for (uint32_t k = 0; k < footer->nKeyframes; ++k) {
+        uint64_t tick = k * interval;
+        uint64_t end = tick + interval < footer->nTicks ? tick + interval : footer->nTicks;
+        if (reader->index[k].tick != tick || reader->index[k].offset != expected) return -1;
+
+        expected += header->keyframeSize + (end - tick) * recordSize(header);
+        if (expected > footer->indexOffset) return -1;
+    }
+
+    return expected == footer->indexOffset ? 0 : -1;
+}
+
+int openReplayReader(ReplayReader *reader, const char *path) {
+    *reader = (ReplayReader) {0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("failed to open the replay file.\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ReplayHeader) + sizeof(ReplayFooter)) {
+        fprintf(stderr, "replay file is too small.\n");
+        close(fd);
+        return -2;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("failed to map the replay file.\n");
+        return -3;
+    }
+
+    // The header starts the mapping, which is page aligned
+    reader->data   = (const uint8_t *)data;
+    reader->size   = st.st_size;
+    reader->header = (const ReplayHeader *)reader->data;
+    memcpy(&reader->footer, reader->data + reader->size - sizeof(ReplayFooter), sizeof(ReplayFooter));
+
+    const ReplayFooter *footer = &reader->footer;
+    if (
+        memcmp(reader->header->magic, replayMagic, sizeof(replayMagic)) != 0 ||
+        memcmp(footer->magic, replayMagic, sizeof(replayMagic)) != 0 ||
+        reader->header->version != REPLAY_VERSION ||
+        reader->header->keyframeInterval == 0 ||
+        footer->nKeyframes == 0 ||
+        footer->indexOffset > reader->size - sizeof(ReplayFooter) ||
+        (uint64_t)footer->nKeyframes * sizeof(ReplayIndexEntry) != reader->size - sizeof(ReplayFooter) - footer->indexOffset
+    ) {
+        fprintf(stderr, "invalid replay file.\n");
+        closeReplayReader(reader);
+        return -4;
+    }
+
+    reader->index = (ReplayIndexEntry *)gameAlloc(ALLOC_REPLAY, footer->nKeyframes * sizeof(ReplayIndexEntry));
+    if (reader->index == NULL) {
+        perror("failed to allocate the replay index.\n");
+        closeReplayReader(reader);
+        return -3;
+    }
+    memcpy(reader->index, reader->data + footer->indexOffset, footer->nKeyframes * sizeof(ReplayIndexEntry));
+
+    if (checkReplayLayout(reader) < 0) {
+        fprintf(stderr, "corrupt replay file.\n");
+        closeReplayReader(reader);
+        return -5;
+    }
+
+    return 0;
+}
+
+void closeReplayReader(ReplayReader *reader) {
+    if (reader->data != NULL) {
+        munmap((void *)reader->data, reader->size);
+    }
+    gameFree(reader->index);
+
+    *reader = (ReplayReader) {0};
+}
+
+int replaySeek(ReplayReader *reader, Game *game, CommandsBufPlayer2 *commandsPlayer2, uint32_t tick) {
+    const ReplayHeader *header = reader->header;
+    if (
+        header->keyframeSize != gameStateSize(game) ||
+        header->nBullets != game->config.nBullets ||
+        header->nPowerups != game->config.nPowerups ||
+        header->hordeRows != game->config.hordeRows ||
+        header->hordeColumns != game->config.hordeColumns ||
+        header->levelChecksum != (game->level != NULL ? game->level->header->checksum : 0) ||
+        header->commandsPerTick != commandsPlayer2->capacity
+    ) {
+        fprintf(stderr, "replay was recorded with a different game layout.\n");
+        return -1;
+    }
+
+    if (tick > reader->footer.nTicks) tick = reader->footer.nTicks;
+
+    uint32_t keyframe = tick / header->keyframeInterval;
+    if (keyframe >= reader->footer.nKeyframes) keyframe = reader->footer.nKeyframes - 1;
+
+    setTickDuration(game, header->tickDuration);
+    loadGameState(game, reader->data + reader->index[keyframe].offset);
+    reader->tick = reader->index[keyframe].tick;
+
+    bool muted = game->muted;
+    game->muted = true;
+    while (reader->tick < tick) {
+        replayStep(reader, game, commandsPlayer2);
+    }
+    game->muted = muted;
+
+    return 0;
+}
+
+int replayStep(ReplayReader *reader, Game *game, CommandsBufPlayer2 *commandsPlayer2) {
+    const ReplayHeader *header = reader->header;
+    if (reader->tick >= reader->footer.nTicks) return 1;
+
+    uint32_t keyframe = reader->tick / header->keyframeInterval;
+    const Input *inputs = (const Input *)(
+        reader->data
+        + reader->index[keyframe].offset
+        + header->keyframeSize
+        + (reader->tick - reader->index[keyframe].tick) * recordSize(header)
+    );
+
+    game->hotData->input = inputs[0];
+    memcpy(commandsPlayer2->input, &inputs[1], header->commandsPerTick * sizeof(Input));
+    updateGame(game, commandsPlayer2, scFromFloat(header->tickDuration));
+    reader->tick++;
+
+    return 0;
+}
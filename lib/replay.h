@@ -0,0 +1,89 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gameData.h"
+
+#define REPLAY_VERSION 11
+#define REPLAY_KEYFRAME_INTERVAL 600
+
+
+/**
+ * File layout:
+ *   ReplayHeader
+ *   for every tick: [keyframe, only when tick % keyframeInterval == 0] inputs
+ *   ReplayIndexEntry[nKeyframes]
+ *   ReplayFooter
+ * The inputs of a tick are the input of player 1 followed by the commands buffer of player 2.
+ */
+typedef struct ReplayHeader {
+    char     magic[4];
+    uint16_t version;
+    uint16_t keyframeInterval;
+    float    tickDuration;
+    uint32_t seed;
+    uint32_t keyframeSize;
+    uint16_t nBullets;
+    uint16_t nPowerups;
+    uint16_t hordeRows;
+    uint16_t hordeColumns;
+    uint16_t commandsPerTick;
+    uint16_t padding;
+    // Of the level played, 0 for the default horde
+    uint32_t levelChecksum;
+} ReplayHeader;
+
+typedef struct ReplayIndexEntry {
+    uint32_t tick;
+    uint32_t padding;
+    uint64_t offset;
+} ReplayIndexEntry;
+
+typedef struct ReplayFooter {
+    uint64_t indexOffset;
+    uint32_t nKeyframes;
+    uint32_t nTicks;
+    char     magic[4];
+    uint32_t padding;
+} ReplayFooter;
+
+typedef struct ReplayWriter {
+    FILE             *file;
+    uint8_t          *keyframe;
+    ReplayIndexEntry *index;
+    ReplayHeader      header;
+    uint32_t          indexCapacity;
+    uint32_t          nKeyframes;
+    uint32_t          tick;
+} ReplayWriter;
+
+/**
+ * The file is memory-mapped, inputs and keyframes are read in place. The index and the footer
+ * follow records of any size, so they are copied out rather than read unaligned.
+ */
+typedef struct ReplayReader {
+    const uint8_t          *data;
+    size_t                  size;
+    const ReplayHeader     *header;
+    ReplayIndexEntry       *index;
+    ReplayFooter            footer;
+    uint32_t                tick;
+} ReplayReader;
+
+int openReplayWriter(ReplayWriter *writer, const char *path, Game *game, int commandsPerTick, float tickDuration, uint32_t seed);
+// Must be called right before every updateGame of the recorded session
+int recordTick(ReplayWriter *writer, Game *game, CommandsBufPlayer2 *commandsPlayer2);
+int closeReplayWriter(ReplayWriter *writer);
+
+// Checks the layout of every keyframe and record against the size of the file
+int openReplayReader(ReplayReader *reader, const char *path);
+void closeReplayReader(ReplayReader *reader);
+// Restores the nearest keyframe before tick and simulates forward to it
+int replaySeek(ReplayReader *reader, Game *game, CommandsBufPlayer2 *commandsPlayer2, uint32_t tick);
+// Runs the next recorded tick through updateGame, returns 1 when the replay is over
+int replayStep(ReplayReader *reader, Game *game, CommandsBufPlayer2 *commandsPlayer2);
+
+#endif
@@ -0,0 +1,68 @@
+#include "rng.h"
+
+#include <stdint.h>
+
+
+void seedRng(Rng *rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0;
+    rng->inc = (stream << 1) | 1;
+    rngNext(rng);
+    rng->state += seed;
+    rngNext(rng);
+}
+
+uint32_t rngNext(Rng *rng) {
+    uint64_t oldState = rng->state;
+    rng->state = oldState * 6364136223846793005ULL + rng->inc;
+
+    uint32_t xorShifted = (uint32_t)(((oldState >> 18) ^ oldState) >> 27);
+    uint32_t rot = (uint32_t)(oldState >> 59);
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+}
+
+uint32_t rngBelow(Rng *rng, uint32_t bound) {
+    return (uint32_t)(((uint64_t)rngNext(rng) * bound) >> 32);
+}
+
+uint64_t chanceToFixed(float chance) {
+    if (!(chance > 0)) return 0;
+    if (chance >= 1) return RNG_FIXED_ONE;
+
+    return (uint64_t)((double)chance * (double)RNG_FIXED_ONE);
+}
+
+uint64_t negLog2Fixed(uint64_t x) {
+    int msb = 63 - __builtin_clzll(x);
+    // The mantissa in [1, 2) as Q2.30, each squaring gives the next bit of its log
+    uint64_t m = msb > 30 ? x >> (msb - 30) : x << (30 - msb);
+    uint64_t fraction = 0;
+    for (int bit = 31; bit >= 2; --bit) {
+        m = (m * m) >> 30;
+        if (m >= UINT64_C(2) << 30) {
+            m >>= 1;
+            fraction |= UINT64_C(1) << bit;
+        }
+    }
+
+    return ((uint64_t)(32 - msb) << 32) - fraction;
+}
+
+uint64_t geometricRate(uint64_t chance, uint32_t ticks) {
+    if (chance == 0 || ticks == 0) return 0;
+    if (chance >= RNG_FIXED_ONE) return UINT64_MAX;
+
+    uint64_t perUnit = negLog2Fixed(RNG_FIXED_ONE - chance);
+    if (perUnit > (UINT64_MAX - 1) / ticks) return UINT64_MAX - 1;
+    uint64_t rate = (perUnit * ticks) >> 16;
+    return rate > 0 ? rate : 1;
+}
+
+uint32_t rngGeometric(Rng *rng, uint64_t rate) {
+    // Never a success or always one, without drawing
+    if (rate == 0) return UINT32_MAX;
+    if (rate == UINT64_MAX) return 0;
+
+    // Inverse CDF, u is in (0, 1] so the log is always defined
+    uint64_t failures = negLog2Fixed((uint64_t)rngNext(rng) + 1) / rate;
+    return failures >= UINT32_MAX ? UINT32_MAX : (uint32_t)failures;
+}
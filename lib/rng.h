@@ -0,0 +1,33 @@
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stdint.h>
+
+
+// 1 in the Q32.32 chances and rates of the draws, which only take integers so every build draws the same
+#define RNG_FIXED_ONE (UINT64_C(1) << 32)
+
+
+// PCG32 (XSH RR), small enough to live in the game state and be saved in replays
+typedef struct Rng {
+    uint64_t state;
+    uint64_t inc;
+} Rng;
+
+void seedRng(Rng *rng, uint64_t seed, uint64_t stream);
+uint32_t rngNext(Rng *rng);
+// Uniform in [0, bound)
+uint32_t rngBelow(Rng *rng, uint32_t bound);
+// A chance in Q32.32, exact as it's only scaled by a power of two, clamped to [0, 1]
+uint64_t chanceToFixed(float chance);
+// -log2(x / 2^32) in Q32.32 for x in [1, 2^32]
+uint64_t negLog2Fixed(uint64_t x);
+/**
+ * Rate of rngGeometric for trials succeeding with chance each over a unit of time, and run for
+ * ticks (Q16.16) of that unit: -log2 of failing for the whole of them, UINT64_MAX for a sure success.
+ */
+uint64_t geometricRate(uint64_t chance, uint32_t ticks);
+// Number of failed trials before the next success, UINT32_MAX for a rate of 0
+uint32_t rngGeometric(Rng *rng, uint64_t rate);
+
+#endif
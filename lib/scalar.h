@@ -0,0 +1,89 @@
+#ifndef _SCALAR_H_
+#define _SCALAR_H_
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * Numeric type of the simulation (positions, speeds and timers).
+ * Building with -DFIXED_POINT_SIM switches it to Q16.16 fixed point, which gives the same
+ * results on every compiler and flag set (no -ffast-math or FMA contraction surprises).
+ * Convert to float only at render time with scToFloat.
+ */
+#ifdef FIXED_POINT_SIM
+
+typedef int32_t Scalar;
+
+#define SCALAR_FRAC_BITS 16
+#define SCALAR_ONE (1 << SCALAR_FRAC_BITS)
+// Only for constant expressions, it's folded by the compiler
+#define SC(x) ((Scalar)((x) >= 0 ? (x) * (double)SCALAR_ONE + 0.5 : (x) * (double)SCALAR_ONE - 0.5))
+
+static inline Scalar scMul(Scalar a, Scalar b) {
+    return (Scalar)(((int64_t)a * b + (SCALAR_ONE >> 1)) >> SCALAR_FRAC_BITS);
+}
+
+static inline Scalar scDiv(Scalar a, Scalar b) {
+    return (Scalar)(((int64_t)a << SCALAR_FRAC_BITS) / b);
+}
+
+static inline Scalar scFromFloat(float f) {
+    return (Scalar)(f >= 0.0f ? f * SCALAR_ONE + 0.5f : f * SCALAR_ONE - 0.5f);
+}
+
+static inline Scalar scFromInt(int i) {
+    return (Scalar)(i * SCALAR_ONE);
+}
+
+static inline float scToFloat(Scalar a) {
+    return (float)a / (float)SCALAR_ONE;
+}
+
+// Truncates toward zero like a float to int cast
+static inline int scToInt(Scalar a) {
+    return a / SCALAR_ONE;
+}
+
+// floor(a / b) as an integer
+static inline int scFloorDiv(Scalar a, Scalar b) {
+    int q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+#else
+
+typedef float Scalar;
+
+#define SC(x) ((Scalar)(x))
+
+static inline Scalar scMul(Scalar a, Scalar b) {
+    return a * b;
+}
+
+static inline Scalar scDiv(Scalar a, Scalar b) {
+    return a / b;
+}
+
+static inline Scalar scFromFloat(float f) {
+    return f;
+}
+
+static inline Scalar scFromInt(int i) {
+    return (Scalar)i;
+}
+
+static inline float scToFloat(Scalar a) {
+    return a;
+}
+
+static inline int scToInt(Scalar a) {
+    return (int)a;
+}
+
+static inline int scFloorDiv(Scalar a, Scalar b) {
+    return (int)floorf(a / b);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+#include "spriteBatch.h"
+
+#include <string.h>
+
+#include "gameData.h"
+
+
+size_t spriteBatchBytes(uint32_t capacity) {
+    return arenaBytes(sizeof(SpriteBatch))
+        + 2 * arenaBytes(capacity * sizeof(SpriteQuad))
+        + arenaBytes(capacity * sizeof(uint8_t));
+}
+
+SpriteBatch *createSpriteBatch(Arena *arena, uint32_t capacity) {
+    SpriteBatch *batch = (SpriteBatch *)arenaAlloc(arena, sizeof(SpriteBatch));
+    if (batch == NULL) return NULL;
+
+    *batch = (SpriteBatch) {
+        .quads    = (SpriteQuad *)arenaAlloc(arena, capacity * sizeof(SpriteQuad)),
+        .textures = (uint8_t *)arenaAlloc(arena, capacity * sizeof(uint8_t)),
+        .sorted   = (SpriteQuad *)arenaAlloc(arena, capacity * sizeof(SpriteQuad)),
+        .capacity = capacity,
+    };
+    if (batch->quads == NULL || batch->textures == NULL || batch->sorted == NULL) return NULL;
+
+    return batch;
+}
+
+void clearSpriteBatch(SpriteBatch *batch) {
+    memset(batch->bucketStart, 0, sizeof(batch->bucketStart));
+    batch->count = 0;
+    batch->switches = 0;
+    batch->dropped = 0;
+}
+
+void pushSprite(SpriteBatch *batch, SpriteTexture texture, Rectangle source, Rectangle dest) {
+    if (batch->count == batch->capacity) {
+        batch->dropped++;
+        return;
+    }
+
+    if (batch->count == 0 || batch->textures[batch->count - 1] != texture) batch->switches++;
+    batch->quads[batch->count] = (SpriteQuad) {.source = source, .dest = dest};
+    batch->textures[batch->count] = (uint8_t)texture;
+    batch->count++;
+}
+
+void sortSpriteBatch(SpriteBatch *batch) {
+    uint32_t counts[N_SPRITE_TEXTURES] = {0};
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        counts[batch->textures[i]]++;
+    }
+
+    uint32_t next[N_SPRITE_TEXTURES];
+    batch->bucketStart[0] = 0;
+    for (int t = 0; t < N_SPRITE_TEXTURES; ++t) {
+        next[t] = batch->bucketStart[t];
+        batch->bucketStart[t + 1] = batch->bucketStart[t] + counts[t];
+    }
+
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        batch->sorted[next[batch->textures[i]]++] = batch->quads[i];
+    }
+}
+
+uint32_t spriteDrawCalls(const SpriteBatch *batch) {
+    uint32_t calls = 0;
+    for (int t = 0; t < N_SPRITE_TEXTURES; ++t) {
+        if (batch->bucketStart[t + 1] > batch->bucketStart[t]) calls++;
+    }
+
+    return calls;
+}
+
+void submitSpriteBatch(const SpriteBatch *batch, const Textures *textures) {
+    const Texture2D sheets[N_SPRITE_TEXTURES] = {
+        [SPRITE_SHIP]         = textures->ship,
+        [SPRITE_ENEMY_SHIP]   = textures->enemyShip,
+        [SPRITE_ALIEN1]       = textures->alien1,
+        [SPRITE_ALIEN2]       = textures->alien2,
+        [SPRITE_ALIEN3]       = textures->alien3,
+        [SPRITE_BULLET]       = textures->bullet,
+        [SPRITE_SHOT_POWERUP] = textures->shotPowerup,
+        [SPRITE_MOVE_POWERUP] = textures->movePowerup,
+    };
+    Vector2 origin = {0.0f, 0.0f};
+
+    // The quads of a texture go to the same batch of raylib, drawn in one call
+    for (int t = 0; t < N_SPRITE_TEXTURES; ++t) {
+        for (uint32_t i = batch->bucketStart[t]; i < batch->bucketStart[t + 1]; ++i) {
+            DrawTexturePro(sheets[t], batch->sorted[i].source, batch->sorted[i].dest, origin, 0.0f, WHITE);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef _SPRITE_BATCH_H_
+#define _SPRITE_BATCH_H_
+
+#include <raylib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+typedef struct Textures Textures;
+
+
+// A bucket per texture, in the order the categories were drawn before, so the layering holds
+typedef enum SpriteTexture {
+    SPRITE_SHIP,
+    SPRITE_ENEMY_SHIP,
+    SPRITE_ALIEN1,
+    SPRITE_ALIEN2,
+    SPRITE_ALIEN3,
+    SPRITE_BULLET,
+    SPRITE_SHOT_POWERUP,
+    SPRITE_MOVE_POWERUP,
+    N_SPRITE_TEXTURES
+} SpriteTexture;
+
+typedef struct SpriteQuad {
+    Rectangle source;
+    Rectangle dest;
+} SpriteQuad;
+
+/**
+ * The sprites of a frame, pushed in any order and drawn a texture after the other. Each
+ * texture switch breaks the batch of raylib into another draw call, bucketed there is one
+ * per texture in use. Nothing here needs a window, only submitSpriteBatch draws.
+ */
+typedef struct SpriteBatch {
+    // In the order they were pushed, with the texture of each
+    SpriteQuad *quads;
+    uint8_t    *textures;
+    // By texture once sorted, each bucket keeps the order of the pushes
+    SpriteQuad *sorted;
+    uint32_t   bucketStart[N_SPRITE_TEXTURES + 1];
+    uint32_t   capacity;
+    uint32_t   count;
+    // Texture switches in the order of the pushes, the draw calls they'd take unsorted
+    uint32_t   switches;
+    // Pushed past the capacity, never drawn
+    uint32_t   dropped;
+} SpriteBatch;
+
+size_t spriteBatchBytes(uint32_t capacity);
+// NULL when the arena was sized too small
+SpriteBatch *createSpriteBatch(Arena *arena, uint32_t capacity);
+void clearSpriteBatch(SpriteBatch *batch);
+void pushSprite(SpriteBatch *batch, SpriteTexture texture, Rectangle source, Rectangle dest);
+// Buckets the quads by texture, in linear time
+void sortSpriteBatch(SpriteBatch *batch);
+// Once sorted, a call per texture in use
+uint32_t spriteDrawCalls(const SpriteBatch *batch);
+void submitSpriteBatch(const SpriteBatch *batch, const Textures *textures);
+
+#endif
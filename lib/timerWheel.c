@@ -0,0 +1,78 @@
+#include "timerWheel.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_REACH (1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+
+// Into the slot of the lowest level whose span covers how far away the timer is
+static void linkTimer(TimerWheel *wheel, uint16_t timer) {
+    Timer *t = &wheel->timers[timer];
+    uint32_t delta = t->expires - wheel->now;
+    uint32_t tick = delta < TIMER_WHEEL_REACH ? t->expires : wheel->now + TIMER_WHEEL_REACH - 1;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= 1u << ((level + 1) * TIMER_WHEEL_BITS)) ++level;
+    uint16_t slot = level * TIMER_WHEEL_SLOTS + ((tick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+
+    t->prev = 0;
+    t->next = wheel->slots[slot];
+    t->slot = slot + 1;
+    if (t->next != 0) wheel->timers[t->next - 1].prev = timer + 1;
+    wheel->slots[slot] = timer + 1;
+}
+
+static void unlinkTimer(TimerWheel *wheel, uint16_t timer) {
+    Timer *t = &wheel->timers[timer];
+    if (t->prev != 0) {
+        wheel->timers[t->prev - 1].next = t->next;
+    } else {
+        wheel->slots[t->slot - 1] = t->next;
+    }
+    if (t->next != 0) wheel->timers[t->next - 1].prev = t->prev;
+
+    t->next = 0;
+    t->prev = 0;
+    t->slot = 0;
+}
+
+void scheduleTimer(TimerWheel *wheel, uint16_t timer, uint32_t tick) {
+    if (wheel->timers[timer].slot != 0) unlinkTimer(wheel, timer);
+
+    // Compared through the difference, the ticks may wrap
+    wheel->timers[timer].expires = (int32_t)(tick - wheel->now) > 0 ? tick : wheel->now + 1;
+    linkTimer(wheel, timer);
+}
+
+void cancelTimer(TimerWheel *wheel, uint16_t timer) {
+    if (wheel->timers[timer].slot != 0) unlinkTimer(wheel, timer);
+}
+
+bool timerPending(const TimerWheel *wheel, uint16_t timer) {
+    return wheel->timers[timer].slot != 0;
+}
+
+void advanceTimerWheel(TimerWheel *wheel, TimerCallback expired, void *data) {
+    uint32_t now = ++wheel->now;
+
+    // Each level that just wrapped hands the slot of the turn starting now to the levels below
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        if ((now & ((1u << (level * TIMER_WHEEL_BITS)) - 1)) != 0) break;
+
+        uint16_t *slot = &wheel->slots[level * TIMER_WHEEL_SLOTS + ((now >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK)];
+        uint16_t timer = *slot;
+        *slot = 0;
+        while (timer != 0) {
+            uint16_t next = wheel->timers[timer - 1].next;
+            linkTimer(wheel, timer - 1);
+            timer = next;
+        }
+    }
+
+    // What expired schedules again lands at least a tick later, so never in this slot
+    uint16_t *slot = &wheel->slots[now & TIMER_WHEEL_MASK];
+    while (*slot != 0) {
+        uint16_t timer = *slot - 1;
+        unlinkTimer(wheel, timer);
+        expired(data, timer);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 3
+#define MAX_TIMERS 16
+
+
+// The links are an index plus 1, so 0 is none and a zeroed timer isn't scheduled
+typedef struct Timer {
+    uint32_t expires;
+    uint16_t next;
+    uint16_t prev;
+    uint16_t slot;
+} Timer;
+
+/**
+ * Hierarchical wheel of whole ticks: level 0 has a slot per tick for the next 64 ticks, each
+ * level above a slot per turn of the one below. Scheduling and cancelling are O(1), and so is
+ * a tick whatever the number of pending timers, the slot of an upper level is only moved down
+ * when the level below wraps. Timers further away than the wheel reaches wait in its last slot.
+ * A zeroed wheel is empty at tick 0, and without pointers it's copied with the state it's in.
+ */
+typedef struct TimerWheel {
+    uint32_t now;
+    uint16_t slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+    Timer    timers[MAX_TIMERS];
+} TimerWheel;
+
+// Called for each timer expiring on a tick, it may schedule timers again
+typedef void (*TimerCallback)(void *data, uint16_t timer);
+
+// At the absolute tick, one already past expires on the next tick. A pending timer is moved
+void scheduleTimer(TimerWheel *wheel, uint16_t timer, uint32_t tick);
+void cancelTimer(TimerWheel *wheel, uint16_t timer);
+bool timerPending(const TimerWheel *wheel, uint16_t timer);
+void advanceTimerWheel(TimerWheel *wheel, TimerCallback expired, void *data);
+
+#endif
@@ -1,9 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/bench.h"
 #include "../lib/game.h"
+#include "../lib/gameData.h"
+#include "../lib/level.h"
 
 
 int main(int argc, char *argv[]) {
-    if (argc < 1) return -1;
-    int ret = mainLoop(argv[1]);
+    if (argc < 2) return -1;
+    if (strcmp(argv[1], "bench") == 0) return benchMain(argc - 2, argv + 2);
+    if (strcmp(argv[1], "replay") == 0) {
+        if (argc < 3) return -1;
+        return replayLoop(argv[2], argc > 3 ? (uint32_t)atoi(argv[3]) : 0, argc > 4 ? argv[4] : NULL);
+    }
+    // Converts the text source of a level to the binary file the game loads
+    if (strcmp(argv[1], "level") == 0) {
+        if (argc < 4) return -1;
+        return convertLevel(argv[2], argv[3]) < 0 ? -1 : 0;
+    }
+
+    /**
+     * Options of host and remote go last, both peers must be given the same ones:
+     * "--rate <hz>", "--horde <rows>x<columns>", "--bullets <n>", "--powerups <n>" and "--level <file>",
+     * but "--threads <n>" which only the host uses
+     */
+    float tickDuration = DEFAULT_TICK_DURATION;
+    GameConfig config = DEFAULT_GAME_CONFIG;
+    const char *levelPath = NULL;
+    int nThreads = 1;
+    while (argc > 3 && strncmp(argv[argc - 2], "--", 2) == 0) {
+        const char *option = argv[argc - 2];
+        const char *value = argv[argc - 1];
+        long count;
+
+        if (strcmp(option, "--rate") == 0) {
+            int rate = atoi(value);
+            if (rate <= 0) return -1;
+            tickDuration = 1.0f / rate;
+        } else if (strcmp(option, "--horde") == 0) {
+            if (parseHordeSize(value, &config) < 0) return -1;
+        } else if (strcmp(option, "--bullets") == 0) {
+            if (parseCount(value, 0xffff, &count) < 0) return -1;
+            config.nBullets = (uint16_t)count;
+        } else if (strcmp(option, "--powerups") == 0) {
+            if (parseCount(value, 0xffff, &count) < 0) return -1;
+            config.nPowerups = (uint16_t)count;
+        } else if (strcmp(option, "--level") == 0) {
+            levelPath = value;
+        } else if (strcmp(option, "--threads") == 0) {
+            nThreads = atoi(value);
+            if (nThreads <= 0) return -1;
+        } else {
+            return -1;
+        }
+        argc -= 2;
+    }
+
+    int ret = mainLoop(argv[1], argc > 2 ? argv[2] : NULL, levelPath, tickDuration, config, nThreads);
     if (ret != 0) return ret;
 
     return 0;